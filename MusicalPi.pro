@@ -55,7 +55,22 @@ SOURCES += main.cpp\
     oursettings.cpp \
     focuswatcher.cpp \
     settingsitem.cpp \
-    playlists.cpp
+    playlists.cpp \
+    allocationcounter.cpp \
+    tilerenderthread.cpp \
+    librarythread.cpp \
+    librarysql.cpp \
+    librarymodel.cpp \
+    searchindex.cpp \
+    librarysnapshot.cpp \
+    librarywatcher.cpp \
+    tagfacets.cpp \
+    thumbnailthread.cpp \
+    bookinfo.cpp \
+    textindex.cpp \
+    pagecache.cpp \
+    usagelog.cpp \
+    playlistorder.cpp
 
 HEADERS  += mainwindow.h \
     button.h \
@@ -74,7 +89,22 @@ HEADERS  += mainwindow.h \
     oursettings.h \
     focuswatcher.h \
     settingsitem.h \
-    playlists.h
+    playlists.h \
+    allocationcounter.h \
+    tilerenderthread.h \
+    librarythread.h \
+    librarysql.h \
+    librarymodel.h \
+    searchindex.h \
+    librarysnapshot.h \
+    librarywatcher.h \
+    tagfacets.h \
+    thumbnailthread.h \
+    bookinfo.h \
+    textindex.h \
+    pagecache.h \
+    usagelog.h \
+    playlistorder.h
 
 DISTFILES += \
     MusicalPi.gif \
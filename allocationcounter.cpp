@@ -0,0 +1,78 @@
+// Copyright 2023 by Linwood Ferguson, licensed under GNU GPLv3
+
+#include "allocationcounter.h"
+
+#ifdef MUSICALPI_DEBUG_PAGE_TURN_CHECK
+
+#include <cassert>
+#include <cstddef>
+
+// These are glibc's own entry points; our replacements below count and then forward to them,
+// so memory still comes from (and is freed by) the normal allocator.  Linux/glibc only, which
+// is all this runs on anyway (ALSA, dbus).
+
+extern "C" void* __libc_malloc(size_t size);
+extern "C" void* __libc_calloc(size_t count, size_t size);
+extern "C" void* __libc_realloc(void* ptr, size_t size);
+
+// Thread local so render threads never show up in a count taken on the GUI thread.  These are
+// plain static TLS in the executable, so touching them from inside malloc does not itself allocate.
+
+static thread_local bool counting = false;
+static thread_local int suspended = 0;
+static thread_local long allocations = 0;
+static thread_local long excludedAllocations = 0;
+
+extern "C" void* malloc(size_t size)
+{
+    if(counting) (suspended ? excludedAllocations : allocations)++;
+    return __libc_malloc(size);
+}
+
+extern "C" void* calloc(size_t count, size_t size)
+{
+    if(counting) (suspended ? excludedAllocations : allocations)++;
+    return __libc_calloc(count, size);
+}
+
+extern "C" void* realloc(void* ptr, size_t size)
+{
+    if(counting) (suspended ? excludedAllocations : allocations)++;
+    return __libc_realloc(ptr, size);
+}
+
+allocationCounter::allocationCounter()
+{
+    assert(!counting);  // nesting counters would make the numbers meaningless
+    allocations = 0;
+    excludedAllocations = 0;
+    suspended = 0;
+    counting = true;
+}
+
+allocationCounter::~allocationCounter()
+{
+    counting = false;
+}
+
+long allocationCounter::count()
+{
+    return allocations;
+}
+
+long allocationCounter::excluded()
+{
+    return excludedAllocations;
+}
+
+allocationCounter::uncounted::uncounted()
+{
+    suspended++;
+}
+
+allocationCounter::uncounted::~uncounted()
+{
+    suspended--;
+}
+
+#endif // MUSICALPI_DEBUG_PAGE_TURN_CHECK
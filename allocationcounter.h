@@ -0,0 +1,46 @@
+#ifndef ALLOCATIONCOUNTER_H
+#define ALLOCATIONCOUNTER_H
+
+// Copyright 2023 by Linwood Ferguson, licensed under GNU GPLv3
+
+// Debugging aid only, compiled in when MUSICALPI_DEBUG_PAGE_TURN_CHECK is defined in piconstants.h.
+//
+// It interposes malloc/calloc/realloc (which also catches operator new and Qt's own containers)
+// and counts heap allocations made by the current thread while an allocationCounter exists.
+// Allocations in other threads (e.g. the render threads) are never counted.
+//
+// A few calls on the page turn path hand work to Qt's event loop (widget update requests, timer
+// registration) and allocate inside Qt where we cannot avoid it; those are wrapped in
+// MUSICALPI_UNCOUNTED_ALLOCATIONS and kept out of count(), but are tallied in excluded() so it
+// is plain how much the turn allocates in all.  A zero count() therefore means our own code made
+// no allocations, not that the turn as a whole made none.
+
+#include "piconstants.h"
+
+#ifdef MUSICALPI_DEBUG_PAGE_TURN_CHECK
+
+class allocationCounter
+{
+public:
+    allocationCounter();   // Starts counting on this thread (only one may be active per thread)
+    ~allocationCounter();  // and stops
+    long count();          // Allocations seen since construction, outside uncounted scopes
+    long excluded();       // and inside them
+
+    class uncounted        // Suspends counting for its lifetime
+    {
+    public:
+        uncounted();
+        ~uncounted();
+    };
+};
+
+#define MUSICALPI_UNCOUNTED_ALLOCATIONS allocationCounter::uncounted uncountedScope; (void)uncountedScope;
+
+#else
+
+#define MUSICALPI_UNCOUNTED_ALLOCATIONS
+
+#endif // MUSICALPI_DEBUG_PAGE_TURN_CHECK
+
+#endif // ALLOCATIONCOUNTER_H
@@ -0,0 +1,200 @@
+// Copyright 2023 by Linwood Ferguson, licensed under GNU GPLv3
+
+#include <QDebug>
+#include <QFile>
+#include <QFileInfo>
+#include <QDateTime>
+#include <QDir>
+#include <QSaveFile>
+#include <QDataStream>
+#include <QStandardPaths>
+#include <QCryptographicHash>
+
+#include "bookinfo.h"
+#include "piconstants.h"
+
+#include <poppler/qt6/poppler-qt6.h>
+
+#include <algorithm>
+
+#define BOOKINFO_MAGIC 0x4D504249   // "MPBI"
+#define BOOKINFO_VERSION 3
+
+bookInfo::bookInfo()
+{
+    fileSize = modified = 0;
+    pageCount = 0;
+    hasMidi = false;
+    songsKnown = false;
+}
+
+QString bookInfo::folder()
+{
+    return QStandardPaths::writableLocation(QStandardPaths::AppLocalDataLocation) + "/books";
+}
+
+QString bookInfo::fileName(const QString& path)
+{
+    return folder() + "/" + QCryptographicHash::hash(path.toUtf8(), QCryptographicHash::Sha1).toHex().left(16) + ".info";
+}
+
+QString bookInfo::midiPath(const QString& path)
+{
+    if(!path.endsWith(".pdf",Qt::CaseInsensitive)) return QString();
+    return path.left(path.length() - 4) + ".mid";
+}
+
+bool bookInfo::find(const QString& path, bool verify)
+{
+    QFile file(fileName(path));
+    if(!file.open(QIODevice::ReadOnly)) return false;
+    QDataStream in(&file);
+    in.setVersion(QDataStream::Qt_6_0);
+    quint32 magic, version;
+    qint32 pages, entries;
+    in >> magic >> version;
+    if(magic != BOOKINFO_MAGIC || version != BOOKINFO_VERSION) return false;
+    in >> filepath >> fileSize >> modified >> hasMidi >> pages >> pageSizes >> entries;
+    pageCount = pages;
+    outline.clear();
+    for(int i = 0; i < entries && in.status() == QDataStream::Ok; i++)
+    {
+        outlineEntry entry;
+        qint32 page, level;
+        in >> entry.title >> page >> level;
+        entry.page = page;
+        entry.level = level;
+        outline.append(entry);
+    }
+    if(outline.size() != entries) return false;
+    in >> entries;
+    songs.clear();
+    for(int i = 0; i < entries && in.status() == QDataStream::Ok; i++)
+    {
+        song thisSong;
+        qint32 first, last;
+        in >> thisSong.title >> first >> last;
+        thisSong.firstPage = first;
+        thisSong.lastPage = last;
+        songs.append(thisSong);
+    }
+    in >> songsKnown;
+    if(in.status() != QDataStream::Ok || filepath != path || songs.size() != entries) return false;
+    if(!verify) return true;
+    QFileInfo info(path);  // One look at the PDF to be sure it's the same, much less than opening it
+    return info.size() == fileSize && info.lastModified().toMSecsSinceEpoch() == modified;
+}
+
+static void addOutline(const QVector<Poppler::OutlineItem>& items, int level, QList<bookInfo::outlineEntry>& outline)
+{
+    for(const Poppler::OutlineItem& item : items)
+    {
+        QSharedPointer<const Poppler::LinkDestination> destination = item.destination();
+        if(destination && destination->pageNumber() > 0) outline.append({item.name(), destination->pageNumber(), level});
+        if(item.hasChildren()) addOutline(item.children(), level + 1, outline);
+    }
+}
+
+bool bookInfo::read(const QString& path, bool withSongs)
+{
+    QFileInfo info(path);
+    filepath = path;
+    fileSize = info.size();
+    modified = info.lastModified().toMSecsSinceEpoch();
+    std::unique_ptr<Poppler::Document> document = Poppler::Document::load(path);
+    if(!document || document->isLocked())
+    {
+        qDebug() << "Could not open " << path;
+        return false;
+    }
+    pageCount = document->numPages();
+    pageSizes.clear();
+    pageSizes.reserve(pageCount);
+    for(int page = 0; page < pageCount; page++)
+    {
+        std::unique_ptr<Poppler::Page> thisPage = document->page(page);
+        pageSizes.append(thisPage ? thisPage->pageSizeF() : QSizeF());
+    }
+    outline.clear();
+    addOutline(document->outline(), 0, outline);
+    songs.clear();
+    songsKnown = withSongs;
+    if(withSongs) findSongs(document.get());
+    QFileInfo midi(midiPath(path));
+    hasMidi = midi.exists() && midi.isFile();
+    save();
+    qDebug() << "Read " << path << ", " << pageCount << " pages, " << outline.size() << " outline entries, " << songs.size() << " songs" << (hasMidi ? ", with midi" : "");
+    return true;
+}
+
+static QString pageTitle(Poppler::Page* page)
+{
+    // The largest text in the top quarter of the page, if it's clearly larger than most of the text on it
+    std::vector<std::unique_ptr<Poppler::TextBox>> boxes = page->textList();
+    if(boxes.empty()) return QString();
+    QVector<double> heights;
+    double tallest = 0;
+    double top = page->pageSizeF().height() / 4;
+    for(const std::unique_ptr<Poppler::TextBox>& box : boxes)
+    {
+        heights.append(box->boundingBox().height());
+        if(box->boundingBox().top() < top) tallest = std::max(tallest, box->boundingBox().height());
+    }
+    std::nth_element(heights.begin(), heights.begin() + heights.size() / 2, heights.end());
+    if(tallest < heights[heights.size() / 2] * MUSICALPI_SONG_TITLE_SCALE) return QString();
+    QString title;
+    for(const std::unique_ptr<Poppler::TextBox>& box : boxes)  // (in the order Poppler gives them, which is close to reading order)
+        if(box->boundingBox().top() < top && box->boundingBox().height() >= tallest * 0.9) title += (title.isEmpty() ? "" : " ") + box->text();
+    title = title.simplified();
+    bool letters = false;
+    for(const QChar& c : title) letters = letters || c.isLetter();
+    return letters && title.length() >= 3 ? title.left(80) : QString();
+}
+
+void bookInfo::findSongs(Poppler::Document* document)
+{
+    songs.clear();
+    if(pageCount < MUSICALPI_SONG_INDEX_MIN_PAGES) return;
+    for(int i = 0; i < outline.size(); i++)
+        if(i + 1 == outline.size() || outline[i + 1].level <= outline[i].level)  // Nothing under it
+            songs.append({outline[i].title, outline[i].page, pageCount});
+    if(songs.isEmpty())
+        for(int page = 0; page < pageCount; page++)
+        {
+            std::unique_ptr<Poppler::Page> thisPage = document->page(page);
+            QString title = thisPage ? pageTitle(thisPage.get()) : QString();
+            if(!title.isEmpty() && (songs.isEmpty() || songs.last().title != title)) songs.append({title, page + 1, pageCount});  // (the same title again is a continued song or a running heading)
+        }
+    std::stable_sort(songs.begin(), songs.end(), [](const song& a, const song& b) { return a.firstPage < b.firstPage; });
+    for(int i = 0; i + 1 < songs.size(); i++) songs[i].lastPage = std::max(songs[i].firstPage, songs[i + 1].firstPage - 1);
+    if(songs.size() < 2) songs.clear();  // One song is just the book
+}
+
+bool bookInfo::checkMidi()
+{
+    QFileInfo midi(midiPath(filepath));
+    bool found = midi.exists() && midi.isFile();
+    if(found == hasMidi) return false;
+    hasMidi = found;
+    save();
+    return true;
+}
+
+void bookInfo::save() const
+{
+    QDir().mkpath(folder());
+    QSaveFile file(fileName(filepath));  // Written aside and renamed over, as two threads may save the same book
+    if(!file.open(QIODevice::WriteOnly))
+    {
+        qDebug() << "Could not write " << file.fileName() << ", " << file.errorString();
+        return;
+    }
+    QDataStream out(&file);
+    out.setVersion(QDataStream::Qt_6_0);
+    out << (quint32)BOOKINFO_MAGIC << (quint32)BOOKINFO_VERSION << filepath << fileSize << modified << hasMidi << (qint32)pageCount << pageSizes << (qint32)outline.size();
+    for(const outlineEntry& entry : outline) out << entry.title << (qint32)entry.page << (qint32)entry.level;
+    out << (qint32)songs.size();
+    for(const song& thisSong : songs) out << thisSong.title << (qint32)thisSong.firstPage << (qint32)thisSong.lastPage;
+    out << songsKnown;
+    if(!file.commit()) qDebug() << "Could not write " << file.fileName() << ", " << file.errorString();
+}
@@ -0,0 +1,64 @@
+#ifndef BOOKINFO_H
+#define BOOKINFO_H
+
+// Copyright 2023 by Linwood Ferguson, licensed under GNU GPLv3
+
+#include <QString>
+#include <QList>
+#include <QVector>
+#include <QSizeF>
+
+namespace Poppler { class Document; }
+
+// What we need to know about a book's PDF before showing it: page count and sizes, its outline (bookmarks), and
+// whether there is a .mid to play with it.  Getting this means opening the PDF with Poppler over the network, so
+// it's kept on local storage, a small file per book, and is good for as long as the PDF's size and modification
+// time are unchanged.  The library's background pipeline (thumbnailThread) fills it in for books as they're seen,
+// so a book being opened usually finds it there and PDFDocument can start laying out and caching pages at once.
+//
+// Books with many pages are usually anthologies, so the songs in them are found too: from the outline if it has one
+// (its entries with none under them), otherwise from title text (the largest text near the top of a page starts a
+// new song).  The library searches these so a song can be opened at its page.  Finding them can mean getting the
+// text of every page, so it's only done when asked for, by the library's indexing in the background; opening a book
+// never waits for it.
+
+class bookInfo
+{
+public:
+    struct outlineEntry
+    {
+        QString title;
+        int page;             // Starting page 1
+        int level;            // 0 at the top, 1 for entries under those, and so on
+    };
+    struct song
+    {
+        QString title;
+        int firstPage;        // Starting page 1
+        int lastPage;
+    };
+    QString filepath;
+    qint64 fileSize;
+    qint64 modified;          // ms since epoch
+    int pageCount;
+    QVector<QSizeF> pageSizes;    // in 72's of inch
+    QList<outlineEntry> outline;  // In document order (a parent before its children)
+    QList<song> songs;        // In page order; none unless there are at least two
+    bool songsKnown;          // songs were looked for (none may have been found)
+    bool hasMidi;             // There is a .mid file beside the PDF
+
+    bookInfo();
+    bool find(const QString& path, bool verify = true);  // From the store, false if it's not there or (if verifying) the PDF has changed since
+    bool read(const QString& path, bool withSongs = false);  // From the PDF itself (and store it), false if it can't be opened
+    bool get(const QString& path) { return find(path) || read(path); }
+    bool checkMidi();                // Look again for the .mid (and store if that changed); true if it did
+    static QString midiPath(const QString& path);
+
+private:
+    static QString folder();
+    static QString fileName(const QString& path);
+    void save() const;
+    void findSongs(Poppler::Document* document);
+};
+
+#endif // BOOKINFO_H
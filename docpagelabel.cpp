@@ -8,15 +8,26 @@
 #include <QPainter>
 #include <QBitmap>
 #include <QColor>
+#include <QPaintEngine>
+#include <QMouseEvent>
+#include <QWheelEvent>
+#include <QGestureEvent>
+#include <QPinchGesture>
 
 #include <cassert>
+#include <cstring>
+#include <cmath>
+#include <utility>
 
 #include "oursettings.h"
+#include "allocationcounter.h"
+#include "tilerenderthread.h"
+#include "pdfdocument.h"
 
 // Note terminology:
 //   The transition is the page contents appearing somewhere
 //   The highlight is the, occasional, surrounding boarder to call one's attention to the page change
-// Transitions will influence the type of highlight shown but they are done in different QLabels overlaid
+// Transitions will influence the type of highlight shown but they are drawn separately, over the page
 
 docPageLabel::docPageLabel(QWidget *parent,MainWindow* mp) : QLabel(parent)
 {
@@ -31,79 +42,106 @@ docPageLabel::docPageLabel(QWidget *parent,MainWindow* mp) : QLabel(parent)
     pageHighlightDelay=mParent->ourSettingsPtr->getSetting("pageHighlightDelay").toInt();
     pageTurnDelay=mParent->ourSettingsPtr->getSetting("pageTurnDelay").toInt();
 
-    ourOverlay.setParent(this);
-    ourOverlay.hide();
-    ourHighlightOverlay.setParent(this);
-    ourHighlightOverlay.hide();
-    ourHighlightOverlay.setAttribute(Qt::WA_TranslucentBackground);
-    our2ndHighlightOverlay.setParent(this);
-    our2ndHighlightOverlay.hide();
-    our2ndHighlightOverlay.setAttribute(Qt::WA_TranslucentBackground);
+    shownFrame = -1;
+    showOldOverlay = false;
+    oldOverlayTop = 0;
+    showHighlight = false;
+    show2ndHighlight = false;
+#ifdef MUSICALPI_DEBUG_PAGE_TURN_CHECK
+    paintedToFormat = QImage::Format_Invalid;
+#endif
+
     ourOverlayTimer.setInterval(pageTurnDelay);
     ourOverlayTimer.setSingleShot(true);
     connect(&ourOverlayTimer, &QTimer::timeout,
         [=]()
         {
-            qDebug() << "Hiding overlay";
-            ourOverlay.hide();
+            if(mParent->debugPageTurns) qDebug() << "Hiding overlay";
+            showOldOverlay = false;
+            update();
         }
      );
     ourHighlightShowTimer.setSingleShot(true);
     connect(&ourHighlightShowTimer, &QTimer::timeout,
         [=]()
         {
-            qDebug() << "Showing highlight";
-            ourHighlightOverlay.show();
+            if(mParent->debugPageTurns) qDebug() << "Showing highlight";
+            showHighlight = true;
+            update();
         }
      );
     ourHighlightHideTimer.setSingleShot(true);
     connect(&ourHighlightHideTimer, &QTimer::timeout,
         [=]()
         {
-            qDebug() << "Hiding highlight";
-            ourHighlightOverlay.hide();
+            if(mParent->debugPageTurns) qDebug() << "Hiding highlight";
+            showHighlight = false;
+            update();
         }
      );
     our2ndHighlightShowTimer.setSingleShot(true);
     connect(&our2ndHighlightShowTimer, &QTimer::timeout,
         [=]()
         {
-            qDebug() << "Showing 2nd highlight";
-            our2ndHighlightOverlay.show();
+            if(mParent->debugPageTurns) qDebug() << "Showing 2nd highlight";
+            show2ndHighlight = true;
+            update();
         }
      );
     our2ndHighlightHideTimer.setSingleShot(true);
     connect(&our2ndHighlightHideTimer, &QTimer::timeout,
         [=]()
         {
-            qDebug() << "Hiding 2nd highlight";
-            our2ndHighlightOverlay.hide();
+            if(mParent->debugPageTurns) qDebug() << "Hiding 2nd highlight";
+            show2ndHighlight = false;
+            update();
         }
      );
     newImageIsBlank = false;
     oldImageIsBlank = false;
+
+    shownPage = 0;
+    shownSource = NULL;
+    spareShownFrame = -1;
+    sparePage = 0;
+    spareSource = NULL;
+    spareIsBlank = false;
+    zoomLevel = 0;
+    zoom = 1.0;
+    pinchStartLevel = 0;
+    dragging = false;
+    dragged = false;
+    tileGeneration = 0;
+    tileThread = NULL;
+    tileCache.setMaxCost(mParent->ourSettingsPtr->getSetting("tileCacheMB").toInt() * 1024);
+    setAttribute(Qt::WA_AcceptTouchEvents);
+    grabGesture(Qt::PinchGesture);
 }
 
 docPageLabel::~docPageLabel()
 {
    qDebug() << "in destructor";
-   // clean up????
+   DELETE_LOG(tileThread);
+}
+
+void docPageLabel::placeImage(docPageLabel::docTransition thisTransition, const QColor& color)
+{
+    if(mParent->debugPageTurns) qDebug() << "Switching placement request for blank image as it is outside of page range";
+    newImageIsBlank = true;  // This will remember that the image was blank (too hard to check the frame itself)
+    placeFrame(thisTransition, NULL, color, 0);
 }
 
-void docPageLabel::placeImage(docPageLabel::docTransition thisTransition, QString color)
+void docPageLabel::placeImage(docPageLabel::docTransition thisTransition, const QImage* newImageBuffer, const QColor& color, int pageNumber)
 {
-    QImage* blankImage = new QImage(this->width(), this->height(), QImage::Format_RGB32);
-    blankImage->fill(color);
-    qDebug() << "Switching placement request for blank image as it is outside of page range";
-    newImageIsBlank = true;  // This will remember that the image was blank (too hard to check the pixmap itself
-    placeImage(thisTransition, blankImage, color);
+    assert(newImageBuffer);
+    placeFrame(thisTransition, newImageBuffer, color, pageNumber);
 }
 
-void docPageLabel::placeImage(docPageLabel::docTransition thisTransition, QImage* newImageBuffer, QString color)
+void docPageLabel::placeFrame(docPageLabel::docTransition thisTransition, const QImage* newImageBuffer, const QColor& color, int pageNumber)
 {
-    // This handles (some) transitions by putting an overlay with the OLD image
-    // on top, where it can be left for a period of time, but the NEW is the
-    // permanent, underlying image.  If there is no transition then no overlay is created.
+    // This handles (some) transitions by drawing the OLD frame on top of the new one, where it can be
+    // left for a period of time, but the NEW is the permanent, underlying image.  If there is no
+    // transition then the old frame is not drawn.
     //
     // Possible transitions:
     //
@@ -112,55 +150,65 @@ void docPageLabel::placeImage(docPageLabel::docTransition thisTransition, QImage
     //                      Note this means the overlay is a half screen down
     //   fullPage           Page will remain unchanged for transition time, then brief highlight
     //   fullPageNow        Page is displayed immediately, with brief highlight
+    //
+    // This is on the page turn path, so once the frames exist for our size it should not allocate other than
+    // inside Qt's update and timer calls (checked by hand with MUSICALPI_DEBUG_PAGE_TURN_CHECK); debug output
+    // is only produced if asked for in settings.
 
-    assert(newImageBuffer);
-    qDebug() << "Entered with transition type = " << thisTransition
-             << ", and image of size " << newImageBuffer->width() << "x" << newImageBuffer->height()
-             << ", container is " << this->width() << "x" << this->height();
+    if(mParent->debugPageTurns)
+        qDebug() << "Entered with transition type = " << thisTransition
+                 << ", and image of size " << (newImageBuffer ? newImageBuffer->width() : this->width()) << "x" << (newImageBuffer ? newImageBuffer->height() : this->height())
+                 << ", container is " << this->width() << "x" << this->height();
 
     // Just kill any timers and hide any overlays we have now as we will make new
     HideAnyInProgressTransitions();
+    if(zoomLevel > 0) resetZoom();  // Never when playing, so this is off the page turn path
 
-    // We form an image here of what we need to display with suitable background and centered, the image in pageImages
-    // does not have these borders.  The new image is formed first so we can copy it into the overlay if needed
-    QImage newImage(this->width(), this->height(),QImage::Format_ARGB32_Premultiplied);
-    newImage.fill(QColor(color));   // We have to paint this not transparent since pages are different sizes
-    // We should only be scaling down never up(pdfDocument takes care of that),
-    // We do need need to recalculate scale with possibility we are scalling down
-    float scale = std::min((float)(this->width())  / (float)(newImageBuffer->width()),
-                           (float)(this->height()) / (float)(newImageBuffer->height()));
-
-    // If we aim for a scale of 1, generally scale at this point will be 1 or very slightly higher; but never
-    // scale up.  If we were doubling scale for precision on notational scores, this will come out at 1/2 or so, etc.
+    if(frames[0].size() != this->size())
+    {
+        // Either back to the size before this one, whose frames we kept, or a new size (and the current frames become
+        // the ones kept).  For a new size, or first use, there is nothing at our size to transition from.
+        swapSpareFrames();
+        if(frames[0].size() != this->size())
+        {
+            frames[0] = QImage(this->size(), mParent->pageImageFormat);
+            frames[1] = QImage(this->size(), mParent->pageImageFormat);
+            shownFrame = -1;
+            shownSource = NULL;
+        }
+    }
+    if(shownFrame != -1 && thisTransition == noTransition && newImageBuffer == shownSource && pageNumber == shownPage &&
+       (newImageBuffer == NULL ? oldImageIsBlank : newImageBuffer->size() == shownSourceSize))
+    {
+        // Already composed (e.g. a mode switch or re-layout back to a size we had), so at most the background changes
+        if(mParent->debugPageTurns) qDebug() << "Page " << pageNumber << " already in frame, not recomposed";
+        if(color != shownColor) recolorMargins(color);
+        {
+            MUSICALPI_UNCOUNTED_ALLOCATIONS
+            update();
+        }
+        newImageIsBlank = false;
+        return;
+    }
+    int newFrame = (shownFrame == 0) ? 1 : 0;  // The one not shown holds the page before last, and is free to reuse
 
-    scale = std::min((float)1.0,scale);  // Never scale up
+    // We form an image here of what we need to display with suitable background and centered, the image in pageImages
+    // does not have these borders.
+    QRect pageArea = composeFrame(frames[newFrame], newImageBuffer, color);
+    shownPageArea = pageArea;
+    shownColor = color;
+    shownPage = pageNumber;  // Only needed to render tiles if we zoom in
+    shownSource = newImageBuffer;
+    shownSourceSize = newImageBuffer ? newImageBuffer->size() : QSize();
 
-    qDebug() << "Scale of drawImage for new image (should be <= 1, ideally == 1 in play mode for quality)  = " << scale;
-    int newW = newImageBuffer->width() * scale;
-    int newH = newImageBuffer->height() * scale;
-    int newX = (this->width() - newW)/2;
-    int newY = (this->height() - newH)/2;
-    QPainter pNew(&newImage);
-    pNew.setRenderHint(QPainter::SmoothPixmapTransform);
-    pNew.setRenderHint(QPainter::Antialiasing);
-    pNew.drawImage( QRectF (newX, newY, newW, newH), *newImageBuffer);  // This implicitly draws the whole from image, scaling if needed
-
-    // While we have all the new image info, go ahead and build the highlight overlay(s)
-    // according to the transition type.  This is just the highlight overlay, not the
-    // page transition overlay which comes next.
-    if(!newImageIsBlank || thisTransition == noTransition)  // if the new page is blank there is no highlight regardless, also if no transition
-    {
-        QImage frameImage(QImage(this->width(), this->height(), QImage::Format_ARGB32));
-        frameImage.fill(Qt::transparent);
-        QPainter hp(&frameImage);
-        hp.setBrush(QBrush(Qt::green,Qt::Dense4Pattern));
-        hp.setPen(Qt::NoPen);
+    // While we have all the new image info, go ahead and set up the highlight(s) according
+    // to the transition type.  This is just the highlight, not the page transition overlay which comes next.
+    if(!newImageIsBlank)  // if the new page is blank there is no highlight regardless (and none for noTransition)
+    {
+        MUSICALPI_UNCOUNTED_ALLOCATIONS  // timer (re)registration happens inside Qt
         if(thisTransition == fullPageNow || thisTransition == fullPage)
         {
-            hp.drawRect(newX,newY,newW,pageHighlightHeight);
-            hp.drawRect(newX,newY,pageHighlightHeight,newH);
-            hp.drawRect(newX,newY + newH-pageHighlightHeight,newW,pageHighlightHeight);
-            hp.drawRect(newX + newW-pageHighlightHeight,newY,pageHighlightHeight,newH);
+            highlightArea = pageArea;
             if(thisTransition == fullPageNow)
             {
                 ourHighlightShowTimer.setInterval(1);
@@ -171,38 +219,18 @@ void docPageLabel::placeImage(docPageLabel::docTransition thisTransition, QImage
                 ourHighlightShowTimer.setInterval(pageTurnDelay);
                 ourHighlightHideTimer.setInterval(pageTurnDelay + pageHighlightDelay);
             }
-            ourHighlightOverlay.setGeometry(0,0,this->geometry().width(),this->geometry().height());   // lay over ourself
-            ourHighlightOverlay.setPixmap(QPixmap::fromImage(frameImage));
             ourHighlightShowTimer.start();
             ourHighlightHideTimer.start();
         }
         else if (thisTransition == halfPage)
         {
-            // First draw top half which appears immediately
-            hp.drawRect(newX,newY,newW,pageHighlightHeight);   // top left across
-            hp.drawRect(newX,newY,pageHighlightHeight,newH/2); // top left down
-            hp.drawRect(newX,newY + newH/2 -pageHighlightHeight,newW,pageHighlightHeight);  // bottom left across
-            hp.drawRect(newX + newW - pageHighlightHeight,newY,pageHighlightHeight,newH/2);  // top right down
+            // First the top half which appears immediately, then bottom half which appears later
+            highlightArea = QRect(pageArea.x(), pageArea.y(), pageArea.width(), pageArea.height() / 2);
+            highlight2ndArea = QRect(pageArea.x(), pageArea.y() + pageArea.height() / 2, pageArea.width(), pageArea.height() - pageArea.height() / 2);
             ourHighlightShowTimer.setInterval(1);
             ourHighlightHideTimer.setInterval(1 + pageHighlightDelay);
-            ourHighlightOverlay.setGeometry(0,0,this->geometry().width(),this->geometry().height());   // lay over ourself
-            ourHighlightOverlay.setPixmap(QPixmap::fromImage(frameImage));
-
-            // now bottom half which appears later
-            QImage frame2ndImage(QImage(this->width(), this->height(), QImage::Format_ARGB32));
-            frame2ndImage.fill(Qt::transparent);
-            QPainter hp2(&frame2ndImage);
-            hp2.setBrush(QBrush(Qt::green,Qt::Dense4Pattern));
-            hp2.setPen(Qt::NoPen);
-            hp2.drawRect(newX,newY + newH/2,newW,pageHighlightHeight);
-            hp2.drawRect(newX,newY + newH/2,pageHighlightHeight,newH/2);
-            hp2.drawRect(newX,newY + newH-pageHighlightHeight,newW,pageHighlightHeight);
-            hp2.drawRect(newX + newW-pageHighlightHeight,newY + newH/2,pageHighlightHeight,newH/2);
             our2ndHighlightShowTimer.setInterval(pageTurnDelay);
             our2ndHighlightHideTimer.setInterval(pageTurnDelay + pageHighlightDelay);
-            our2ndHighlightOverlay.setGeometry(0,0,this->geometry().width(),this->geometry().height());   // lay over ourself
-            our2ndHighlightOverlay.setPixmap(QPixmap::fromImage(frame2ndImage));
-
             ourHighlightShowTimer.start();
             ourHighlightHideTimer.start();
             our2ndHighlightShowTimer.start();
@@ -211,41 +239,422 @@ void docPageLabel::placeImage(docPageLabel::docTransition thisTransition, QImage
     }
 
     // This is the page image transition overlay, if needed.
-    // This is the OLD image, the new image is always placed inside "this", so to show it
-    // we just remove the ourOverlay at the right time.
+    // This is the OLD frame, the new frame is what is displayed, so to show it
+    // we just stop drawing the old one at the right time.
 
-    if((thisTransition != noTransition && thisTransition != fullPageNow) && !this->pixmap().isNull() && !oldImageIsBlank) // this latter is still the old image; if none no transition regardless
+    if((thisTransition != noTransition && thisTransition != fullPageNow) && shownFrame != -1 && !oldImageIsBlank) // if no old image no transition regardless
     {
-        ourOverlay.setGeometry(0,0,this->geometry().width(),this->geometry().height());  // Position directly over
-        QPixmap tmpPixmap = this->pixmap().copy();  // grab the old image -- the overlay is what is OLD not new, new will be underneath
-        if(thisTransition == halfPage)  // we have to replace the top half
-        {
-            // For overlay just divide it in half do not rescale, and paint new over old
-            QPainter pOld(&tmpPixmap);
-            QRectF sameFromTo(0,0,tmpPixmap.width(), tmpPixmap.height()/2);
-            pOld.drawImage(sameFromTo,newImage,sameFromTo);
-        }
-        //else thisTransition == fullPage (but not fullPageNow)
-        ourOverlay.setPixmap(tmpPixmap);
-        ourOverlay.show();
-        qDebug() << "Starting timer to hide overlay";
+        showOldOverlay = true;
+        oldOverlayTop = (thisTransition == halfPage) ? this->height() / 2 : 0;  // For half page the new top half shows through
+        if(mParent->debugPageTurns) qDebug() << "Starting timer to hide overlay";
+        MUSICALPI_UNCOUNTED_ALLOCATIONS
         ourOverlayTimer.start();
     }
-    this->setPixmap(QPixmap::fromImage(newImage));
+    shownFrame = newFrame;
+    {
+        MUSICALPI_UNCOUNTED_ALLOCATIONS  // posting the repaint happens inside Qt
+        update();
+    }
 
     // This awkward technique records in this instance whether the image now displayed is blank
     oldImageIsBlank = newImageIsBlank;  // remember what we just loaded
     newImageIsBlank = false;  // reseet for next call, since in this variant we can't tell directly
 }
+
+QRect docPageLabel::composeFrame(QImage& frame, const QImage* newImageBuffer, const QColor& color)
+{
+    // Fill the frame with the background and center the page in it, returning where the page went.
+    // We have to paint the background not transparent since pages are different sizes.
+    frame.fill(color);
+    if(newImageBuffer == NULL) return frame.rect();  // blank page
+
+    // We should only be scaling down never up (pdfDocument takes care of that),
+    // We do need need to recalculate scale with possibility we are scalling down
+    float scale = std::min((float)(frame.width())  / (float)(newImageBuffer->width()),
+                           (float)(frame.height()) / (float)(newImageBuffer->height()));
+
+    // Pages are rendered (and scaled down in the render thread) for the play mode size, so in play mode scale
+    // comes out 1; other layouts (e.g. review with the menu showing, or 4 x 2) are smaller and scale down here.
+
+    scale = std::min((float)1.0,scale);  // Never scale up
+
+    int newW = newImageBuffer->width() * scale;
+    int newH = newImageBuffer->height() * scale;
+    int newX = (frame.width() - newW)/2;
+    int newY = (frame.height() - newH)/2;
+    if(scale == (float)1.0 && newImageBuffer->format() == frame.format())
+    {
+        // Usual case when playing: a row by row copy with no painter (which would allocate)
+        int bytesPerPixel = frame.depth() / 8;
+        for(int y = 0; y < newH; y++)
+            memcpy(frame.scanLine(newY + y) + newX * bytesPerPixel, newImageBuffer->constScanLine(y), newW * bytesPerPixel);
+    }
+    else
+    {
+        if(mParent->debugPageTurns) qDebug() << "Scale of drawImage for new image (should be <= 1, ideally == 1 in play mode for quality)  = " << scale;
+        QPainter pNew(&frame);
+        pNew.setRenderHint(QPainter::SmoothPixmapTransform);
+        pNew.setRenderHint(QPainter::Antialiasing);
+        pNew.drawImage( QRectF (newX, newY, newW, newH), *newImageBuffer);  // This implicitly draws the whole from image, scaling if needed
+    }
+    return QRect(newX, newY, newW, newH);
+}
+
+void docPageLabel::swapSpareFrames()
+{
+    std::swap(frames[0], spareFrames[0]);  // QImage swaps are just the data pointers
+    std::swap(frames[1], spareFrames[1]);
+    std::swap(shownFrame, spareShownFrame);
+    std::swap(shownPage, sparePage);
+    std::swap(shownPageArea, sparePageArea);
+    std::swap(shownColor, spareColor);
+    std::swap(shownSource, spareSource);
+    std::swap(shownSourceSize, spareSourceSize);
+    std::swap(oldImageIsBlank, spareIsBlank);
+}
+
+void docPageLabel::recolorMargins(const QColor& color)
+{
+    // Refill only what is around the page, which is all that differs between modes
+    QImage& frame = frames[shownFrame];
+    if(shownSource == NULL) frame.fill(color);
+    else
+    {
+        QPainter p(&frame);
+        QRect page = shownPageArea;
+        p.fillRect(0, 0, frame.width(), page.top(), color);                                                         // above
+        p.fillRect(0, page.bottom() + 1, frame.width(), frame.height() - page.bottom() - 1, color);                  // below
+        p.fillRect(0, page.top(), page.left(), page.height(), color);                                               // left
+        p.fillRect(page.right() + 1, page.top(), frame.width() - page.right() - 1, page.height(), color);          // right
+    }
+    shownColor = color;
+}
+
+void docPageLabel::drawHighlight(QPainter& p, const QRect& area)
+{
+    p.drawRect(area.x(), area.y(), area.width(), pageHighlightHeight);                                          // top across
+    p.drawRect(area.x(), area.y(), pageHighlightHeight, area.height());                                         // left down
+    p.drawRect(area.x(), area.y() + area.height() - pageHighlightHeight, area.width(), pageHighlightHeight);   // bottom across
+    p.drawRect(area.x() + area.width() - pageHighlightHeight, area.y(), pageHighlightHeight, area.height());    // right down
+}
+
+void docPageLabel::paintEvent(QPaintEvent *e)
+{
+    QPainter p(this);
+    if(shownFrame == -1)
+    {
+        p.fillRect(e->rect(), mParent->pageBackground);  // Nothing yet, so just the mode's background (we have no style sheet for it)
+        return;
+    }
+    if(zoomLevel > 0)
+    {
+        paintZoomed(p, e->rect());
+        return;
+    }
+#ifdef MUSICALPI_DEBUG_PAGE_TURN_CHECK
+    QPaintDevice* target = p.paintEngine()->paintDevice();  // the backing store, if raster
+    paintedToFormat = (target && target->devType() == QInternal::Image) ? static_cast<QImage*>(target)->format() : QImage::Format_Invalid;
+#endif
+    p.drawImage(0, 0, frames[shownFrame]);  // Same format as the backing store, so this is a copy not a conversion
+    if(showOldOverlay)
+    {
+        QRect oldArea(0, oldOverlayTop, this->width(), this->height() - oldOverlayTop);
+        p.drawImage(oldArea, frames[shownFrame == 0 ? 1 : 0], oldArea);
+    }
+    if(showHighlight || show2ndHighlight)
+    {
+        p.setBrush(QBrush(Qt::green,Qt::Dense4Pattern));
+        p.setPen(Qt::NoPen);
+        if(showHighlight) drawHighlight(p, highlightArea);
+        if(show2ndHighlight) drawHighlight(p, highlight2ndArea);
+    }
+}
+
+void docPageLabel::clearPage()
+{
+    // Frames are kept (if we come back at the same size they are reused) but nothing is shown
+    HideAnyInProgressTransitions();
+    resetZoom();
+    dropTiles();  // The next page shown may be another book's, with the same page numbers
+    shownFrame = -1;
+    shownSource = NULL;
+    spareShownFrame = -1;
+    spareSource = NULL;
+    oldImageIsBlank = false;
+    newImageIsBlank = false;
+    QLabel::clear();
+    update();
+}
+
 void docPageLabel::HideAnyInProgressTransitions()
 {
     // Used to interrupt transitions if a sudden change occurs (e.g. a subsequent page turn before this finished)
-    ourOverlay.hide();
-    ourHighlightOverlay.hide();
-    our2ndHighlightOverlay.hide();
+    if(showOldOverlay || showHighlight || show2ndHighlight)
+    {
+        MUSICALPI_UNCOUNTED_ALLOCATIONS
+        update();
+    }
+    showOldOverlay = false;
+    showHighlight = false;
+    show2ndHighlight = false;
     ourOverlayTimer.stop();
     ourHighlightShowTimer.stop();
     ourHighlightHideTimer.stop();
     our2ndHighlightShowTimer.stop();
     our2ndHighlightHideTimer.stop();
 }
+
+void docPageLabel::mousePressEvent(QMouseEvent *e)
+{
+    if(zoomLevel > 0 && canZoom())  // Start of a pan; accepting it means we get the moves
+    {
+        dragging = true;
+        dragged = false;
+        dragLast = e->position().toPoint();
+        e->accept();
+        return;
+    }
+    QLabel::mousePressEvent(e);
+}
+
+void docPageLabel::mouseMoveEvent(QMouseEvent *e)
+{
+    if(!dragging)
+    {
+        QLabel::mouseMoveEvent(e);
+        return;
+    }
+    QPoint delta = e->position().toPoint() - dragLast;
+    if(!dragged && delta.manhattanLength() < 4) return;  // Not yet far enough to be a pan rather than a tap
+    dragged = true;
+    dragLast = e->position().toPoint();
+    panBy(delta);
+}
+
+void docPageLabel::mouseReleaseEvent(QMouseEvent *e)
+{
+    bool wasPan = dragging && dragged;
+    dragging = false;
+    if(wasPan)
+    {
+        e->accept();
+        return;
+    }
+    emit clicked();
+    QLabel::mouseReleaseEvent(e);  // ignores it, so MainWindow still sees it
+}
+
+void docPageLabel::mouseDoubleClickEvent(QMouseEvent *e)
+{
+    // Toggle between fitted and a useful reading zoom centered where tapped
+    if(!canZoom())
+    {
+        QLabel::mouseDoubleClickEvent(e);
+        return;
+    }
+    if(zoomLevel > 0) resetZoom();
+    else setZoom(4, e->position().toPoint());
+}
+
+void docPageLabel::wheelEvent(QWheelEvent *e)
+{
+    // Ctrl+wheel zooms (for use without a touch screen), otherwise the wheel pans when zoomed in
+    if(canZoom() && (e->modifiers() & Qt::ControlModifier))
+    {
+        setZoom(zoomLevel + e->angleDelta().y() / 120, e->position().toPoint());
+        e->accept();
+    }
+    else if(zoomLevel > 0 && canZoom())
+    {
+        panBy(QPoint(e->angleDelta().x(), e->angleDelta().y()));
+        e->accept();
+    }
+    else QLabel::wheelEvent(e);
+}
+
+bool docPageLabel::event(QEvent *e)
+{
+    if(e->type() == QEvent::Gesture)
+    {
+        QGestureEvent* gestureEvent = static_cast<QGestureEvent*>(e);
+        QPinchGesture* pinch = static_cast<QPinchGesture*>(gestureEvent->gesture(Qt::PinchGesture));
+        if(pinch && canZoom())
+        {
+            // Zoom snaps to steps, so tiles rendered for a step are reused however the fingers move
+            if(pinch->state() == Qt::GestureStarted) pinchStartLevel = zoomLevel;
+            int level = pinchStartLevel + std::lround(std::log(pinch->totalScaleFactor()) / std::log(MUSICALPI_ZOOM_STEP));
+            setZoom(level, mapFromGlobal(pinch->centerPoint()).toPoint());
+            if(zoomLevel > 0) panBy((pinch->centerPoint() - pinch->lastCenterPoint()).toPoint());
+            gestureEvent->accept(pinch);
+            return true;
+        }
+    }
+    return QLabel::event(e);
+}
+
+bool docPageLabel::canZoom()
+{
+    // Review mode only; when playing a touch is a page turn
+    return !mParent->isPlaying() && mParent->currentPDF() != NULL && shownFrame != -1 && shownPage > 0;
+}
+
+void docPageLabel::resetZoom()
+{
+    if(zoomLevel == 0) return;
+    if(mParent->debugPageTurns) qDebug() << "Zoom reset";
+    zoomLevel = 0;
+    zoom = 1.0;
+    dragging = false;
+    tilesRequested.clear();
+    if(tileThread && tileThread->isRunning()) tileThread->render(QString(), QList<tileRenderThread::tileRequest>());  // drop anything queued
+    update();
+}
+
+void docPageLabel::setZoom(int level, QPoint about)
+{
+    // Zoom to the given step keeping the point of the page under "about" where it is
+    level = std::max(0, std::min(MUSICALPI_ZOOM_MAX_LEVEL, level));
+    if(level == zoomLevel) return;
+    if(level == 0)
+    {
+        resetZoom();
+        return;
+    }
+    if(zoomLevel == 0)
+    {
+        panOffset = shownPageArea.topLeft();
+        zoom = 1.0;
+    }
+    double newZoom = std::pow(MUSICALPI_ZOOM_STEP, level);
+    QPointF pagePoint = QPointF(about - panOffset) / zoom;
+    panOffset = (QPointF(about) - pagePoint * newZoom).toPoint();
+    zoom = newZoom;
+    zoomLevel = level;
+    qDebug() << "Zoom level " << zoomLevel << " (" << zoom << "x) on page " << shownPage;
+    if(tileThread == NULL)
+    {
+        tileThread = new tileRenderThread(this, mParent);
+        connect(tileThread, &tileRenderThread::renderedTile, this, &docPageLabel::tileRendered);
+    }
+    clampPan();
+    requestVisibleTiles();
+    update();
+}
+
+void docPageLabel::panBy(QPoint delta)
+{
+    if(delta.isNull()) return;
+    panDirection = QPoint((delta.x() > 0) - (delta.x() < 0), (delta.y() > 0) - (delta.y() < 0));
+    QPoint oldOffset = panOffset;
+    panOffset += delta;
+    clampPan();
+    if(panOffset == oldOffset) return;  // Already at the edge
+    requestVisibleTiles();
+    update();
+}
+
+void docPageLabel::clampPan()
+{
+    // Keep the page covering us where it is big enough to, otherwise centered in that direction
+    QSize zoomed = zoomedSize();
+    if(zoomed.width() <= this->width()) panOffset.setX((this->width() - zoomed.width()) / 2);
+    else panOffset.setX(std::max(this->width() - zoomed.width(), std::min(0, panOffset.x())));
+    if(zoomed.height() <= this->height()) panOffset.setY((this->height() - zoomed.height()) / 2);
+    else panOffset.setY(std::max(this->height() - zoomed.height(), std::min(0, panOffset.y())));
+}
+
+QSize docPageLabel::zoomedSize()
+{
+    return QSize(std::lround(shownPageArea.width() * zoom), std::lround(shownPageArea.height() * zoom));
+}
+
+QRect docPageLabel::tileRange(const QRect& area)
+{
+    QSize zoomed = zoomedSize();
+    int lastColumn = (zoomed.width() - 1) / MUSICALPI_TILE_SIZE;
+    int lastRow = (zoomed.height() - 1) / MUSICALPI_TILE_SIZE;
+    return QRect(QPoint(std::max(0, (area.left() - panOffset.x()) / MUSICALPI_TILE_SIZE),
+                        std::max(0, (area.top() - panOffset.y()) / MUSICALPI_TILE_SIZE)),
+                 QPoint(std::min(lastColumn, (area.right() - panOffset.x()) / MUSICALPI_TILE_SIZE),
+                        std::min(lastRow, (area.bottom() - panOffset.y()) / MUSICALPI_TILE_SIZE)));
+}
+
+quint64 docPageLabel::tileKey(int generation, int page, int level, int column, int row)
+{
+    return ((quint64)(generation & 0xFFFF) << 48) | ((quint64)(page & 0xFFFF) << 32) | ((quint64)(level & 0xFF) << 24) | ((quint64)(column & 0xFFF) << 12) | (quint64)(row & 0xFFF);
+}
+
+void docPageLabel::requestVisibleTiles()
+{
+    // Ask for what we are missing of what is visible, then one more column/row in the direction we are panning so it
+    // is there when we get to it.  This replaces anything still queued, which has scrolled out of view.
+    if(mParent->currentPDF() == NULL || tileThread == NULL) return;
+    if(shownPageArea.size() != tileFitSize || mParent->currentPDF()->filepath != tileFilepath)
+    {
+        dropTiles();  // Tiles are made to a multiple of the fitted size, so none we have can be used now
+        tileFitSize = shownPageArea.size();
+        tileFilepath = mParent->currentPDF()->filepath;
+    }
+    QSize zoomed = zoomedSize();
+    QRect visible = tileRange(this->rect());
+    QRect ahead = visible.adjusted(panDirection.x() > 0 ? -1 : 0, panDirection.y() > 0 ? -1 : 0,  // dragging right reveals the left
+                                   panDirection.x() < 0 ?  1 : 0, panDirection.y() < 0 ?  1 : 0);
+    ahead = ahead.intersected(tileRange(QRect(panOffset, zoomed)));
+    QList<tileRenderThread::tileRequest> tiles;
+    QSet<quint64> requested;
+    for(int pass = 0; pass < 2; pass++)
+    {
+        QRect range = pass == 0 ? visible : ahead;
+        for(int row = range.top(); row <= range.bottom(); row++)
+            for(int column = range.left(); column <= range.right(); column++)
+            {
+                if(pass == 1 && visible.contains(column, row)) continue;
+                quint64 key = tileKey(tileGeneration, shownPage, zoomLevel, column, row);
+                if(tileCache.contains(key)) continue;
+                tiles.append({key, tileGeneration, shownPage, zoomed.width(), column * MUSICALPI_TILE_SIZE, row * MUSICALPI_TILE_SIZE});
+                requested.insert(key);
+            }
+    }
+    if(tiles.isEmpty() && tilesRequested.isEmpty()) return;  // Nothing wanted now or before
+    tilesRequested = requested;
+    tileThread->render(mParent->currentPDF()->filepath, tiles);
+}
+
+void docPageLabel::dropTiles()
+{
+    // Nothing cached or on its way can be used after this, even if it arrives later
+    tileGeneration++;
+    tileCache.clear();
+    tilesRequested.clear();
+    tileFitSize = QSize();
+    tileFilepath = "";
+    if(tileThread && tileThread->isRunning()) tileThread->render(QString(), QList<tileRenderThread::tileRequest>());  // drop anything queued
+}
+
+// Slot
+void docPageLabel::tileRendered(quint64 key, int generation, QImage tile)
+{
+    if(generation != tileGeneration || !tilesRequested.remove(key)) return;  // From before the tiles were dropped, or no longer wanted
+    tileCache.insert(key, new QImage(tile), std::max((qsizetype)1, tile.sizeInBytes() / 1024));
+    if(zoomLevel > 0) update();
+}
+
+void docPageLabel::paintZoomed(QPainter& p, const QRect& area)
+{
+    // Only composes what is cached (so panning is smooth); a tile not here yet is filled from the frame, scaled up
+    p.fillRect(area, shownColor);
+    QSize zoomed = zoomedSize();
+    QRect range = tileRange(area);
+    for(int row = range.top(); row <= range.bottom(); row++)
+        for(int column = range.left(); column <= range.right(); column++)
+        {
+            QRect tileArea(panOffset.x() + column * MUSICALPI_TILE_SIZE, panOffset.y() + row * MUSICALPI_TILE_SIZE,
+                           std::min(MUSICALPI_TILE_SIZE, zoomed.width() - column * MUSICALPI_TILE_SIZE),
+                           std::min(MUSICALPI_TILE_SIZE, zoomed.height() - row * MUSICALPI_TILE_SIZE));
+            QImage* tile = tileCache.object(tileKey(tileGeneration, shownPage, zoomLevel, column, row));
+            if(tile) p.drawImage(tileArea.topLeft(), *tile);
+            else p.drawImage(QRectF(tileArea), frames[shownFrame],
+                             QRectF(shownPageArea.x() + (tileArea.x() - panOffset.x()) / zoom, shownPageArea.y() + (tileArea.y() - panOffset.y()) / zoom,
+                                    tileArea.width() / zoom, tileArea.height() / zoom));
+        }
+}
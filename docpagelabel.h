@@ -7,9 +7,16 @@
 #include <QTimer>
 #include <QtDebug>
 #include <QLabel>
+#include <QImage>
+#include <QCache>
+#include <QSet>
+
+#include "piconstants.h"
 
 
 class MainWindow;
+class QPainter;
+class tileRenderThread;
 
 class docPageLabel : public QLabel
 {
@@ -23,9 +30,15 @@ public:
         // fullPageNow  - display immediately but highlight whole page briefly
     docPageLabel(QWidget *parent, MainWindow* mp);
     ~docPageLabel();
-    void placeImage(docTransition thisTransition, QString color);
-    void placeImage(docTransition thisTransition, QImage *newImageBuffer, QString color);
+    void placeImage(docTransition thisTransition, const QColor& color);
+    void placeImage(docTransition thisTransition, const QImage *newImageBuffer, const QColor& color, int pageNumber);
+    void clearPage();   // Forget whatever is shown (use instead of QLabel::clear)
+    void resetZoom();   // Back to the whole page fitted
     void HideAnyInProgressTransitions();
+#ifdef MUSICALPI_DEBUG_PAGE_TURN_CHECK
+    QImage::Format frameFormat() { return frames[0].format(); }
+    QImage::Format paintedToFormat;  // format of the device our last paint went to
+#endif
     QTimer ourOverlayTimer;
     QTimer ourHighlightShowTimer;  // for full page or first half of half page
     QTimer ourHighlightHideTimer;
@@ -34,15 +47,84 @@ public:
     QWidget* ourParent;
     MainWindow* mParent;
 
+signals:
+    void clicked();     // released on this page (not a pan); the event still goes on to MainWindow for page turns
+
+private slots:
+    void tileRendered(quint64 key, int generation, QImage tile);
+
 private:
-    QLabel ourOverlay;
-    QLabel ourHighlightOverlay;
-    QLabel our2ndHighlightOverlay;
+    // The page is composed into one of two frames the size of this widget, which are reused turn after turn
+    // rather than reallocated.  The other frame still holds the page it replaced, which is what the transition
+    // overlay shows, so the overlay and highlights are just state drawn in paintEvent, not separate images.
+    QImage frames[2];
+    int shownFrame;             // index of frame now displayed, -1 if none
+    bool showOldOverlay;        // draw the replaced frame over the new one, from oldOverlayTop down
+    int oldOverlayTop;
+    bool showHighlight;         // outline highlightArea
+    bool show2ndHighlight;      // outline highlight2ndArea (bottom half for halfPage)
+    QRect highlightArea;
+    QRect highlight2ndArea;
     bool oldImageIsBlank;
     bool newImageIsBlank;
     int pageTurnDelay;
     int pageHighlightDelay;
     int pageHighlightHeight;
+
+    // Zoom and pan, review mode only.  Zoom 1 is the page as composed into the frame (shownPageArea); zoomed in, the page
+    // is drawn from tiles rendered at the zoomed size, and until a tile arrives that part is drawn scaled up from the frame.
+    int shownPage;              // Page in the frame, 0 if blank
+    QRect shownPageArea;        // Where it is in the frame
+    QColor shownColor;
+    const QImage* shownSource;  // What the shown frame was composed from (only compared, never used), so placing it again is free
+    QSize shownSourceSize;
+
+    // The frames (and what they hold) from the size before this one, so going back to it, as between review and play
+    // which differ only by the menu, needs no recompose.
+    QImage spareFrames[2];
+    int spareShownFrame;
+    int sparePage;
+    QRect sparePageArea;
+    QColor spareColor;
+    const QImage* spareSource;
+    QSize spareSourceSize;
+    bool spareIsBlank;
+    int zoomLevel;              // 0 = fitted; else zoom is MUSICALPI_ZOOM_STEP to this power
+    double zoom;
+    QPoint panOffset;           // Top left of the zoomed page, in our coordinates (negative when panned in)
+    QPoint panDirection;        // Sign of the last pan movement, to prefetch tiles ahead of it
+    int pinchStartLevel;
+    bool dragging;              // Mouse is down on a zoomed page
+    bool dragged;               // and has moved, so its release is a pan not a click
+    QPoint dragLast;
+    int tileGeneration;         // Part of each tile key; bumped when the fitted size or document changes (or the page is cleared), so older tiles are never used
+    QSize tileFitSize;          // Fitted size the tiles in the cache were made for
+    QString tileFilepath;       //     and document
+    QCache<quint64, QImage> tileCache;   // LRU, cost in KB
+    QSet<quint64> tilesRequested;
+    tileRenderThread* tileThread;        // Created on first zoom
+    static quint64 tileKey(int generation, int page, int level, int column, int row);
+    QSize zoomedSize();
+    QRect tileRange(const QRect& area);  // Columns (x) and rows (y) of tiles covering area, in our coordinates
+    bool canZoom();
+    void setZoom(int level, QPoint about);
+    void panBy(QPoint delta);
+    void clampPan();
+    void requestVisibleTiles();
+    void dropTiles();
+    void paintZoomed(QPainter& p, const QRect& area);
+    void placeFrame(docTransition thisTransition, const QImage *newImageBuffer, const QColor& color, int pageNumber);
+    QRect composeFrame(QImage& frame, const QImage *newImageBuffer, const QColor& color);
+    void drawHighlight(QPainter& p, const QRect& area);
+    void swapSpareFrames();
+    void recolorMargins(const QColor& color);
+    void paintEvent(QPaintEvent *e);
+    bool event(QEvent *e);
+    void mousePressEvent(QMouseEvent *e);
+    void mouseMoveEvent(QMouseEvent *e);
+    void mouseReleaseEvent(QMouseEvent *e);
+    void mouseDoubleClickEvent(QMouseEvent *e);
+    void wheelEvent(QWheelEvent *e);
 };
 
 #endif // DOCPAGELABEL_H
@@ -0,0 +1,427 @@
+// Copyright 2023 by Linwood Ferguson, licensed under GNU GPLv3
+
+#include <QDebug>
+
+#include "librarymodel.h"
+
+#include <algorithm>
+#include <climits>
+
+libraryModel::libraryModel(QObject *parent) : QAbstractTableModel(parent)
+{
+    sortColumn = -1;
+    listIdColumn = -1;
+    sortOrder = Qt::AscendingOrder;
+    titleColumn = -1;
+    thumbnailColumn = -1;
+    thumbnails.setMaxCost(MUSICALPI_THUMBNAILS_KEPT);
+}
+
+void libraryModel::reset(const QStringList& fieldNames)
+{
+    beginResetModel();
+    fields = fieldNames;
+    columns = QVector<QVector<QString>>(fields.size());
+    interned = QVector<QHash<QString,QString>>(fields.size());
+    searchable = QVector<bool>(fields.size(), true);
+    sorted.clear();
+    shown.clear();
+    songs.clear();
+    pageMatches.clear();
+    startPages.clear();
+    listPositions.clear();
+    live.clear();
+    search.clear();
+    facets.clear();
+    titleColumn = -1;
+    endResetModel();
+}
+
+int libraryModel::addRows(const QList<QStringList>& rows, char kind)
+{
+    // Store and index rows (after all those already loaded), returning the first one's number
+    // Collections, authors and tags repeat a lot, so keep one copy of each value (QString copies share their data)
+    static const QStringList repeating = {"Collection", "Author", "tags"};
+    int firstNew = live.size();
+    for(int field = 0; field < fields.size(); field++)
+    {
+        bool intern = repeating.contains(fields[field]);
+        columns[field].reserve(firstNew + rows.size());
+        for(const QStringList& row : rows)
+        {
+            const QString& value = row.value(field);
+            if(intern)
+            {
+                auto found = interned[field].constFind(value);
+                if(found == interned[field].constEnd()) found = interned[field].insert(value, value);
+                columns[field].append(found.value());
+            }
+            else columns[field].append(value);
+        }
+    }
+    // Misspelled searches are matched against titles first, then authors, then collections
+    static const QStringList rankedFields = {"Title", "Author", "Collection"};
+    QVector<int> searchFields;
+    QVector<int> ranks;
+    for(int field = 0; field < fields.size(); field++)
+        if(searchable[field])
+        {
+            searchFields.append(field);
+            ranks.append(rankedFields.indexOf(fields[field]));
+        }
+    if(firstNew == 0) search.setRankedFields(ranks);
+    QStringList searchText;
+    int tagsColumn = fields.indexOf("tags");
+    int collectionColumn = fields.indexOf("Collection");
+    int authorColumn = fields.indexOf("Author");
+    for(int row = firstNew; row < firstNew + rows.size(); row++)
+    {
+        searchText.clear();
+        for(int field : searchFields) searchText.append(kind == 1 || (kind == 2 && fields[field] == "Title") ? columns[field][row] : QString());  // (pages are found by their words, not these)
+        search.addRow(row, searchText);
+        facets.addRow(row, tagsColumn >= 0 ? columns[tagsColumn][row] : QString(), collectionColumn >= 0 ? columns[collectionColumn][row] : QString(),
+                      authorColumn >= 0 ? columns[authorColumn][row] : QString(), kind == 1);
+        live.append(kind);
+    }
+    return firstNew;
+}
+
+void libraryModel::appendRows(const QList<QStringList>& rows)
+{
+    int firstNew = addRows(rows);
+    QVector<int> matching;
+    for(int row = firstNew; row < firstNew + rows.size(); row++)
+    {
+        sorted.append(row);
+        if(rowMatches(row)) matching.append(row);
+    }
+    if(matching.isEmpty()) return;
+    beginInsertRows(QModelIndex(), shown.size(), shown.size() + matching.size() - 1);
+    shown.append(matching);
+    endInsertRows();
+}
+
+bool libraryModel::sortsBefore(int a, int b) const
+{
+    if(sortColumn < 0 && !listPositions.isEmpty() && listIdColumn >= 0 && listIdColumn < columns.size())
+    {
+        int positionA = listPositions.value(columns[listIdColumn][a], INT_MAX);  // (any not in it after those that are)
+        int positionB = listPositions.value(columns[listIdColumn][b], INT_MAX);
+        return positionA != positionB ? positionA < positionB : a < b;
+    }
+    if(sortColumn < 0 || sortColumn >= columns.size()) return a < b;
+    const QVector<QString>& values = columns[sortColumn];
+    return sortOrder == Qt::AscendingOrder ? values[a] < values[b] : values[b] < values[a];
+}
+
+bool libraryModel::applyDelta(int idColumn, const QSet<QString>& presentIds, const QSet<QString>& changedIds, const QList<QStringList>& rows)
+{
+    // Rows whose book is gone or changed come out, and the changed (or new) ones go back in where they sort.  A few are
+    // done a row at a time so the view keeps its place; more than that (or any while searching) is one reset.
+    if(idColumn < 0 || idColumn >= columns.size()) return false;
+    const QVector<QString>& ids = columns[idColumn];
+    int goneCount = 0;
+    for(int row : sorted)
+        if(!presentIds.contains(ids[row]) || changedIds.contains(ids[row])) goneCount++;
+    if(goneCount == 0 && rows.isEmpty()) return false;
+    bool oneReset = !filterText.isEmpty() || facets.filtering() || goneCount + rows.size() > MUSICALPI_LIBRARY_CHUNK_ROWS;
+    if(oneReset) beginResetModel();
+    else
+        for(int i = shown.size() - 1; i >= 0 && goneCount > 0; i--)
+            if(!presentIds.contains(ids[shown[i]]) || changedIds.contains(ids[shown[i]]))
+            {
+                beginRemoveRows(QModelIndex(), i, i);
+                shown.removeAt(i);
+                endRemoveRows();
+            }
+    QVector<int> kept;
+    kept.reserve(sorted.size());
+    for(int row : sorted)
+    {
+        if(!presentIds.contains(ids[row]) || changedIds.contains(ids[row]))
+        {
+            live[row] = 0;
+            facets.removeRow(row);
+        }
+        else kept.append(row);
+    }
+    sorted.swap(kept);
+    dropSongs(idColumn, presentIds, true);
+    dropSongs(idColumn, changedIds, false);
+
+    int firstNew = addRows(rows);
+    for(int row = firstNew; row < firstNew + rows.size(); row++)
+    {
+        int at = std::upper_bound(sorted.begin(), sorted.end(), row, [this](int a, int b) { return sortsBefore(a, b); }) - sorted.begin();
+        sorted.insert(at, row);
+        if(oneReset) continue;
+        beginInsertRows(QModelIndex(), at, at);  // Not searching, so shown is sorted
+        shown.insert(at, row);
+        endInsertRows();
+    }
+    if(oneReset)
+    {
+        rebuildShown();
+        endResetModel();
+    }
+    qDebug() << "Library refreshed, " << goneCount << " rows out and " << rows.size() << " in, " << sorted.size() << " rows now";
+    return true;
+}
+
+void libraryModel::removeIds(int idColumn, const QSet<QString>& ids)
+{
+    // A row at a time, since it's usually one book (taken out of the list being shown)
+    if(idColumn < 0 || idColumn >= columns.size() || ids.isEmpty()) return;
+    const QVector<QString>& values = columns[idColumn];
+    for(int i = shown.size() - 1; i >= 0; i--)
+        if(ids.contains(values[shown[i]]))
+        {
+            beginRemoveRows(QModelIndex(), i, i);
+            shown.removeAt(i);
+            endRemoveRows();
+        }
+    QVector<int> kept;
+    kept.reserve(sorted.size());
+    for(int row : sorted)
+    {
+        if(ids.contains(values[row]))
+        {
+            live[row] = 0;
+            facets.removeRow(row);
+        }
+        else kept.append(row);
+    }
+    sorted.swap(kept);
+    dropSongs(idColumn, ids, false);  // (any showing went out above)
+}
+
+void libraryModel::dropSongs(int idColumn, const QSet<QString>& ids, bool keepIds)
+{
+    const QVector<QString>& values = columns[idColumn];
+    for(QVector<int>* rows : {&songs, &pageMatches})
+    {
+        QVector<int> kept;
+        kept.reserve(rows->size());
+        for(int row : *rows)
+        {
+            if(ids.contains(values[row]) != keepIds)
+            {
+                live[row] = 0;
+                facets.removeRow(row);
+                startPages.remove(row);
+            }
+            else kept.append(row);
+        }
+        rows->swap(kept);
+    }
+}
+
+void libraryModel::dropPageMatches()
+{
+    for(int row : pageMatches)
+    {
+        live[row] = 0;
+        facets.removeRow(row);
+        startPages.remove(row);
+    }
+    pageMatches.clear();
+}
+
+void libraryModel::addSongs(const QList<QStringList>& rows, const QVector<int>& pages)
+{
+    if(rows.isEmpty()) return;
+    int firstNew = addRows(rows, 2);
+    for(int i = 0; i < rows.size(); i++)
+    {
+        songs.append(firstNew + i);
+        startPages.insert(firstNew + i, pages.value(i, 1));
+    }
+    if(filterText.isEmpty()) return;  // Not shown until searched for
+    beginResetModel();
+    rebuildShown();
+    endResetModel();
+}
+
+int libraryModel::startPage(int row) const
+{
+    if(row < 0 || row >= shown.size()) return 1;
+    return startPages.value(shown[row], 1);
+}
+
+void libraryModel::setPageMatches(const QList<QStringList>& rows, const QVector<int>& pages)
+{
+    // Rows taken out stay in the columns (as all do until the next load), but there are only a few per search
+    if(rows.isEmpty() && pageMatches.isEmpty()) return;
+    beginResetModel();
+    dropPageMatches();
+    if(!rows.isEmpty())
+    {
+        int firstNew = addRows(rows, 3);
+        for(int i = 0; i < rows.size(); i++)
+        {
+            pageMatches.append(firstNew + i);
+            startPages.insert(firstNew + i, pages.value(i, 1));
+        }
+    }
+    rebuildShown();
+    endResetModel();
+}
+
+void libraryModel::loadFinished()
+{
+    for(int field = 0; field < interned.size(); field++) interned[field].clear();  // only needed while adding
+    qDebug() << "Library loaded with " << sorted.size() << " rows, " << shown.size() << " shown";
+}
+
+void libraryModel::setSearchable(int column, bool canSearch)
+{
+    if(column >= 0 && column < searchable.size()) searchable[column] = canSearch;
+}
+
+void libraryModel::setTitleFont(int column, const QFont& font)
+{
+    titleColumn = column;
+    titleFont = font;
+}
+
+void libraryModel::setThumbnail(const QString& key, const QPixmap& picture)
+{
+    thumbnails.insert(key, new QPixmap(picture));
+    if(titleColumn >= 0 && !shown.isEmpty()) emit dataChanged(index(0, titleColumn), index(shown.size() - 1, titleColumn), {Qt::DecorationRole});  // The view only repaints what's on screen
+}
+
+bool libraryModel::hasThumbnail(int row) const
+{
+    if(row < 0 || row >= shown.size() || thumbnailColumn < 0 || thumbnailColumn >= columns.size()) return true;  // (nothing to get)
+    return thumbnails.contains(columns[thumbnailColumn][shown[row]]);
+}
+
+bool libraryModel::rowMatches(int row)
+{
+    // Rows arriving while a search is showing are only checked for an exact match; the full (ranked) search is
+    // applied the next time the filter changes
+
+    return facets.selected(row) && (filterText.isEmpty() || search.rowContains(row, filterText));
+}
+
+void libraryModel::rebuildShown()
+{
+    // Best matches first, and within equally good matches, in sort order
+    shown.clear();
+    if(filterText.isEmpty())
+    {
+        if(!facets.filtering()) shown = sorted;
+        else
+            for(int row : sorted)
+                if(facets.selected(row)) shown.append(row);
+        return;
+    }
+    const QVector<QPair<int,int>>& found = search.findRanked(filterText);
+    position.resize(live.size());
+    for(int i = 0; i < sorted.size(); i++) position[sorted[i]] = i;
+    for(int i = 0; i < songs.size(); i++) position[songs[i]] = sorted.size() + i;  // Songs after books that match as well
+    rankedRows.clear();
+    rankedRows.reserve(found.size());
+    for(const QPair<int,int>& rowScore : found)
+        if(live[rowScore.first] && facets.selected(rowScore.first)) rankedRows.append(qMakePair(rowScore.second, position[rowScore.first]));  // (the index still has rows taken out by applyDelta)
+    std::sort(rankedRows.begin(), rankedRows.end());
+    shown.reserve(rankedRows.size());
+    for(const QPair<int,int>& scorePosition : rankedRows)
+        shown.append(scorePosition.second < sorted.size() ? sorted[scorePosition.second] : songs[scorePosition.second - sorted.size()]);
+    for(int row : pageMatches)  // (already best first)
+        if(facets.selected(row)) shown.append(row);
+}
+
+void libraryModel::setFilter(QString filter)
+{
+    // One reset rather than showing/hiding rows one at a time
+    beginResetModel();
+    if(filter != filterText) dropPageMatches();  // (they were for the old one)
+    filterText = filter;
+    rebuildShown();
+    endResetModel();
+}
+
+void libraryModel::setTagFilter(const QStringList& tags, bool matchAll)
+{
+    beginResetModel();
+    facets.select(tags, matchAll);
+    rebuildShown();
+    endResetModel();
+}
+
+void libraryModel::setFacet(int facet, const QString& value)
+{
+    if(facets.chosen(facet) == value) return;
+    beginResetModel();
+    facets.choose(facet, value);
+    rebuildShown();
+    endResetModel();
+}
+
+void libraryModel::sort(int column, Qt::SortOrder order)
+{
+    sortColumn = column;
+    sortOrder = order;
+    if(column >= columns.size()) return;  // (-1 is the list's order, or as loaded)
+    emit layoutAboutToBeChanged();
+    std::stable_sort(sorted.begin(), sorted.end(), [this](int a, int b) { return sortsBefore(a, b); });
+    rebuildShown();
+    emit layoutChanged();
+}
+
+void libraryModel::setListOrder(int idColumn, const QHash<QString,int>& positions)
+{
+    listIdColumn = idColumn;
+    listPositions = positions;
+    if(sortColumn < 0) sort(-1);
+}
+
+QString libraryModel::text(int row, int column) const
+{
+    if(row < 0 || row >= shown.size() || column < 0 || column >= columns.size()) return QString();
+    return columns[column][shown[row]];
+}
+
+QString libraryModel::latest(int column) const
+{
+    QString result;
+    if(column < 0 || column >= columns.size()) return result;
+    for(int row : sorted) result = std::max(result, columns[column][row]);
+    return result;
+}
+
+QString libraryModel::sampleText(int sample, int samples, int column) const
+{
+    if(sorted.isEmpty()) return QString();
+    return columns[column][(int)((qint64)sample * sorted.size() / samples)];
+}
+
+int libraryModel::rowCount(const QModelIndex &parent) const
+{
+    return parent.isValid() ? 0 : shown.size();
+}
+
+int libraryModel::columnCount(const QModelIndex &parent) const
+{
+    return parent.isValid() ? 0 : fields.size();
+}
+
+QVariant libraryModel::data(const QModelIndex &index, int role) const
+{
+    if(!index.isValid()) return QVariant();
+    if(role == Qt::DisplayRole) return text(index.row(), index.column());
+    if(role == Qt::FontRole && index.column() == titleColumn) return titleFont;
+    if(role == Qt::DecorationRole && index.column() == titleColumn && thumbnailColumn >= 0 && thumbnailColumn < columns.size())
+    {
+        QPixmap* picture = thumbnails.object(text(index.row(), thumbnailColumn));
+        if(picture != NULL && !picture->isNull()) return *picture;
+    }
+    return QVariant();
+}
+
+QVariant libraryModel::headerData(int section, Qt::Orientation orientation, int role) const
+{
+    if(orientation == Qt::Horizontal && role == Qt::DisplayRole) return fields.value(section);
+    return QAbstractTableModel::headerData(section, orientation, role);
+}
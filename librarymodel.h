@@ -0,0 +1,100 @@
+#ifndef LIBRARYMODEL_H
+#define LIBRARYMODEL_H
+
+// Copyright 2023 by Linwood Ferguson, licensed under GNU GPLv3
+
+#include <QAbstractTableModel>
+#include <QStringList>
+#include <QVector>
+#include <QHash>
+#include <QSet>
+#include <QFont>
+#include <QCache>
+#include <QPixmap>
+#include "piconstants.h"
+#include "searchindex.h"
+#include "tagfacets.h"
+
+// The library as the view sees it.  Values are kept a column at a time (repeated values in columns like Author are
+// shared, not copied per row) and the view only ever asks for the rows on screen, so a large library costs little
+// more than its text.  Sorting and filtering just reorder a list of row numbers; nothing is moved.
+//
+// Songs found inside books (see bookInfo) are rows too, with the book's values but the song's title, found only by
+// that title and only shown when searching, so an anthology's songs don't crowd the list.  Pages whose words match a
+// search (see textIndex) are rows the same way, but only for as long as that search is showing.
+
+class libraryModel : public QAbstractTableModel
+{
+    Q_OBJECT
+
+public:
+    libraryModel(QObject *parent);
+    void reset(const QStringList& fieldNames);         // Start a new load, with these columns
+    void appendRows(const QList<QStringList>& rows);   // Add rows as they arrive (unsorted until loadFinished)
+    void loadFinished();                               // All rows are in (the view then sorts, if asked to)
+    bool applyDelta(int idColumn, const QSet<QString>& presentIds, const QSet<QString>& changedIds, const QList<QStringList>& rows);  // Drop rows not present or changed, add rows; false if nothing to do
+    void removeIds(int idColumn, const QSet<QString>& ids);  // Take these books' rows out (as applyDelta would if they were gone)
+    void addSongs(const QList<QStringList>& rows, const QVector<int>& pages);  // Song rows, and the page each starts on
+    void setPageMatches(const QList<QStringList>& rows, const QVector<int>& pages);  // Pages found for the current filter, shown after what it matches
+    int startPage(int row) const;                      // By row as shown; 1 unless it's a song or page
+    void setFilter(QString filter);                    // Show only rows with filter in a searchable column (or close to it, see searchIndex), best first
+    void setTagFilter(const QStringList& tags, bool matchAll);  // Show only rows with all (or any) of these tags, as well as the filter
+    void setFacet(int facet, const QString& value);    // Only this collection (or author) as well, see tagFacets; empty for any
+    void setListOrder(int idColumn, const QHash<QString,int>& positions);  // Unsorted, rows go by their book's position in the list (see playListOrder); none for the order loaded
+    QStringList facetNames(int facet) const { return facets.names(facet); }    // Values in the "tags" (or Collection, Author) column, most used first
+    QHash<QString,int> facetCounts(int facet) const { return facets.counts(facet); }  // Books with each that the other choices leave
+    qint64 facetBytes() const { return facets.bytes(); }   // (for librarybench)
+    void setSearchable(int column, bool searchable);   // Hidden columns (ids, paths) should not match searches
+    void setTitleFont(int column, const QFont& font);  // Font for the one column shown larger (and with the thumbnails)
+    void setThumbnailKey(int column) { thumbnailColumn = column; }  // Thumbnails are filed by this column's value (the path)
+    void setThumbnail(const QString& key, const QPixmap& picture);  // (null if there is none, so it's known not to need getting)
+    bool hasThumbnail(int row) const;                  // By row as shown
+    QString text(int row, int column) const;           // By row as shown (i.e. sorted and filtered)
+    QString fieldName(int column) const { return fields.value(column); }
+    int fieldColumn(QString name) const { return fields.indexOf(name); }
+    int totalRows() const { return sorted.size(); }
+    int loadedRows() const { return live.size(); }     // Including any taken out by applyDelta or removeIds, for going through in the order loaded
+    bool rowLive(int row) const { return live[row] == 1; }  // (a book, not a song)
+    const QString& loadedText(int row, int column) const { return columns[column][row]; }
+    QString latest(int column) const;                  // Greatest value in a column (of rows still in)
+    QString sampleText(int sample, int samples, int column) const;  // Spread evenly over all rows, for sizing columns
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const Q_DECL_OVERRIDE;
+    int columnCount(const QModelIndex &parent = QModelIndex()) const Q_DECL_OVERRIDE;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const Q_DECL_OVERRIDE;
+    QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const Q_DECL_OVERRIDE;
+    void sort(int column, Qt::SortOrder order = Qt::AscendingOrder) Q_DECL_OVERRIDE;
+
+private:
+    QStringList fields;
+    QVector<QVector<QString>> columns;           // columns[column][row], rows in the order loaded
+    QVector<QHash<QString,QString>> interned;    // While loading, values seen so far in columns with many repeats
+    QVector<bool> searchable;
+    QVector<char> live;    // live[row] is 0 if applyDelta or removeIds took it out (its values stay, but it's in none of the lists below), 2 for a song, 3 for a page
+    QVector<int> sorted;   // All rows in sort order
+    QVector<int> shown;    // Rows that pass the filter, in sort order; this is what the view sees
+    QVector<int> songs;    // Song rows, in the order added
+    QVector<int> pageMatches;  // Page rows, for the current filter only
+    QHash<int,int> startPages; // of song and page rows, by row
+    int sortColumn;        // -1 if in the order loaded (or the list's order)
+    Qt::SortOrder sortOrder;
+    int listIdColumn;
+    QHash<QString,int> listPositions;  // Book id -> position, when showing a playlist
+    QString filterText;
+    searchIndex search;    // Searchable columns of each row, built as rows are added
+    tagFacets facets;      // and the tags, collection and authors of each
+    QVector<int> position;                // Scratch for setFilter, position[row] is where row is in sorted
+    QVector<QPair<int,int>> rankedRows;   // Scratch for setFilter, (score, position) of each row found
+    int titleColumn;
+    QFont titleFont;
+    int thumbnailColumn;
+    QCache<QString, QPixmap> thumbnails;  // Most recently made or shown, by path; kept over resets as paths don't change
+    bool rowMatches(int row);
+    int addRows(const QList<QStringList>& rows, char kind = 1);  // (as in live)
+    void dropSongs(int idColumn, const QSet<QString>& ids, bool keepIds);  // Take out songs and pages of books in ids (or not in them)
+    void dropPageMatches();
+    bool sortsBefore(int a, int b) const;
+    void rebuildShown();
+};
+
+#endif // LIBRARYMODEL_H
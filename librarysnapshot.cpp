@@ -0,0 +1,101 @@
+// Copyright 2023 by Linwood Ferguson, licensed under GNU GPLv3
+
+#include <QDebug>
+#include <QFile>
+#include <QDir>
+#include <QSaveFile>
+#include <QDataStream>
+#include <QByteArray>
+#include <QStandardPaths>
+#include <QCryptographicHash>
+
+#include "librarysnapshot.h"
+#include "librarymodel.h"
+
+#define LIBRARYSNAPSHOT_MAGIC 0x4D504C53   // "MPLS"
+#define LIBRARYSNAPSHOT_VERSION 1
+
+librarySnapshot::librarySnapshot(QString key)
+{
+    fileName = folder() + "/" + QCryptographicHash::hash(key.toUtf8(), QCryptographicHash::Sha1).toHex().left(16) + ".snapshot";
+}
+
+QString librarySnapshot::folder()
+{
+    return QStandardPaths::writableLocation(QStandardPaths::AppLocalDataLocation) + "/snapshots";
+}
+
+bool librarySnapshot::load(QStringList& fields, QList<QStringList>& rows, QString& stamp)
+{
+    QFile file(fileName);
+    if(!file.open(QIODevice::ReadOnly)) return false;
+    uchar* mapped = file.map(0, file.size());
+    if(mapped == NULL)
+    {
+        qDebug() << "Could not map " << fileName << ", " << file.errorString();
+        return false;
+    }
+    QByteArray contents = QByteArray::fromRawData((const char*)mapped, file.size());  // Reads straight from the mapping
+    QDataStream in(contents);
+    in.setVersion(QDataStream::Qt_6_0);
+    quint32 magic, version;
+    qint32 rowCount;
+    in >> magic >> version;
+    bool ok = (magic == LIBRARYSNAPSHOT_MAGIC && version == LIBRARYSNAPSHOT_VERSION);
+    if(ok)
+    {
+        in >> stamp >> fields >> rowCount;
+        rows.reserve(rowCount);
+        for(int row = 0; row < rowCount && in.status() == QDataStream::Ok; row++)
+        {
+            QStringList values;
+            values.reserve(fields.size());
+            for(int field = 0; field < fields.size(); field++)
+            {
+                QString value;
+                in >> value;
+                values.append(value);
+            }
+            rows.append(values);
+        }
+        ok = (in.status() == QDataStream::Ok && rows.size() == rowCount);
+    }
+    file.unmap(mapped);
+    if(!ok)
+    {
+        qDebug() << "Snapshot " << fileName << " is not usable, ignoring it";
+        fields.clear();
+        rows.clear();
+        return false;
+    }
+    qDebug() << "Loaded snapshot " << fileName << " with " << rows.size() << " rows as of " << stamp;
+    return true;
+}
+
+void librarySnapshot::save(const libraryModel* model, int stampColumn)
+{
+    QString stamp = model->latest(stampColumn);
+    qint32 rowCount = model->totalRows();
+    QDir().mkpath(folder());
+    QSaveFile file(fileName);  // Written aside and renamed over, so a snapshot is never half written
+    if(!file.open(QIODevice::WriteOnly))
+    {
+        qDebug() << "Could not write snapshot " << fileName << ", " << file.errorString();
+        return;
+    }
+    QDataStream out(&file);
+    out.setVersion(QDataStream::Qt_6_0);
+    QStringList fields;
+    for(int field = 0; field < model->columnCount(); field++) fields.append(model->fieldName(field));
+    out << (quint32)LIBRARYSNAPSHOT_MAGIC << (quint32)LIBRARYSNAPSHOT_VERSION << stamp << fields << rowCount;
+    for(int row = 0; row < model->loadedRows(); row++)
+        if(model->rowLive(row))
+            for(int field = 0; field < fields.size(); field++) out << model->loadedText(row, field);
+    if(!file.commit()) qDebug() << "Could not write snapshot " << fileName << ", " << file.errorString();
+    else qDebug() << "Saved snapshot " << fileName << " with " << rowCount << " rows as of " << stamp;
+}
+
+void librarySnapshot::discard()
+{
+    if(QFile::remove(fileName)) qDebug() << "Discarded snapshot " << fileName;
+}
@@ -0,0 +1,30 @@
+#ifndef LIBRARYSNAPSHOT_H
+#define LIBRARYSNAPSHOT_H
+
+// Copyright 2023 by Linwood Ferguson, licensed under GNU GPLv3
+
+#include <QString>
+#include <QStringList>
+#include <QList>
+
+class libraryModel;
+
+// A copy of what a library query returned, kept on local storage so the library can be shown at once when it is
+// next asked for, and only the books Calibre changed since (by their last_modified) read from the network share.
+// There is one file per query (the key says which: database, SQL and values), read by mapping it rather than through
+// a buffer.  Files are simply replaced when saved, and a list's is discarded when we change which books are in it.
+
+class librarySnapshot
+{
+public:
+    librarySnapshot(QString key);
+    bool load(QStringList& fields, QList<QStringList>& rows, QString& stamp);  // False if none (or unreadable)
+    void save(const libraryModel* model, int stampColumn);                     // Rows still in the model; stamp is the latest in stampColumn
+    void discard();
+
+private:
+    QString fileName;
+    static QString folder();
+};
+
+#endif // LIBRARYSNAPSHOT_H
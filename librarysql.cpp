@@ -0,0 +1,115 @@
+// Copyright 2023 by Linwood Ferguson, licensed under GNU GPLv3
+
+#include <QVariant>
+
+#include "librarysql.h"
+
+QString librarySql::prefixEnd(QString text)
+{
+    // Tag names compare ignoring case (of ASCII letters), so this is text in lower case with its last character one
+    // higher; every name starting with text is at least text and less than this
+    text = text.toLower();
+    if(!text.isEmpty()) text.back() = QChar(text.back().unicode() + 1);
+    return text;
+}
+
+QString librarySql::books(bool inList)
+{
+    // A list's books are those with one of its tags; they're put in the list's order from playListOrder, not here
+    return QString(
+        "select b.id as BookID, b.sort as Title, coalesce(max(s.name),'') as Collection, b.author_sort as Author, b.path || '/' ||  d.name || '.' || lower(d.format) as Path, group_concat(t2.name,',') as tags, "
+        "b.last_modified as Modified "
+        "from books b "
+        "inner join books_tags_link btl on btl.book = b.id "
+        "inner join tags t on t.id = btl.tag "
+        "inner join data d on d.book = b.id and d.format = 'PDF' ") +
+        (
+           !inList ? "" :
+              ( "inner join books_tags_link btl3 on btl3.book = b.id "
+                "inner join tags t3 on t3.id = btl3.tag and t3.name >= ? and t3.name < ? "
+              )
+        ) +
+        "left join books_series_link bsl on bsl.book = b.id "
+        "left join series s on s.id=bsl.series "
+        "left join books_tags_link btl2 on btl2.book=b.id "
+        "left join tags t2 on t2.id=btl2.tag and t2.name not like 'musicList%' and t2.name <> 'music' "
+        "where t.name = ? ";
+}
+
+QString librarySql::booksEnd()
+{
+    return "group  by b.id, b.sort, b.author_sort, b.path, d.name "
+           "order by b.sort;";
+}
+
+QString librarySql::playLists()
+{
+    // There is a row per book in each list, so this also gives which books are in which lists, and where
+    return "select t.id, case instr(t.name,'|') when 0 then t.name else substr(t.name, 1, instr(t.name,'|')-1) end as tagname, btl.book, "
+           "case instr(t.name,'|') when 0 then 0 else cast(substr(t.name, instr(t.name,'|')+1) as integer) end as position from tags t"
+           ", books_tags_link btl where t.id=btl.tag and t.name >= ? and t.name < ? order by t.name;";
+}
+
+QString librarySql::bookChanges()
+{
+    return "select id, last_modified > ? as changed from books;";
+}
+
+libraryThread::transactionWork librarySql::addToList(const QList<QPair<int,QString>>& adding)
+{
+    return [adding](libraryThread* db) -> QString
+    {
+        for(const QPair<int,QString>& add : adding)
+        {
+            libraryThread::statementResult insert = db->step("insert into tags (name) values(?);", {add.second});
+            if(insert.error != " / ") return insert.error;
+            insert = db->step("insert into books_tags_link(tag, book) values (?,?);", {insert.lastInsertId, add.first});
+            if(insert.error != " / ") return insert.error;
+        }
+        return QString(" / ");
+    };
+}
+
+libraryThread::transactionWork librarySql::removeFromList(int book, const QString& tagName)
+{
+    return [book, tagName](libraryThread* db) -> QString
+    {
+        libraryThread::statementResult query = db->step("delete from books_tags_link where book = ? and tag in (select id from tags where name = ?);", {book, tagName});
+        if(query.error != " / ") return query.error;  // (if it's not there, it's already done)
+        query = db->step("delete from tags where name = ? and not exists (select 1 from books_tags_link btl where btl.tag = tags.id);", {tagName});  // Nothing else has it
+        return query.error;
+    };
+}
+
+libraryThread::transactionWork librarySql::renameTags(const QStringList& from, const QStringList& to)
+{
+    return [from, to](libraryThread* db) -> QString
+    {
+        for(int i = 0; i < from.size(); i++)
+        {
+            libraryThread::statementResult query = db->step("update tags set name = ? where name = ?;", {from[i] + "~", from[i]});
+            if(query.error != " / ") return query.error;
+            if(query.rowsAffected != 1) return "Tag " + from[i] + " not found / ";  // (Calibre changed meanwhile)
+        }
+        for(int i = 0; i < to.size(); i++)
+        {
+            libraryThread::statementResult query = db->step("update tags set name = ? where name = ?;", {to[i], from[i] + "~"});
+            if(query.error != " / ") return query.error;
+        }
+        return QString(" / ");
+    };
+}
+
+libraryThread::transactionWork librarySql::newList(const QString& tagPrefix, int book, const QString& tagName)
+{
+    QVariantList range = {tagPrefix, prefixEnd(tagPrefix)};
+    return [range, book, tagName](libraryThread* db) -> QString
+    {
+        libraryThread::statementResult query = db->step("select 1 from tags t where t.name >= ? and t.name < ? limit 1;", range);
+        if(query.error != " / " || !query.rows.isEmpty()) return query.error;  // (made meanwhile, nothing to do)
+        query = db->step("insert into tags (name) values(?);", {tagName});
+        if(query.error != " / ") return query.error;
+        query = db->step("insert into books_tags_link(tag, book) values (?,?);", {query.lastInsertId, book});
+        return query.error;
+    };
+}
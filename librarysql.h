@@ -0,0 +1,35 @@
+#ifndef LIBRARYSQL_H
+#define LIBRARYSQL_H
+
+// Copyright 2023 by Linwood Ferguson, licensed under GNU GPLv3
+
+#include <QString>
+#include <QStringList>
+#include <QList>
+#include <QPair>
+
+#include "librarythread.h"
+
+// The SQL the library runs against Calibre's database, built in one place so musicLibrary and the library benchmark
+// (tools/librarybench) run exactly the same statements.  Names (of lists and tags) are always bound as values, so
+// each statement's text is fixed and is prepared once.  Tags are found by a range of names (name >= ? and name < ?,
+// see prefixEnd), which the index on tags.name gives directly, never by LIKE.
+//
+// A playlist is a tag per book in it, the list's tag then "|" and the book's position (see playListOrder); the
+// edits below are the statements for each change, as transaction work for libraryThread.
+
+class librarySql
+{
+public:
+    static QString prefixEnd(QString text);      // Least name after all those starting with text (as tags.name compares), for an indexed range
+    static QString books(bool inList);           // Books with a tag: values are the list's range (if inList) then the tag; ends before "group by" so a condition can go between
+    static QString booksEnd();
+    static QString playLists();                  // Tag id, list's tag, book and position for each book in a list: values are the range of the lists' prefix
+    static QString bookChanges();                // Each book's id, and whether it changed since the value
+    static libraryThread::transactionWork addToList(const QList<QPair<int,QString>>& adding);  // (book, tag name) of each, in order
+    static libraryThread::transactionWork removeFromList(int book, const QString& tagName);
+    static libraryThread::transactionWork renameTags(const QStringList& from, const QStringList& to);  // Through a temporary name, so no new name is taken while it's still an old one
+    static libraryThread::transactionWork newList(const QString& tagPrefix, int book, const QString& tagName);  // Nothing if a tag starting with tagPrefix is there by then
+};
+
+#endif // LIBRARYSQL_H
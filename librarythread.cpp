@@ -0,0 +1,288 @@
+// Copyright 2023 by Linwood Ferguson, licensed under GNU GPLv3
+
+#include <QDebug>
+#include <QSqlDatabase>
+#include <QSqlQuery>
+#include <QSqlRecord>
+#include <QSqlError>
+#include <QUrl>
+
+#include "librarythread.h"
+
+#include <cassert>
+
+#define LIBRARYTHREAD_CONNECTION "libraryThread"   // Connections are per thread, so these are named to keep them apart from any others
+#define LIBRARYTHREAD_WRITE_CONNECTION "libraryThreadWrites"
+
+libraryThread::libraryThread(QObject *parent, QString databasePath, bool immutable, int mmapMB, int cacheMB) : QThread(parent)
+{
+    // Constructor is running in the parent thread
+    qDebug() << "in constructor with " << databasePath << ", immutable " << immutable << ", mmap " << mmapMB << "MB, cache " << cacheMB << "MB";
+    abort = false;
+    runningKind = -1;
+    runningSuperseded = false;
+    mDatabasePath = databasePath;
+    mImmutable = immutable;
+    mMmapMB = mmapMB;
+    mCacheMB = cacheMB;
+    reopenRead = false;
+}
+
+libraryThread::~libraryThread()
+{
+    qDebug() << "In destructor";
+    mutex.lock();
+    abort = true;
+    runningSuperseded = true;  // Don't finish reading a large library on the way out
+    condition.wakeOne();
+    mutex.unlock();
+    wait();
+    qDebug() << "Wait finished, leaving destructor";
+}
+
+void libraryThread::query(queryKind kind, int serial, QString sql, QVariantList values)
+{
+    // Run in the parent thread.  Results of an older query of this kind are no longer wanted, so drop or stop it.
+    mutex.lock();
+    for(int i = queue.size() - 1; i >= 0; i--)
+        if(queue[i].kind == kind) queue.removeAt(i);
+    if(runningKind == kind) runningSuperseded = true;
+    queue.append({kind, serial, sql, values});
+    if(this->isRunning()) condition.wakeOne();
+    else start(QThread::LowPriority);
+    mutex.unlock();
+}
+
+void libraryThread::transaction(int serial, transactionWork work)
+{
+    // Run in the parent thread, which doesn't wait; transactionDone comes back when it's committed or rolled back
+    mutex.lock();
+    transactions.append({serial, work});
+    if(this->isRunning()) condition.wakeOne();
+    else start(QThread::LowPriority);
+    mutex.unlock();
+}
+
+libraryThread::statementResult libraryThread::step(QString sql, QVariantList values)
+{
+    statementResult result;
+    runStatement(true, sql, values, &result);
+    return result;
+}
+
+bool libraryThread::checkSqlError(QString stage, const QSqlError& err)
+{
+    // Same rules as musicLibrary::checkSqlError, but we report rather than abort as the caller is in another thread
+    if(err.databaseText()!="" || err.driverText()!="")
+    {
+        qDebug() << stage << " resulted in error " << err;
+        return false;
+    }
+    return true;
+}
+
+void libraryThread::databaseChanged()
+{
+    mutex.lock();
+    reopenRead = true;
+    mutex.unlock();
+}
+
+void libraryThread::openRead()
+{
+    // (Re)open the read connection: read only, by URI so it can be immutable, and not waiting long on Calibre's locks
+    qDeleteAll(prepared);  // Statements belong to the connection
+    prepared.clear();
+    QSqlDatabase db = QSqlDatabase::database(LIBRARYTHREAD_CONNECTION, false);
+    db.close();
+    db.setConnectOptions("QSQLITE_OPEN_URI;QSQLITE_OPEN_READONLY;QSQLITE_BUSY_TIMEOUT=" + QString::number(MUSICALPI_LIBRARY_BUSY_MS));
+    db.setDatabaseName(QUrl::fromLocalFile(mDatabasePath).toString(QUrl::FullyEncoded) + (mImmutable ? "?mode=ro&immutable=1" : "?mode=ro"));
+    db.open();
+    checkSqlError("Opening SQL database " + db.databaseName(), db.lastError());
+    QSqlQuery pragmas(db);
+    const QStringList settings = {"PRAGMA query_only=1;",
+                                  "PRAGMA mmap_size=" + QString::number((qint64)mMmapMB * 1024 * 1024) + ";",
+                                  "PRAGMA cache_size=-" + QString::number(mCacheMB * 1024) + ";"};  // (negative is in KB)
+    for(const QString& setting : settings)
+    {
+        pragmas.exec(setting);
+        checkSqlError("Setting " + setting, pragmas.lastError());  // Each, so a failed query_only isn't hidden by the others
+    }
+    pragmas.exec("PRAGMA query_only;");
+    if(!pragmas.next() || pragmas.value(0).toInt() != 1) qDebug() << "Read connection is not query only, " << pragmas.lastError();
+}
+
+QSqlDatabase libraryThread::writeConnection()
+{
+    QSqlDatabase db = QSqlDatabase::database(LIBRARYTHREAD_WRITE_CONNECTION, false);
+    if(!db.isValid())
+    {
+        db = QSqlDatabase::addDatabase("QSQLITE", LIBRARYTHREAD_WRITE_CONNECTION);
+        db.setConnectOptions("QSQLITE_BUSY_TIMEOUT=" + QString::number(MUSICALPI_LIBRARY_WRITE_BUSY_MS));  // Our writes should wait for Calibre's
+        db.setDatabaseName(mDatabasePath);
+    }
+    if(!db.isOpen())
+    {
+        db.open();
+        checkSqlError("Opening SQL database for writes " + db.databaseName(), db.lastError());
+    }
+    return db;
+}
+
+QSqlQuery* libraryThread::preparedQuery(bool writes, const QString& sql, const QVariantList& values)
+{
+    // Prepare each SQL text the first time it's seen, then just bind new values and run it again
+    QHash<QString, QSqlQuery*>& cache = writes ? preparedWrites : prepared;
+    QSqlQuery* query = cache.value(sql, NULL);
+    if(query == NULL)
+    {
+        query = new QSqlQuery(writes ? writeConnection() : QSqlDatabase::database(LIBRARYTHREAD_CONNECTION, false));
+        query->setForwardOnly(true);  // We only read through once, so don't let it keep every row
+        query->prepare(sql);
+        checkSqlError("Prepared " + sql, query->lastError());
+        cache.insert(sql, query);
+    }
+    for(int i = 0; i < values.size(); i++) query->bindValue(i, values[i]);
+    query->exec();
+    checkSqlError("Executed query " + sql, query->lastError());
+    return query;
+}
+
+void libraryThread::runStatement(bool writes, const QString& sql, const QVariantList& values, statementResult* result)
+{
+    QSqlQuery* query = preparedQuery(writes, sql, values);
+    result->error = query->lastError().databaseText() + " / " + query->lastError().driverText();
+    result->lastInsertId = query->lastInsertId();
+    result->rowsAffected = query->numRowsAffected();
+    int fields = query->record().count();
+    while(query->next())
+    {
+        QStringList row;
+        for(int field = 0; field < fields; field++) row.append(query->value(field).toString());
+        result->rows.append(row);
+    }
+    query->finish();  // Done with it until next time, so let go of the statement's read lock
+}
+
+void libraryThread::runTransactions()
+{
+    // Run each waiting transaction; called with the mutex unlocked.  IMMEDIATE takes the write lock (waiting for
+    // Calibre if need be) before anything is read, so nothing can change between our reads and writes.
+    forever
+    {
+        mutex.lock();
+        if(transactions.isEmpty())
+        {
+            mutex.unlock();
+            return;
+        }
+        transactionRequest request = transactions.takeFirst();
+        mutex.unlock();
+
+        QSqlDatabase db = writeConnection();
+        QString error;
+        {
+            QSqlQuery begin(db);
+            begin.exec("BEGIN IMMEDIATE;");
+            error = begin.lastError().databaseText() + " / " + begin.lastError().driverText();
+        }
+        if(error == " / ") error = request.work(this);
+        if(error == " / ")
+        {
+            QSqlQuery commit(db);
+            commit.exec("COMMIT;");
+            error = commit.lastError().databaseText() + " / " + commit.lastError().driverText();
+        }
+        if(error != " / ")
+        {
+            qDebug() << "Transaction " << request.serial << " failed with " << error << ", rolling back";
+            QSqlQuery rollback(db);
+            rollback.exec("ROLLBACK;");  // (fails harmlessly if BEGIN did)
+        }
+        else qDebug() << "Transaction " << request.serial << " committed";
+
+        mutex.lock();
+        reopenRead = true;  // An immutable read connection wouldn't see what we just did
+        mutex.unlock();
+        emit transactionDone(request.serial, error);
+    }
+}
+
+void libraryThread::run()
+{
+    {   // Scope so the database object is gone before we remove the connection
+        QSqlDatabase::addDatabase("QSQLITE", LIBRARYTHREAD_CONNECTION);
+        openRead();
+        forever
+        {
+            mutex.lock();
+            bool reopen = reopenRead && mImmutable;  // Otherwise SQLite notices changes itself
+            reopenRead = false;
+            mutex.unlock();
+            if(reopen) openRead();
+            runTransactions();  // (no query open now, see above)
+            mutex.lock();
+            while(queue.isEmpty() && transactions.isEmpty() && !abort) condition.wait(&mutex);
+            if(abort)
+            {
+                mutex.unlock();
+                break;
+            }
+            if(queue.isEmpty())  // Only transactions to run
+            {
+                mutex.unlock();
+                continue;
+            }
+            libraryRequest thisRequest = queue.takeFirst();
+            runningKind = thisRequest.kind;
+            runningSuperseded = false;
+            mutex.unlock();
+
+            QSqlQuery& query = *preparedQuery(false, thisRequest.sql, thisRequest.values);
+            QSqlRecord rec = query.record();
+            QStringList fieldNames;
+            for(int field = 0; field < rec.count(); field++) fieldNames.append(rec.fieldName(field));
+            emit queryStarted(thisRequest.kind, thisRequest.serial, fieldNames);
+
+            QList<QStringList> chunk;
+            int rowCount = 0;
+            bool superseded = false;
+            while(query.next())
+            {
+                QStringList row;
+                for(int field = 0; field < fieldNames.size(); field++) row.append(query.value(field).toString());
+                chunk.append(row);
+                rowCount++;
+                if(chunk.size() == MUSICALPI_LIBRARY_CHUNK_ROWS)
+                {
+                    emit rowsRead(thisRequest.kind, thisRequest.serial, chunk);
+                    chunk.clear();
+                    mutex.lock();
+                    superseded = runningSuperseded;
+                    mutex.unlock();
+                    if(superseded) break;
+                }
+            }
+            if(!superseded)
+            {
+                if(!chunk.isEmpty()) emit rowsRead(thisRequest.kind, thisRequest.serial, chunk);
+                emit queryFinished(thisRequest.kind, thisRequest.serial, rowCount);
+                qDebug() << "Query for " << (thisRequest.kind == booksQuery ? "books" : thisRequest.kind == bookChangesQuery ? "book changes" : "playlists") << " returned " << rowCount << " rows";
+            }
+            else qDebug() << "Query superseded after " << rowCount << " rows";
+            query.finish();
+            mutex.lock();
+            runningKind = -1;
+            mutex.unlock();
+        }
+        qDeleteAll(prepared);
+        prepared.clear();
+        qDeleteAll(preparedWrites);
+        preparedWrites.clear();
+        QSqlDatabase::database(LIBRARYTHREAD_CONNECTION, false).close();
+        QSqlDatabase::database(LIBRARYTHREAD_WRITE_CONNECTION, false).close();
+    }
+    QSqlDatabase::removeDatabase(LIBRARYTHREAD_CONNECTION);
+    QSqlDatabase::removeDatabase(LIBRARYTHREAD_WRITE_CONNECTION);
+    qDebug() << "Returning with abort";
+}
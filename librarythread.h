@@ -0,0 +1,105 @@
+#ifndef LIBRARYTHREAD_H
+#define LIBRARYTHREAD_H
+
+// Copyright 2023 by Linwood Ferguson, licensed under GNU GPLv3
+
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QStringList>
+#include <QList>
+#include <QHash>
+#include <QVariant>
+#include "piconstants.h"
+
+#include <functional>
+
+class QSqlError;
+class QSqlQuery;
+class QSqlDatabase;
+
+// Runs the library's queries away from the GUI thread, on its own database connection, since over a network share
+// (CIFS) opening the Calibre database and reading the library can take seconds.  Rows come back in chunks (all values
+// as strings, as the library displays them) so the view fills in progressively.
+//
+// The connection stays open for the life of the thread (SQLite holds no locks between statements, so this doesn't get
+// in Calibre's way) and each distinct SQL text is prepared once and reused with new values bound, so nothing re-reads
+// the header and schema over the network per operation.
+//
+// Reads use a read-only connection that gives up quickly if Calibre is writing rather than waiting on it.  It can also
+// be opened immutable, which takes no locks at all (so never holds up Calibre), but then SQLite can't see Calibre's
+// changes, so the connection is reopened whenever we are told the database changed.  Our own (playlist) writes go
+// through a separate read-write connection, opened the first time one is needed.
+//
+// Playlist changes are sent as a transaction: a function run on this thread (so it must only use what it captured)
+// whose statements, run with step, all go in one BEGIN IMMEDIATE ... COMMIT (or ROLLBACK if it returns an error).
+// The caller doesn't wait; transactionDone says how it went.  Transactions run only between queries: a query part read
+// still holds its SHARED lock, and Calibre's database (on CIFS, so not in WAL mode) can't be committed to until that's
+// let go, so one run then would wait out its busy timeout and fail.
+
+class libraryThread : public QThread
+{
+    Q_OBJECT
+
+public:
+    enum queryKind {playListsQuery, booksQuery, bookChangesQuery};
+    struct statementResult
+    {
+        QList<QStringList> rows;
+        QVariant lastInsertId;
+        int rowsAffected;     // By an insert, update or delete
+        QString error;        // Database and driver error texts separated by " / ", so just " / " if none
+    };
+    typedef std::function<QString(libraryThread*)> transactionWork;  // Returns an error as above, " / " to commit
+    libraryThread(QObject *parent, QString databasePath, bool immutable, int mmapMB, int cacheMB);
+    ~libraryThread();
+    void query(queryKind kind, int serial, QString sql, QVariantList values = QVariantList());  // Replaces (and stops) any earlier query of the same kind
+    void transaction(int serial, transactionWork work);  // Queues work to run in one write transaction
+    statementResult step(QString sql, QVariantList values = QVariantList());  // For transactionWork only, runs one of its statements
+    void databaseChanged();   // Calibre changed the database, so an immutable connection must be reopened to see it
+
+protected:
+    void run() Q_DECL_OVERRIDE;
+
+signals:
+    void queryStarted(int kind, int serial, QStringList fieldNames);
+    void rowsRead(int kind, int serial, QList<QStringList> rows);
+    void queryFinished(int kind, int serial, int rowCount);
+    void transactionDone(int serial, QString error);
+
+private:
+    struct libraryRequest
+    {
+        queryKind kind;
+        int serial;           // Caller's number for this request, returned with results so it can ignore stale ones
+        QString sql;
+        QVariantList values;  // Bound in order to the ?'s in sql
+    };
+    struct transactionRequest
+    {
+        int serial;
+        transactionWork work;
+    };
+    bool abort;
+    QMutex mutex;             // Protects the queue and goes with the condition below
+    QWaitCondition condition; // Thread sleeps on this when there is nothing to do
+    QList<libraryRequest> queue;
+    QList<transactionRequest> transactions;  // Waiting to be run, in the order they came
+    int runningKind;          // Kind being run now, -1 if none
+    bool runningSuperseded;   // A newer query of the running kind came in, so stop this one
+    QString mDatabasePath;
+    bool mImmutable;
+    int mMmapMB;
+    int mCacheMB;
+    bool reopenRead;          // Set by databaseChanged
+    QHash<QString, QSqlQuery*> prepared;       // By SQL text, for the read connection; only used on the thread
+    QHash<QString, QSqlQuery*> preparedWrites; //     and for the write connection
+    bool checkSqlError(QString stage, const QSqlError& err);
+    void openRead();
+    QSqlDatabase writeConnection();
+    QSqlQuery* preparedQuery(bool writes, const QString& sql, const QVariantList& values);
+    void runStatement(bool writes, const QString& sql, const QVariantList& values, statementResult* result);
+    void runTransactions();
+};
+
+#endif // LIBRARYTHREAD_H
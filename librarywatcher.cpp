@@ -0,0 +1,68 @@
+// Copyright 2023 by Linwood Ferguson, licensed under GNU GPLv3
+
+#include <QDebug>
+#include <QFileInfo>
+#include <QDateTime>
+
+#include "librarywatcher.h"
+
+libraryWatcher::libraryWatcher(QObject *parent, QString databasePath) : QObject(parent)
+{
+    files << databasePath << databasePath + "-journal" << databasePath + "-wal";
+    folder = QFileInfo(databasePath).absolutePath();
+    lastSignature = signature();
+    watchFiles();
+    connect(&watcher, &QFileSystemWatcher::fileChanged, this, [this]() { settleTimer.start(); });
+    connect(&watcher, &QFileSystemWatcher::directoryChanged, this, [this]() { settleTimer.start(); });
+    settleTimer.setSingleShot(true);
+    settleTimer.setInterval(MUSICALPI_LIBRARY_SETTLE_MS);
+    connect(&settleTimer, &QTimer::timeout, this, &libraryWatcher::check);
+    pollTimer.setInterval(MUSICALPI_LIBRARY_POLL_MS);
+    connect(&pollTimer, &QTimer::timeout, this, &libraryWatcher::check);
+    qDebug() << "Watching " << files << ", watcher has " << watcher.files();
+}
+
+void libraryWatcher::setPolling(bool on)
+{
+    if(on == pollTimer.isActive()) return;
+    if(!on)
+    {
+        pollTimer.stop();
+        return;
+    }
+    pollTimer.start();
+    check();  // (anything inotify missed while we weren't polling)
+}
+
+QString libraryWatcher::signature()
+{
+    QString result;
+    for(const QString& file : files)
+    {
+        QFileInfo info(file);
+        info.setCaching(false);
+        if(info.exists()) result += QString::number(info.size()) + "@" + QString::number(info.lastModified().toMSecsSinceEpoch());
+        result += ";";
+    }
+    return result;
+}
+
+void libraryWatcher::watchFiles()
+{
+    // A file that is replaced or deleted (as the journal is after each write) drops out of the watcher, so add back
+    // any that exist now; addPath just warns about ones already there, so only add those missing
+    QStringList watching = watcher.files();
+    for(const QString& file : files)
+        if(!watching.contains(file) && QFileInfo::exists(file)) watcher.addPath(file);
+    if(!watcher.directories().contains(folder)) watcher.addPath(folder);
+}
+
+void libraryWatcher::check()
+{
+    QString now = signature();
+    watchFiles();
+    if(now == lastSignature) return;
+    qDebug() << "Library database changed, was " << lastSignature << " now " << now;
+    lastSignature = now;
+    emit changed();
+}
@@ -0,0 +1,44 @@
+#ifndef LIBRARYWATCHER_H
+#define LIBRARYWATCHER_H
+
+// Copyright 2023 by Linwood Ferguson, licensed under GNU GPLv3
+
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <QTimer>
+#include <QFileSystemWatcher>
+#include "piconstants.h"
+
+// Tells the library when Calibre's database has changed, so it need not reload on the chance that it did.  The
+// database and its journal or write-ahead log are watched (inotify, where the file system supports it), but changes
+// made over a network share (CIFS) are not always reported that way, so their sizes and times are also checked every
+// few seconds, which costs a few stat calls.  That is only done while the library is showing (see setPolling), as a
+// stalled share would hold up whatever else the GUI thread is doing, such as turning pages; while it's hidden the
+// library only notes that there was a change, so inotify is enough.  Either way changed is only emitted once writes
+// settle, and only if the files really are different.
+
+class libraryWatcher : public QObject
+{
+    Q_OBJECT
+
+public:
+    libraryWatcher(QObject *parent, QString databasePath);
+    void setPolling(bool on);     // Check every few seconds as well (checking now when turned on); off at first
+
+signals:
+    void changed();
+
+private:
+    QStringList files;            // The database, and the journal and WAL SQLite may create next to it
+    QString folder;               // Watched for the journal or WAL appearing
+    QString lastSignature;        // Sizes and times of the files when last checked
+    QFileSystemWatcher watcher;
+    QTimer pollTimer;
+    QTimer settleTimer;           // Restarted by each notification, so a burst of writes is checked once
+    QString signature();
+    void watchFiles();
+    void check();
+};
+
+#endif // LIBRARYWATCHER_H
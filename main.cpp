@@ -8,6 +8,8 @@ int main(int argc, char *argv[])
 {
     qInstallMessageHandler(myMessageOutput);
     QApplication a(argc, argv);
+    a.setOrganizationName("Linwood Ferguson");  // Same as the settings, and where local data (e.g. library snapshots) is kept
+    a.setApplicationName("MusicalPi");
     a.setStyleSheet(QString(
         "QWidget                         {                background-color:" MUSICALPI_BACKGROUND_COLOR_NORMAL "; margin: 0px; padding: 0px; } "
         "QPushButton                     {color: black;   background-color: gray; font-size: 16px ; border: 1px solid black; border-radius: 4px; height: 35px; padding: 5px; min-width: 60px; text-align: center;} "
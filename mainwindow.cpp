@@ -10,6 +10,10 @@
 #include <QScreen>
 #include <QTimer>
 #include <QRect>
+#include <QPixmap>
+#include <QElapsedTimer>
+#include <QPainter>
+#include <QPaintEvent>
 #include <cmath>
 
 #include "mainwindow.h"
@@ -20,20 +24,34 @@
 #include "settingswidget.h"
 //#include "midiplayerV2.h"
 #include "oursettings.h"
+#include "usagelog.h"
 #include "playlists.h"
+#include "allocationcounter.h"
 
 MainWindow::MainWindow() : QMainWindow()
 {
     qDebug() << "MainWindow::MainWindow() in constructor";
     setWindowTitle(tr("MusicalPi"));
     ourSettingsPtr = new ourSettings(this);  // Get all our defaults
+    usagePtr = new usageLog();
+    debugPageTurns = ourSettingsPtr->getSetting("debugPageTurnDetails").toBool();
+
+    // Pick once the pixel format the raster backend uses for opaque pixmaps (the screen's format, normally
+    // RGB32) so pages are rendered, composed and drawn to the screen in it with no conversion along the way.
+    QPixmap formatProbe(1,1);
+    formatProbe.fill(Qt::white);
+    pageImageFormat = formatProbe.toImage().format();
+    qDebug() << "Page images will use format " << pageImageFormat;
+
     PDF = NULL;
+    preparedPDF = NULL;
+    cancelledPDFs = 0;
+    aheadBusy = false;
     mp = NULL;
     pl = NULL;
     pagesNowDown = 0;
     pagesNowAcross = 0;
     overlay = NULL;
-    for(int i=0; i<MUSICALPI_MAXCOLUMNS * MUSICALPI_MAXROWS; i++) loadPagePendingNumber[i]=0; // flag as nothing yet to load
 
     // The below determines the actual size of the screen, but in case it is not working the settings
     // file can override it if set.
@@ -58,8 +76,11 @@ MainWindow::MainWindow() : QMainWindow()
 MainWindow::~MainWindow()
 {
     qDebug() << "MainWindow::~MainWindow in destructor";
+    cancelOpen();
+    for(PDFDocument* doc : findChildren<PDFDocument*>()) disconnect(doc, nullptr, this, nullptr);  // (their going must not call back into us as we go)
     deletePDF();
     DELETE_LOG(libraryTable);
+    DELETE_LOG(usagePtr);
 }
 
 void MainWindow::setupCoreWidgets()
@@ -70,6 +91,7 @@ void MainWindow::setupCoreWidgets()
     qDebug()<< "Starting widget setup";
     outerLayoutWidget = new QWidget();
     outerLayoutWidget->setObjectName("outerLayoutWidget");
+    outerLayoutWidget->installEventFilter(this);  // To paint its play mode background, see eventFilter
     outerLayoutWidget->setSizePolicy(QSizePolicy::MinimumExpanding, QSizePolicy::MinimumExpanding);
     outerLayout = new QVBoxLayout(outerLayoutWidget);
     this->setCentralWidget(outerLayoutWidget);
@@ -173,6 +195,12 @@ void MainWindow::setupCoreWidgets()
     playerMenuLayout->addWidget(fourByTwoButton);
     connect(fourByTwoButton,&QPushButton::clicked, this, [this](){this->setPlayMode(false,4,2);});
 
+    overviewButton  = new QPushButton("Overview");
+    playerMenuLayout->addWidget(overviewButton);
+    connect(overviewButton,&QPushButton::clicked, this, [this](){this->setPlayMode(false,
+                                                                                 ourSettingsPtr->getSetting("overviewAcross").toInt(),
+                                                                                 ourSettingsPtr->getSetting("overviewDown").toInt());});
+
 //    playMidiButton = new QPushButton("Play Midi");
 //    playerMenuLayout->addWidget(playMidiButton);
 //    connect(playMidiButton,&QPushButton::clicked, this, &MainWindow::doMidiPlayer);
@@ -181,11 +209,8 @@ void MainWindow::setupCoreWidgets()
     playerMenuLayout->addWidget(playListButton);
     connect(playListButton,&QPushButton::clicked, this, &MainWindow::doPlayLists);
 
-    // ALl details of this get filled in during use in play section; not all may be use, this is max.
-    for (int i=0; i < (MUSICALPI_MAXCOLUMNS * MUSICALPI_MAXROWS); i++)
-    {
-        visiblePages[i] = new docPageLabel(outerLayoutWidget, this);
-    }
+    // ALl details of this get filled in during use in play section; more are added if a larger grid is asked for
+    ensurePanes(2);
 
     generalLayoutWidget = new QWidget(outerLayoutWidget);
     generalLayoutWidget->setAccessibleDescription("generalLayoutWidget");
@@ -215,7 +240,33 @@ void MainWindow::setupCoreWidgets()
     generalLayout->setAlignment(settingsUI,Qt::AlignTop | Qt::AlignLeft);
 
     overlay = new TipOverlay(outerLayoutWidget, this);
-    connect(libraryTable, SIGNAL(songSelected(QString,QString)), this, SLOT(startPlayMode(QString,QString)));
+    connect(libraryTable, SIGNAL(songSelected(QString,QString,int)), this, SLOT(startPlayMode(QString,QString,int)));
+}
+
+void MainWindow::ensurePanes(int count)
+{
+    // Panes are created the first time a grid needs them, then kept (hidden when not in use)
+    while(visiblePages.size() < count)
+    {
+        int index = visiblePages.size();
+        docPageLabel* pane = new docPageLabel(outerLayoutWidget, this);
+        if(overlay) pane->stackUnder(overlay);  // created after the overlay, so would otherwise be on top of it
+        connect(pane, &docPageLabel::clicked, this, [this,index]{paneClicked(index);});
+        visiblePages.append(pane);
+        loadPagePendingNumber.append(0);  // flag as nothing yet to load
+        loadPagePendingTransition.append(docPageLabel::noTransition);
+    }
+}
+
+void MainWindow::paneClicked(int index)
+{
+    // In a thumbnail grid (reviewing only) tapping a page opens it Two Up, to find a page quickly in a large book
+    if(nowMode != playMode || playing || PDF == NULL || !PDF->usingThumbnails()) return;
+    int page = leftmostPage + index;
+    if(page > PDF->numPages) return;
+    qDebug() << "Opening page " << page << " from thumbnail";
+    leftmostPage = page;
+    setPlayMode(false,2,1);
 }
 
 void MainWindow::setLibraryMode()
@@ -264,31 +315,53 @@ void MainWindow::setSettingsMode()
     libraryButton->setVisible(true);
 }
 
-void MainWindow::startPlayMode(QString path, QString _titlePlaying)
+void MainWindow::startPlayMode(QString path, QString _titlePlaying, int startPage)
 {
-    qDebug() << "Calling with " << path << ", " << _titlePlaying;
+    qDebug() << "Calling with " << path << ", " << _titlePlaying << " at page " << startPage;
     kbd.hide();
-    if(PDF==NULL || PDF->filepath != path)
+    bool opening = (PDF==NULL || PDF->filepath != path);
+    if(opening)
     {
         deletePDF();
-        PDF = new PDFDocument(this, path, _titlePlaying);
+        if(preparedPDF != NULL && preparedPDF->filepath == path)
+        {
+            PDF = preparedPDF;  // Opened when its row was touched, and its first spread rendering (or rendered) since
+            preparedPDF = NULL;
+            disconnect(PDF, &PDFDocument::newImageReady, this, &MainWindow::checkOpenAhead);
+        }
+        else PDF = new PDFDocument(this, path, _titlePlaying);
+        cancelOpen();  // (one prepared for some other book)
+        checkOpenAhead();
         leftmostPage = 1;   // Always start new document from zero
         connect(PDF,&PDFDocument::newImageReady,this, [this]{this->checkQueueVsCache();});
         //Hide or show button if midi there
 //        playMidiButton->setVisible(PDF->midiFilePath != "");
     }
+    // A song inside a book starts at its own page; setPlayMode asks for this spread first, so it's what gets rendered first
+    if(startPage > 1) leftmostPage = std::min(startPage, PDF->numPages);
     libraryButton->setVisible(true);
     setPlayMode(false,2,1);
+    if(opening)
+    {
+        // Now the size its first pages are rendered for is known, so next time they can be rendered ahead
+        usagePtr->opened(path, _titlePlaying, leftmostPage, QSize(PDF->imageWidth, PDF->imageHeight), pagesNowAcross * pagesNowDown);
+        openTimer.start();
+    }
 }
 
 void MainWindow::setPlayMode(bool _playing, int pagesToShowAcross, int pagesToShowDown)
 {
     qDebug() << "setPlayMode(playing=" << _playing << "," << pagesToShowAcross << "," << pagesToShowDown << ") called";
+    bool wasPlaying = (nowMode == playMode && playing);  // i.e. if outerLayoutWidget now has the playing background
     nowMode=playMode;
     kbd.hide();
     HideEverything();  // This gets called with play already there when changing modes
     playing = _playing;
     pageBorderWidth = ourSettingsPtr->getSetting("pageBorderWidth").toInt();
+    overlayTopPortion = ourSettingsPtr->getSetting("overlayTopPortion").toInt();
+    overlaySidePortion = ourSettingsPtr->getSetting("overlaySidePortion").toInt();
+    debugPageTurns = ourSettingsPtr->getSetting("debugPageTurnDetails").toBool();
+    pageBackground = QColor(playing ? MUSICALPI_BACKGROUND_COLOR_PLAYING : MUSICALPI_BACKGROUND_COLOR_NORMAL);
     if(!playing) // if we are in player review, not playing mode
     {
         menuLayoutWidget->show();
@@ -312,20 +385,18 @@ void MainWindow::setPlayMode(bool _playing, int pagesToShowAcross, int pagesToSh
     }
     cornerleft.show();
     cornerright.show();
-    // Change all widget backgrounds to the playing color, or normal color, as appropriate
-#ifndef MUSICALPI_DEBUG_WIDGET_BORDERS
-    QString playBackground = "background-color: " + QString((playing ?  MUSICALPI_BACKGROUND_COLOR_PLAYING : MUSICALPI_BACKGROUND_COLOR_NORMAL));
-    outerLayoutWidget->setStyleSheet("docPageLabel {" + playBackground + " } "
-                                     "#outerLayoutWidget {" + playBackground + "}" );
-#endif
-    // These are placed in outerLayoutWidget reduced in height but the size of menuLayoutWidget if not playing
-    QSize outerLayoutWidgetSize = outerLayoutWidget->size();
-    QSize menuLayoutWidgetSize = menuLayoutWidget->size();
-    // These are packed as tight as they can go, except between rows and between columns put in a small border
-    int roomForMenu = playing ? 0 : menuLayoutWidgetSize.height();
-    int maxPageWidth = std::floor((outerLayoutWidgetSize.width() - pageBorderWidth * (pagesToShowAcross - 1)) / pagesToShowAcross);
-    int maxPageHeight = std::floor((outerLayoutWidgetSize.height() - roomForMenu - pageBorderWidth * (pagesToShowDown - 1)) / pagesToShowDown);
+    // The playing color, or normal color, is painted by the panes and our eventFilter from pageBackground, not by
+    // a style sheet, as setting one restyles every child and made each mode change slow.
+    if(playing != wasPlaying) outerLayoutWidget->update();
+    int maxPageWidth, maxPageHeight, roomForMenu;
+    pageCellSize(pagesToShowAcross, pagesToShowDown, playing, maxPageWidth, maxPageHeight, roomForMenu);
     PDF->checkResetImageSize(maxPageWidth, maxPageHeight + roomForMenu);  // add menu back in so we get larger image in cache so we don't re-cache for playing mode
+    // Cells well under the cached page size are filled with thumbnails, made by scaling down cached pages where we have them
+    if(maxPageWidth * 2 <= PDF->imageWidth && maxPageHeight * 2 <= PDF->imageHeight)
+        PDF->checkResetThumbnailSize(maxPageWidth, maxPageHeight + roomForMenu / pagesToShowDown);
+    else
+        PDF->checkResetThumbnailSize(0, 0);
+    ensurePanes(pagesToShowAcross * pagesToShowDown);
     for (int r=0; r<pagesToShowDown; r++)
     {
         for (int c=0; c<pagesToShowAcross; c++)
@@ -336,7 +407,7 @@ void MainWindow::setPlayMode(bool _playing, int pagesToShowAcross, int pagesToSh
             loadPagePendingTransition[indx] = docPageLabel::noTransition;
             visiblePages[indx]->setAttribute(Qt::WA_TransparentForMouseEvents, playing);  // if we are playing, pass mouse events through to main window
             visiblePages[indx]->show();
-            qDebug() << "visiblePages[" << indx << "] sized and shown";
+            if(debugPageTurns) qDebug() << "visiblePages[" << indx << "] sized and shown";
         }
     }
     checkQueueVsCache();
@@ -345,28 +416,91 @@ void MainWindow::setPlayMode(bool _playing, int pagesToShowAcross, int pagesToSh
     if(playing && ourSettingsPtr->getSetting("pageTurnTipOverlay").toBool()) overlay->show();
 }
 
+void MainWindow::pageCellSize(int pagesToShowAcross, int pagesToShowDown, bool forPlaying, int& maxPageWidth, int& maxPageHeight, int& roomForMenu)
+{
+    // These are placed in outerLayoutWidget reduced in height but the size of menuLayoutWidget if not playing
+    QSize outerLayoutWidgetSize = outerLayoutWidget->size();
+    QSize menuLayoutWidgetSize = menuLayoutWidget->size();
+    // These are packed as tight as they can go, except between rows and between columns put in a small border
+    roomForMenu = forPlaying ? 0 : menuLayoutWidgetSize.height();
+    maxPageWidth = std::floor((outerLayoutWidgetSize.width() - pageBorderWidth * (pagesToShowAcross - 1)) / pagesToShowAcross);
+    maxPageHeight = std::floor((outerLayoutWidgetSize.height() - roomForMenu - pageBorderWidth * (pagesToShowDown - 1)) / pagesToShowDown);
+}
+
+void MainWindow::prepareOpen(QString path, QString title, int startPage)
+{
+    // Called as a library row is touched, before we know if it's a tap or the start of a scroll, so that by the time
+    // it's released (and startPlayMode is called) the book is open and its first spread rendering, at the size
+    // startPlayMode will want (the same 2 up review it shows first)
+    if((PDF != NULL && PDF->filepath == path) || (preparedPDF != NULL && preparedPDF->filepath == path)) return;
+    cancelOpen();
+    qDebug() << "Opening " << path << " ahead at page " << startPage;
+    preparedPDF = new PDFDocument(this, path, title);
+    pageBorderWidth = ourSettingsPtr->getSetting("pageBorderWidth").toInt();
+    int maxPageWidth, maxPageHeight, roomForMenu;
+    pageCellSize(2, 1, false, maxPageWidth, maxPageHeight, roomForMenu);
+    preparedPDF->adjustCache(std::max(1, std::min(startPage, preparedPDF->numPages)));  // Where to start, before a size lets it render
+    preparedPDF->checkResetImageSize(maxPageWidth, maxPageHeight + roomForMenu);
+    connect(preparedPDF, &PDFDocument::newImageReady, this, &MainWindow::checkOpenAhead);
+    checkOpenAhead();
+}
+
+void MainWindow::cancelOpen()
+{
+    // Deleting it now would wait for the pages rendering to finish, holding up the scroll that probably cancelled it,
+    // so it only stops starting more, and goes once those are done
+    if(preparedPDF == NULL) return;
+    qDebug() << "Cancelled opening " << preparedPDF->filepath << " ahead";
+    PDFDocument* cancelled = preparedPDF;
+    preparedPDF = NULL;
+    cancelled->stopCaching();
+    disconnect(cancelled, &PDFDocument::newImageReady, this, &MainWindow::checkOpenAhead);
+    cancelledPDFs++;
+    connect(cancelled, &QObject::destroyed, this, [this]{ cancelledPDFs--; checkOpenAhead(); });
+    if(cancelled->idle()) cancelled->deleteLater();
+    else connect(cancelled, &PDFDocument::newImageReady, cancelled, [cancelled]{ if(cancelled->idle()) cancelled->deleteLater(); });
+    checkOpenAhead();
+}
+
+// Slot
+void MainWindow::checkOpenAhead()
+{
+    // Busy from when a book is opened ahead until it has rendered what it caches (or is taken up), and while any
+    // cancelled are still finishing, so the library's background work (thumbnails, songs) never competes with them
+    bool busy = (preparedPDF != NULL && !preparedPDF->idle()) || cancelledPDFs > 0;
+    if(busy == aheadBusy) return;
+    aheadBusy = busy;
+    emit openAheadBusy(busy);
+}
+
 void MainWindow::checkQueueVsCache()
 {
+    // This is on the page turn path, so it should not allocate (checked by hand with MUSICALPI_DEBUG_PAGE_TURN_CHECK)
     PDF->adjustCache(leftmostPage);
     PDF->lockOrUnlockMutex(true); // Shouldn't need this but just make sure the ones we find are fully formed - this may be too broad, and we might want to put this just around the inner loop so it releases each time
     int skipped = 0;
-    for(int i = 0; i < MUSICALPI_MAXCOLUMNS * MUSICALPI_MAXROWS ; i++)
+    for(int i = 0; i < pagesNowAcross * pagesNowDown ; i++)
     {
         if(loadPagePendingNumber[i] > PDF->numPages)
         {
             // We are out of the range of the book and need to clear the widget
-            visiblePages[i]->placeImage(loadPagePendingTransition[i], playing ? MUSICALPI_BACKGROUND_COLOR_PLAYING : MUSICALPI_BACKGROUND_COLOR_NORMAL );  // special call which asks for empty page (but allows transitions)
+            visiblePages[i]->placeImage(loadPagePendingTransition[i], pageBackground);  // special call which asks for empty page (but allows transitions)
+        }
+        else if(loadPagePendingNumber[i] && PDF->usingThumbnails() && PDF->thumbImagesAvailable[loadPagePendingNumber[i]-1])  // Small grid cells only show thumbnails
+        {
+            visiblePages[i]->placeImage(loadPagePendingTransition[i], PDF->thumbImages[loadPagePendingNumber[i]-1], pageBackground, loadPagePendingNumber[i]);
+            loadPagePendingNumber[i]=0;
         }
-        else if(loadPagePendingNumber[i] && PDF->pageImagesAvailable[loadPagePendingNumber[i]-1])  // If it's needed and present
+        else if(loadPagePendingNumber[i] && !PDF->usingThumbnails() && PDF->pageImagesAvailable[loadPagePendingNumber[i]-1])  // If it's needed and present
         {
             // qDebug() << "Found we should display page " << loadPagePendingNumber[i] << " for position " << i;
 
-            visiblePages[i]->placeImage(loadPagePendingTransition[i], PDF->pageImages[loadPagePendingNumber[i]-1], playing ? MUSICALPI_BACKGROUND_COLOR_PLAYING : MUSICALPI_BACKGROUND_COLOR_NORMAL);
+            visiblePages[i]->placeImage(loadPagePendingTransition[i], PDF->pageImages[loadPagePendingNumber[i]-1], pageBackground, loadPagePendingNumber[i]);
             loadPagePendingNumber[i]=0;
         }
         else if(loadPagePendingNumber[i])
         {
-            qDebug() << "Found we need a page but it isn't available, skipped for now page " << loadPagePendingNumber[i] << " for position " << i;
+            if(debugPageTurns) qDebug() << "Found we need a page but it isn't available, skipped for now page " << loadPagePendingNumber[i] << " for position " << i;
             skipped++;
         }
         // else we just don't need it (yet)
@@ -380,12 +514,12 @@ void MainWindow::playingNextPage()
     //            immediately (if any), and delay the last page.  On the last page if it is the only
     //            page we do it half at a time.
 
-    qDebug()<< "started";
+    if(debugPageTurns) qDebug()<< "started";
     if(nowMode!=playMode || !playing) return;
     int nextPage = leftmostPage + pagesNowAcross * pagesNowDown;
     if(nextPage> PDF->numPages)
     {
-        qDebug() << "play forward no action - exiting as already at end";
+        if(debugPageTurns) qDebug() << "play forward no action - exiting as already at end";
         return;
     }
     leftmostPage = nextPage; // new leftmost
@@ -411,11 +545,11 @@ void MainWindow::playingPrevPage()
     //            pages displayed) will mean transitioning the last page (which they are reading) to get back.
     //            this would be fine if they are at the very end of the page, but "back" could be anywhere on the page.
     //            Going back on a single page display just stinks, as there's no real choice.
-    qDebug() << "started";
+    if(debugPageTurns) qDebug() << "started";
     if(nowMode!=playMode || !playing) return;
     if(leftmostPage == 1)
     {
-        qDebug() << "exiting as already at start";
+        if(debugPageTurns) qDebug() << "exiting as already at start";
         return;
     }
     leftmostPage--;
@@ -483,12 +617,8 @@ void MainWindow::HideEverything()
     cornerright.hide();
     DELETE_LOG(pl);  // if Playlists is there just get rid of it.
     DELETE_LOG(mp);  // same with midi player
-    for(int row=0; row < MUSICALPI_MAXROWS; row++)
-        for(int column=0; column < MUSICALPI_MAXCOLUMNS; column++)
-        {
-            visiblePages[row * MUSICALPI_MAXCOLUMNS + column]->hide();
-            visiblePages[row * MUSICALPI_MAXCOLUMNS + column]->clear();  // we need to re-do these
-        }
+    for(int i=0; i < visiblePages.size(); i++)
+        visiblePages[i]->hide();  // but keep what they hold, so coming back (e.g. review <-> play) need not recompose
     overlay->hide();
     libraryTable->hideKeyboard();
 }
@@ -496,44 +626,66 @@ void MainWindow::HideEverything()
 void MainWindow::deletePDF()
 {
     // THis is to keep the pointer NULL if not valid so we can reliably clean up
-    if(PDF) delete PDF;
+    for(int i=0; i < visiblePages.size(); i++)
+        visiblePages[i]->clearPage();  // They remember what they were composed from, which is about to go
+    if(PDF)
+    {
+        usagePtr->closed(PDF->filepath, openTimer.elapsed(), leftmostPage);
+        delete PDF;
+    }
     PDF=NULL;
 }
 
 void MainWindow::mouseReleaseEvent(QMouseEvent *event)
 {
     // This is only used at present if we are in play mode, and actually playing
-    qDebug() << "event " << ((event->button() == Qt::LeftButton) ? "left" : "other")
-             << ", location=(" << event->position().x() << "," << event->position().y() << ")";
+    // Page turns come through here so keep allocations out of it (settings are cached in setPlayMode)
+    if(debugPageTurns)
+        qDebug() << "event " << ((event->button() == Qt::LeftButton) ? "left" : "other")
+                 << ", location=(" << event->position().x() << "," << event->position().y() << ")";
     if(nowMode == playMode && playing)
     {
         if(overlay)
         {
-            qDebug() << "We still have an overlay - hide it";
+            if(debugPageTurns) qDebug() << "We still have an overlay - hide it";
             overlay->hide();
         }
-        if(event->position().y()< ourSettingsPtr->getSetting("overlayTopPortion").toInt() * this->height() / 100)  // How will I know where with it a class ???
+        if(event->position().y()< overlayTopPortion * this->height() / 100)  // How will I know where with it a class ???
         {
             qDebug() << "MainWindow::mouseReleaseEvent ending play mode";
             setPlayMode(false,pagesNowAcross,pagesNowDown);
         }
-        else if (event->position().x() < ourSettingsPtr->getSetting("overlaySidePortion").toInt() * this->width() / 100)
+        else if (event->position().x() < overlaySidePortion * this->width() / 100)
         {
-            qDebug() << "MainWindow::mouseReleaseEvent doing previous page";
+            if(debugPageTurns) qDebug() << "MainWindow::mouseReleaseEvent doing previous page";
             playingPrevPage();
         }
-        else if (event->position().x() > this->width() - ourSettingsPtr->getSetting("overlaySidePortion").toInt() * this->width() / 100)
+        else if (event->position().x() > this->width() - overlaySidePortion * this->width() / 100)
         {
-            qDebug() << "MainWindow::mouseReleaseEvent doing next page";
+            if(debugPageTurns) qDebug() << "MainWindow::mouseReleaseEvent doing next page";
             playingNextPage();
         }
         else
         {
-            qDebug() << "MainWindow::mouseReleaseEvent touch in not-effective space";
+            if(debugPageTurns) qDebug() << "MainWindow::mouseReleaseEvent touch in not-effective space";
         }
     }
 }
 
+bool MainWindow::eventFilter(QObject *object, QEvent *event)
+{
+    // Paint outerLayoutWidget's background in play mode colors ourselves; the application style sheet still does it otherwise
+#ifndef MUSICALPI_DEBUG_WIDGET_BORDERS
+    if(object == outerLayoutWidget && event->type() == QEvent::Paint && nowMode == playMode && playing)
+    {
+        QPainter p(outerLayoutWidget);
+        p.fillRect(static_cast<QPaintEvent*>(event)->rect(), pageBackground);
+        return true;
+    }
+#endif
+    return QMainWindow::eventFilter(object, event);
+}
+
 void MainWindow::resizeEvent(QResizeEvent*e)
 {
     // Note that this will RE-CALL play mode if it is already running but not others
@@ -587,8 +739,11 @@ void MainWindow::keyPressEvent(QKeyEvent* e)
     if(playing){
         switch (e->key())
         {
-            case Qt::Key_PageDown: qDebug() << "Received PageDown"; playingNextPage(); break;
-            case Qt::Key_PageUp:   qDebug() << "Received PageUp";   playingPrevPage(); break;
+            case Qt::Key_PageDown: if(debugPageTurns) qDebug() << "Received PageDown"; playingNextPage(); break;
+            case Qt::Key_PageUp:   if(debugPageTurns) qDebug() << "Received PageUp";   playingPrevPage(); break;
+#ifdef MUSICALPI_DEBUG_PAGE_TURN_CHECK
+            case Qt::Key_F12:      checkPageTurnPath(); break;
+#endif
         }
     } else {
         switch (e->key())
@@ -618,6 +773,64 @@ void MainWindow::doPlayLists()
     pl->move(QWidget::mapToGlobal(this->pos()));  // Put this somewhere interesting -- ??
 }
 
+#ifdef MUSICALPI_DEBUG_PAGE_TURN_CHECK
+void MainWindow::checkPageTurnPath()
+{
+    // Scripted page turns forward then back, in three passes:
+    //   0 - warm up (page frames get allocated at our size, render threads get started)
+    //   1 - counted, and our own code should make no heap allocations (Qt's update/timer calls are reported apart)
+    //   2 - timed, repainting after each turn so drawing to the screen is included
+    // Pages not yet rendered are simply skipped by the turn, as they would be normally.
+    // Then every cached page, every frame and the screen's backing store should all be in pageImageFormat,
+    // otherwise some stage is converting pixels on every turn.
+
+    int startingPage = leftmostPage;
+    int turns = MUSICALPI_DEBUG_PAGE_TURN_CHECK_TURNS;
+    long counted = 0;
+    for(int pass = 0; pass < 2; pass++)
+    {
+        allocationCounter counter;
+        for(int i = 0; i < turns; i++) playingNextPage();
+        for(int i = 0; i < turns; i++) playingPrevPage();
+        counted = counter.count();
+        qDebug() << "Pass " << pass << " made " << turns * 2 << " page turns with " << counted << " allocations in our code and "
+                 << counter.excluded() << " inside Qt's update/timer calls (not counted)";
+    }
+    QElapsedTimer elapsed;
+    elapsed.start();
+    for(int i = 0; i < turns; i++) { playingNextPage(); repaint(); }
+    for(int i = 0; i < turns; i++) { playingPrevPage(); repaint(); }
+    qDebug() << "Timed pass averaged " << elapsed.nsecsElapsed() / 1000 / (turns * 2) << " us per page turn including repaint";
+
+    int mismatches = 0;
+    PDF->lockOrUnlockMutex(true);
+    for(int i = 0; i < PDF->numPages; i++)
+        if(PDF->pageImagesAvailable[i] && PDF->pageImages[i]->format() != pageImageFormat)
+        {
+            qDebug() << "Page " << i + 1 << " is cached in format " << PDF->pageImages[i]->format();
+            mismatches++;
+        }
+    PDF->lockOrUnlockMutex(false);
+    for(int i = 0; i < pagesNowAcross * pagesNowDown; i++)
+    {
+        qDebug() << "visiblePages[" << i << "] frame format " << visiblePages[i]->frameFormat() << ", painted to " << visiblePages[i]->paintedToFormat;
+        if(visiblePages[i]->frameFormat() != pageImageFormat) mismatches++;
+        if(visiblePages[i]->paintedToFormat != QImage::Format_Invalid && visiblePages[i]->paintedToFormat != pageImageFormat) mismatches++;  // Invalid is a non-raster backend, nothing to compare
+    }
+    qDebug() << "Native format is " << pageImageFormat << ", stages not in it: " << mismatches;
+
+    leftmostPage = startingPage;  // put it back as it was (navigateTo is only for when not playing)
+    for(int i=0; i< pagesNowDown * pagesNowAcross; i++)
+    {
+        loadPagePendingNumber[i] = leftmostPage + i;
+        loadPagePendingTransition[i] = docPageLabel::noTransition;
+    }
+    checkQueueVsCache();
+    assert(counted == 0);
+    assert(mismatches == 0);
+}
+#endif
+
 //void MainWindow::doMidiPlayer()
 //{
 //    DELETE_LOG(mp); // Don't run same one, create a new one if it exists
@@ -5,6 +5,10 @@
 
 #include <QMainWindow>
 #include <QMouseEvent>
+#include <QColor>
+#include <QImage>
+#include <QVector>
+#include <QElapsedTimer>
 
 #include "docpagelabel.h"
 #include "piconstants.h"
@@ -24,6 +28,7 @@ class QHBoxLayout;
 class QVBoxLayout;
 class QPushButton;
 class playLists;
+class usageLog;
 
 class MainWindow : public QMainWindow
 {
@@ -37,14 +42,29 @@ public:
     int pagesNowDown;
     Keyboard kbd;
     ourSettings* ourSettingsPtr;
+    usageLog* usagePtr;            // Books played, most (and most lately) first
     int screenWidth, screenHeight; // size derived from real window, or possibly settings file.
+    bool debugPageTurns;           // Cached "debugPageTurnDetails" setting, checked on the page turn path
+    QImage::Format pageImageFormat; // Native format pages are rendered, composed and displayed in
+    QColor pageBackground;          // Background for pages in the current mode, parsed once rather than per page
+    bool isPlaying() { return nowMode == playMode && playing; }
+    PDFDocument* currentPDF() { return PDF; }
+    void prepareOpen(QString path, QString title, int startPage);  // Open a book and render its first spread ahead, as it's likely to be chosen
+    void cancelOpen();     // It won't be after all (e.g. the touch became a scroll)
+
+signals:
+    void openAheadBusy(bool busy);  // Books opened ahead are rendering (so background work should wait), or have stopped
 
 private:
     PDFDocument* PDF;
+    PDFDocument* preparedPDF;  // Opened by prepareOpen, and taken over by startPlayMode if it's the one chosen
+    int cancelledPDFs;         // Cancelled ones not yet gone (they finish the pages they were rendering first)
+    bool aheadBusy;            // As last signalled by openAheadBusy
     enum runningModes {libraryMode, playMode, aboutMode, settingsMode};
     runningModes nowMode;  // Note playMode is either playing=true or playing=false as submode
     bool playing;          // Submode for playMode, indicates if we are reviewing or playing
     int leftmostPage;      // Page number (reference 1) of leftmost page
+    QElapsedTimer openTimer;  // Since PDF was opened, for usagePtr
     int statePU;
     int stateL;
     int stateR;
@@ -79,6 +99,7 @@ private:
                 QPushButton* oneUpButton;
                 QPushButton* twoUpButton;
                 QPushButton* fourByTwoButton;
+                QPushButton* overviewButton;
                 QPushButton* playMidiButton;
                 QPushButton* playListButton;
         QWidget* generalLayoutWidget;   // This is the main body under the menu and holds everything except play mode items
@@ -87,7 +108,7 @@ private:
             musicLibrary* libraryTable;
             aboutWidget* aboutBox;
             settingsWidget* settingsUI;
-       docPageLabel* visiblePages[MUSICALPI_MAXROWS * MUSICALPI_MAXCOLUMNS];  // used for play mode panes; layout is ignored for these and explicitly positioned
+       QVector<docPageLabel*> visiblePages;  // used for play mode panes, created as needed; layout is ignored for these and explicitly positioned
        TipOverlay* overlay;                                                   // fits (briefly) over the whole window when play-playing mode starts.
        ButtonMgr cornerleft;
        ButtonMgr cornerright;
@@ -95,32 +116,42 @@ private:
     midiPlayerV2* mp; // This widget is a free floating window
     playLists* pl;
 
-    int loadPagePendingNumber[MUSICALPI_MAXCOLUMNS * MUSICALPI_MAXROWS]; // 0 indicates none pending
-    docPageLabel::docTransition loadPagePendingTransition[MUSICALPI_MAXCOLUMNS * MUSICALPI_MAXROWS];
+    QVector<int> loadPagePendingNumber; // 0 indicates none pending; one per pane in visiblePages
+    QVector<docPageLabel::docTransition> loadPagePendingTransition;
 
     int pageBorderWidth;
+    int overlayTopPortion;     // Settings cached when play mode is set up so a page turn need not look them up
+    int overlaySidePortion;
 
     void setLibraryMode();
     void setPlayMode(bool playing, int pagesToShowAcross, int pagesToShowDown);
+    void pageCellSize(int pagesToShowAcross, int pagesToShowDown, bool forPlaying, int& maxPageWidth, int& maxPageHeight, int& roomForMenu);
     void navigateTo(int leftPage);
     void setAboutMode();
     void setSettingsMode();
     void setupCoreWidgets();
+    void ensurePanes(int count);
+    void paneClicked(int index);
     void HideEverything();
     void playingNextPage();
     void playingPrevPage();
     void deletePDF();
     void checkQueueVsCache();
     void mouseReleaseEvent(QMouseEvent *event);
+    bool eventFilter(QObject *object, QEvent *event);
     void resizeEvent(QResizeEvent *event);
     void sizeLogo();
     void keyPressEvent(QKeyEvent* e);
     void doMidiPlayer();
     void doPlayLists();
+#ifdef MUSICALPI_DEBUG_PAGE_TURN_CHECK
+    void checkPageTurnPath();
+#endif
     bool kbdShowing;
 
 private slots:
-    void startPlayMode(QString,QString);
+    void checkOpenAhead();
+    void startPlayMode(QString,QString,int);
 
 };
 
@@ -1,12 +1,8 @@
 // Copyright 2023 by Linwood Ferguson, licensed under GNU GPLv3
 
 #include <QPainter>
-#include <QSqlRecord>
-#include <QSqlField>
-#include <QSqlError>
-#include <QSqlDatabase>
-#include <QSqlQuery>
 #include <QCheckBox>
+#include <QScrollArea>
 
 #include <QHeaderView>
 #include <QScroller>
@@ -14,19 +10,36 @@
 #include <QtDBus/QDBusMessage>
 #include <QEvent>
 #include <QKeyEvent>
-#include <QTableWidgetItem>
+#include <QTableView>
+#include <QFontMetrics>
 #include <QLineEdit>
 #include <QHBoxLayout>
 #include <QVBoxLayout>
 #include <QComboBox>
 #include <QListView>
+#include <QScrollBar>
+#include <QTimer>
+#include <QPushButton>
+#include <QElapsedTimer>
+#include <QCursor>
+#include <QItemSelectionModel>
 
 #include "musiclibrary.h"
 #include "mainwindow.h"
 #include "oursettings.h"
 #include "piconstants.h"
+#include "librarythread.h"
+#include "librarysql.h"
+#include "librarymodel.h"
+#include "librarysnapshot.h"
+#include "librarywatcher.h"
+#include "thumbnailthread.h"
+#include "textindex.h"
+#include "usagelog.h"
+#include "playlistorder.h"
 
 #include <cassert>
+#include <algorithm>
 
 
 musicLibrary::musicLibrary(QWidget *parent, MainWindow* mp) : QWidget(parent)
@@ -49,8 +62,6 @@ musicLibrary::musicLibrary(QWidget *parent, MainWindow* mp) : QWidget(parent)
 
     ActiveListIndex = 0;  // Default for start -- choices are persisted against subsequent hide/show iterations.
 
-    m_db = NULL;  // Be sure we know if it's been created.  We open/close it a lot, but do not delete it until this routine is deleted
-
     qDebug() << "in constructor with path " << calibrePath << " and file " << calibreDatabase;
 
     // Create widgets and layouts
@@ -63,55 +74,64 @@ musicLibrary::musicLibrary(QWidget *parent, MainWindow* mp) : QWidget(parent)
     dropdown= new QComboBox(search);
     listDropdown = new QListView(dropdown);
     dropdown->setView(listDropdown);
-    libTable = new QTableWidget(this);
+    collectionBox = new QComboBox(search);
+    authorBox = new QComboBox(search);
+    quickWidget = new QWidget(this);
+    quickLayout = new QHBoxLayout(quickWidget);
+    quickLabel = new QLabel(quickWidget);
+    libTable = new QTableView(this);
+    libModel = new libraryModel(this);
+    libTable->setModel(libModel);
     checkboxLabel = new QLabel(this);
-    checkboxAll = new QCheckBox(this);
     checkboxNone = new QCheckBox(this);
-    checkbox1 = new QCheckBox(this);
-    checkbox2 = new QCheckBox(this);
-    checkbox3 = new QCheckBox(this);
-    checkbox4 = new QCheckBox(this);
-    checkbox5 = new QCheckBox(this);
-    checkbox6 = new QCheckBox(this);
+    checkboxMatchAll = new QCheckBox(this);
+    tagArea = new QScrollArea(this);
+    tagWidget = new QWidget(tagArea);
+    tagLayout = new QHBoxLayout(tagWidget);
 
     // Arrange the widgets
 
     this->setLayout(baseLayout);
     baseLayout->addWidget(search);
+    baseLayout->addWidget(quickWidget);
     baseLayout->addWidget(libTable);
+    quickWidget->setLayout(quickLayout);
+    quickLayout->setContentsMargins(0,0,0,0);
+    quickLayout->setAlignment(Qt::AlignLeft);
+    quickLayout->addWidget(quickLabel);
+    quickLabel->setFont(QFont("Arial",12,1));
+    quickLabel->setText("Played most:");
+    quickWidget->hide();  // Until something has been
     search->setLayout(searchLayout);
     searchLayout->addWidget(prompt);
     searchLayout->addWidget(searchBox);
     searchLayout->addWidget(dropdown);
+    searchLayout->addWidget(collectionBox);
+    searchLayout->addWidget(authorBox);
     searchLayout->addWidget(checkboxLabel);
-    searchLayout->addWidget(checkboxAll);
     searchLayout->addWidget(checkboxNone);
-    searchLayout->addWidget(checkbox1);
-    searchLayout->addWidget(checkbox2);
-    searchLayout->addWidget(checkbox3);
-    searchLayout->addWidget(checkbox4);
-    searchLayout->addWidget(checkbox5);
-    searchLayout->addWidget(checkbox6);
+    searchLayout->addWidget(checkboxMatchAll);
+    searchLayout->addWidget(tagArea, 1);  // Tags take what room is left, and scroll if there are more
     checkboxLabel->setFont(QFont("Arial",12,1));
     checkboxLabel->setText("  Additional Filter(s):  ");
-    checkboxAll->setText("All");
     checkboxNone->setText("None");
-    checkbox1->setText("CheckBox1");
-    checkbox2->setText("CheckBox2");
-    checkbox3->setText("CheckBox3");
-    checkbox4->setText("CheckBox4");
-    checkbox5->setText("CheckBox5");
-    checkbox6->setText("CheckBox6");
-
-    checkbox1->setVisible(false);
-    checkbox2->setVisible(false);
-    checkbox3->setVisible(false);
-    checkbox4->setVisible(false);
-    checkbox5->setVisible(false);
-    checkbox6->setVisible(false);
-
-    checkboxAll->setVisible(false);
-
+    checkboxMatchAll->setText("Match all");
+    checkboxMatchAll->setChecked(true);  // As the filters always were; unchecked shows books with any of the tags checked
+    collectionBox->setMaximumWidth(250);  // Names can be long, and the tags need the room more
+    authorBox->setMaximumWidth(250);
+    collectionBox->setView(new QListView(collectionBox));  // (styled as the list dropdown is)
+    authorBox->setView(new QListView(authorBox));
+    collectionBox->addItem("All collections", QString());
+    authorBox->addItem("All authors", QString());
+    tagWidget->setLayout(tagLayout);
+    tagLayout->setContentsMargins(0,0,0,0);
+    tagLayout->setSizeConstraint(QLayout::SetMinimumSize);
+    tagArea->setWidget(tagWidget);
+    tagArea->setWidgetResizable(true);
+    tagArea->setFrameShape(QFrame::NoFrame);
+    tagArea->setHorizontalScrollBarPolicy(Qt::ScrollBarAlwaysOff);
+    tagArea->setVerticalScrollBarPolicy(Qt::ScrollBarAlwaysOff);
+    QScroller::grabGesture(tagArea->viewport(),QScroller::LeftMouseButtonGesture);  // Drag sideways to see more tags
 
 
     prompt->setFont(QFont("Arial",16,1));
@@ -126,7 +146,13 @@ musicLibrary::musicLibrary(QWidget *parent, MainWindow* mp) : QWidget(parent)
     libTable->setSelectionBehavior(QAbstractItemView::SelectRows);
     libTable->setSelectionMode(QAbstractItemView::SingleSelection);
     libTable->verticalHeader()->hide();
+    libTable->verticalHeader()->setSectionResizeMode(QHeaderView::Fixed);  // All rows the same height, so the view never measures them
+    int thumbnailHeight = mParent->ourSettingsPtr->getSetting("libraryThumbnailHeight").toInt();
+    libTable->verticalHeader()->setDefaultSectionSize(std::max(QFontMetrics(QFont("Arial",14,1,false)).height(), thumbnailHeight) + 8);  // Title font (or thumbnail) is the tallest
+    libTable->setIconSize(QSize(thumbnailHeight, thumbnailHeight));
+    libTable->setWordWrap(false);
     libTable->setAlternatingRowColors(true);
+    libTable->horizontalHeader()->setSortIndicator(-1, Qt::AscendingOrder);  // In the order read (or the list's order) until a heading is touched
     libTable->setSortingEnabled(true);
     libTable->setEditTriggers(QAbstractItemView::NoEditTriggers);  // this makes the table read-only so you don't accidentally end up editing inside a cell.
 
@@ -135,219 +161,446 @@ musicLibrary::musicLibrary(QWidget *parent, MainWindow* mp) : QWidget(parent)
     libTable->setVerticalScrollMode(QAbstractItemView::ScrollPerPixel);
     libTable->setHorizontalScrollBarPolicy(Qt::ScrollBarAlwaysOff);
 
-    connect(libTable, SIGNAL(cellClicked(int,int)), this, SLOT(onChosen(int,int)));
+    connect(libTable, SIGNAL(clicked(QModelIndex)), this, SLOT(onClicked(QModelIndex)));
+    // The book touched is opened (and its first pages rendered) while the finger is still down, unless it turns into a scroll
+    connect(libTable, &QAbstractItemView::pressed, this, &musicLibrary::onTouched);
+    // (a selection, e.g. by arrow keys, only once it has stayed on the row a moment)
+    connect(libTable->selectionModel(), &QItemSelectionModel::currentRowChanged, this, &musicLibrary::rowSelected);
+    connect(QScroller::scroller(libTable), &QScroller::stateChanged, this, &musicLibrary::scrollerStateChanged);
+    openAheadTimer = new QTimer(this);
+    openAheadTimer->setSingleShot(true);
+    openAheadTimer->setInterval(MUSICALPI_OPEN_AHEAD_DELAY_MS);
+    connect(openAheadTimer, &QTimer::timeout, this, [this]{ onTouched(openAheadIndex); });
+    openingAhead = false;
+    connect(mParent, &MainWindow::openAheadBusy, this, &musicLibrary::openAheadBusy);
     connect(searchBox, SIGNAL(textChanged(QString)), this, SLOT(filterTable(QString)));
-    connect(checkboxAll, SIGNAL(stateChanged(int)), this, SLOT(procCboxAll(int)));
     connect(checkboxNone, SIGNAL(stateChanged(int)), this, SLOT(procCboxNone(int)));
-    connect(checkbox1, SIGNAL(stateChanged(int)), this, SLOT(procCbox1(int)));
-    connect(checkbox2, SIGNAL(stateChanged(int)), this, SLOT(procCbox2(int)));
-    connect(checkbox3, SIGNAL(stateChanged(int)), this, SLOT(procCbox3(int)));
-    connect(checkbox4, SIGNAL(stateChanged(int)), this, SLOT(procCbox4(int)));
-    connect(checkbox5, SIGNAL(stateChanged(int)), this, SLOT(procCbox5(int)));
-    connect(checkbox6, SIGNAL(stateChanged(int)), this, SLOT(procCbox6(int)));
-
-    m_db = new QSqlDatabase(QSqlDatabase::addDatabase("QSQLITE"));
-    m_db->setDatabaseName(calibrePath + "/" + calibreDatabase);
-    m_db->open();
-    QSqlQuery queryLists;
-    QString sql = "SELECT t.name as tag_name, count(1) as count FROM tags t, books_tags_link btl where t.id=btl.tag and t.name<>'"
-            + calibreMusicTag + "' and t.name not like '" + calibreListPrefix + "%' group by t.name order by count(1) desc;";
-    queryLists.exec(sql);
-    checkSqlError("Executed tag query " + sql, queryLists.lastError());
-    int iQcount = 0;
-    while(queryLists.next())
-    {
-        iQcount++;
-        qDebug()<<"read tags, value=" << queryLists.record().field(0).value().toString();
-        if(iQcount==1) {
-            checkbox1->setText(queryLists.record().field(0).value().toString());
-            checkbox1->setVisible(true);
-        } else if(iQcount==2) {
-            checkbox2->setText(queryLists.record().field(0).value().toString());
-            checkbox2->setVisible(true);
-        } else if(iQcount==3) {
-            checkbox3->setText(queryLists.record().field(0).value().toString());
-            checkbox3->setVisible(true);
-        } else if(iQcount==4) {
-            checkbox4->setText(queryLists.record().field(0).value().toString());
-            checkbox4->setVisible(true);
-        } else if(iQcount==5) {
-            checkbox5->setText(queryLists.record().field(0).value().toString());
-            checkbox5->setVisible(true);
-        } else if(iQcount==6) {
-            checkbox6->setText(queryLists.record().field(0).value().toString());
-            checkbox6->setVisible(true);
-        }
-    }
-    m_db->close();
+    connect(checkboxMatchAll, SIGNAL(stateChanged(int)), this, SLOT(tagsChanged()));
+    connect(collectionBox, SIGNAL(currentIndexChanged(int)), this, SLOT(facetChosen()));
+    connect(authorBox, SIGNAL(currentIndexChanged(int)), this, SLOT(facetChosen()));
+
+    loader = new libraryThread(this, calibrePath + "/" + calibreDatabase, mParent->ourSettingsPtr->getSetting("calibreImmutable").toBool(),
+                               mParent->ourSettingsPtr->getSetting("calibreMmapMB").toInt(), mParent->ourSettingsPtr->getSetting("calibreCacheMB").toInt());
+    playListsSerial = booksSerial = bookChangesSerial = transactionSerial = 0;
+    booksRefreshing = false;
+    snapshot = NULL;
+    columnForID = columnForModified = -1;
+    booksLoading = false;
+    libraryChanged = false;
+    screenLoaded = false;
+    watcher = new libraryWatcher(this, calibrePath + "/" + calibreDatabase);
+    connect(watcher, &libraryWatcher::changed, this, &musicLibrary::databaseChanged);
+    connect(loader, &libraryThread::queryStarted, this, &musicLibrary::libraryQueryStarted);
+    connect(loader, &libraryThread::rowsRead, this, &musicLibrary::libraryRowsRead);
+    connect(loader, &libraryThread::queryFinished, this, &musicLibrary::libraryQueryFinished);
+    connect(loader, &libraryThread::transactionDone, this, &musicLibrary::libraryTransactionDone);
+
+    thumbnails = new thumbnailThread(this, thumbnailHeight);  // (with height 0 it only fills in bookInfo)
+    thumbnailTimer = new QTimer(this);
+    thumbnailTimer->setSingleShot(true);
+    thumbnailTimer->setInterval(100);
+    connect(thumbnails, &thumbnailThread::thumbnailReady, this, &musicLibrary::thumbnailReady);
+    connect(thumbnails, &thumbnailThread::songsFound, this, &musicLibrary::songsFound);
+    connect(thumbnailTimer, &QTimer::timeout, this, &musicLibrary::requestThumbnails);
+    connect(libTable->verticalScrollBar(), &QScrollBar::valueChanged, thumbnailTimer, QOverload<>::of(&QTimer::start));
+    connect(libTable->verticalScrollBar(), &QScrollBar::rangeChanged, thumbnailTimer, QOverload<>::of(&QTimer::start));  // (rows loaded)
+    connect(libModel, &QAbstractItemModel::modelReset, thumbnailTimer, QOverload<>::of(&QTimer::start));
+    connect(libModel, &QAbstractItemModel::layoutChanged, thumbnailTimer, QOverload<>::of(&QTimer::start));
+
+    pageText = new textIndex("musicLibraryText");
+    listOrder = new playListOrder("musicLibraryLists");
+    pageTextTimer = new QTimer(this);
+    pageTextTimer->setSingleShot(true);
+    pageTextTimer->setInterval(MUSICALPI_TEXT_SEARCH_DELAY_MS);
+    connect(pageTextTimer, &QTimer::timeout, this, &musicLibrary::searchPageText);
+
     checkboxNone->setChecked(true);
-//    screenLoaded=false;
 //    lastTimeSelected = QTime::currentTime();
 }
 
 musicLibrary::~musicLibrary()
 {
     qDebug() << "in destructor";
-    DELETE_LOG(m_db);
+    DELETE_LOG(thumbnails);
+    DELETE_LOG(pageText);
+    DELETE_LOG(listOrder);
+    DELETE_LOG(loader);
+    DELETE_LOG(snapshot);
 }
 
 void musicLibrary::loadPlayLists()
 {
     // Get a list of playlists and set it to active if we already had chosen it
-    // Must have database open to call
     // These need to stay loaded as they are used in a separate widget (and indeed may be forced into a reload by it)
+    // The query runs on the loader thread, and fillPlayLists loads the dropdown when it comes back.
 
     qDebug() << "Entered";
-    dropdown->clear();
-    QSqlQuery queryLists;
 //    QString sql = "select id, name from tags where name like '" + calibreListPrefix + "%' order by name;";
-    QString sql = "select t.id, case instr(t.name,'|') when 0 then t.name else substr(t.name, 1, instr(t.name,'|')-1) end as tagname from tags t"
-            ", books_tags_link btl where t.id=btl.tag and t.name like '" + calibreListPrefix + "%' order by t.name;";
-    queryLists.exec(sql);
-    checkSqlError("Executed tag query " + sql, queryLists.lastError());
+    // There is a row per book in each list, so this also gives us which books are in which lists, and where (see librarySql)
+    playListRows.clear();
+    loader->query(libraryThread::playListsQuery, ++playListsSerial, librarySql::playLists(), {calibreListPrefix, librarySql::prefixEnd(calibreListPrefix)});
+}
+
+void musicLibrary::fillPlayLists(const QList<QStringList>& rows)
+{
+    qDebug() << "Entered with " << rows.size() << " rows";
+    dropdown->blockSignals(true);  // Loading it isn't the user changing lists
+    dropdown->clear();
     dropdown->addItem("All items",0);
+    listsOfBook.clear();
+    QHash<QString, QList<playListOrder::entry>> listEntries;
     QString lastPlaylist="none";
-    while(queryLists.next())
+    for(const QStringList& row : rows)
     {
-        QString playlist = queryLists.record().field(1).value().toString().replace(calibreListPrefix,"");
-        qDebug()<<"read tags, id=" << queryLists.record().field(0).value().toInt() << ", value=" << queryLists.record().field(1).value().toString();
-        if(playlist!=lastPlaylist) {
-            dropdown->addItem(playlist.replace(calibreListPrefix,""),queryLists.record().field(0).value().toInt());
-        } else {
-            int tmpIndex = dropdown->findText(playlist);
-            dropdown->removeItem(tmpIndex);
-            dropdown->addItem(playlist.replace(calibreListPrefix,""),queryLists.record().field(0).value().toInt());
-        }
+        QString playlist = QString(row[1]).replace(calibreListPrefix,"");
+        listsOfBook[row[2].toInt()].insert(playlist);
+        listEntries[playlist].append({row[3].toInt(), row[2].toInt()});
+        // Rows are in tag name order, so a list's rows are together; it's kept with its last tag
+        if(playlist!=lastPlaylist) dropdown->addItem(playlist,row[0].toInt());
+        else dropdown->setItemData(dropdown->count() - 1,row[0].toInt());
         lastPlaylist = playlist;
     }
+    // Our order store follows Calibre, except for lists with changes not written yet (or not when this was read)
+    QSet<QString> editing;
+    for(const playListEdit& edit : pendingEdits) editing.insert(edit.list);
+    QStringList lists;
+    for(int i = 1; i < dropdown->count(); i++) lists.append(dropdown->itemText(i));
+    for(const QString& list : lists)
+        if(!editing.contains(list) && listOrder->sync(list, listEntries.value(list)) && list == ActiveList && ActiveListIndex != 0)
+            libModel->setListOrder(columnForID, listOrder->positions(list));
+    for(const playListEdit& edit : pendingEdits) applyEdit(edit, false);
+    for(const QString& list : editing) lists.append(list);
+    listOrder->keepOnly(lists);
     ActiveListIndex = dropdown->findText(ActiveList);  // We have to look it up in case they list changed so index may change
     if(ActiveListIndex == -1) ActiveListIndex = 0;  // If the current active disappeareed reset to all
     dropdown->setCurrentIndex(ActiveListIndex);
+    dropdown->blockSignals(false);
 }
 
 void musicLibrary::loadBooks()
 {
-    // Must have database open to call
+    // Builds the query here (it depends on the list and filters chosen) but it runs on the loader thread,
+    // and the table is filled in as the rows come back (libraryQueryStarted, libraryRowsRead, libraryQueryFinished)
+    // If we have a snapshot of this query's result it is shown at once instead, and only the changes since are read.
     qDebug() << "Entered";
     lastRowSelected=-1; // None selected (yet)
-    libTable->setRowCount(0);
+    libTable->setSortingEnabled(false);  // Otherwise it re-sorts with every item added; turned back on when all are in
+    libModel->reset(QStringList());
     searchBox->setText("");  // Start fresh search each time
-    QSqlQuery queryBooks;
-    QString sql =
-        "select b.id as BookID, b.sort as Title, coalesce(max(s.name),'') as Collection, b.author_sort as Author, b.path || '/' ||  d.name || '.' || lower(d.format) as Path, group_concat(t2.name,',') as tags "
-        "from books b "
-        "inner join books_tags_link btl on btl.book = b.id "
-        "inner join tags t on t.id = btl.tag "
-        "inner join data d on d.book = b.id and d.format = 'PDF' " +
-        (
-           ActiveListIndex == 0 ? "" :
-              ( "inner join books_tags_link btl3 on btl3.book = b.id "
-                "inner join tags t3 on t3.id = btl3.tag and t3.name like '" + calibreListPrefix + ActiveList + "%' "
-              )
-        ) +
-        "left join books_series_link bsl on bsl.book = b.id "
-        "left join series s on s.id=bsl.series "
-        "left join books_tags_link btl2 on btl2.book=b.id "
-        "left join tags t2 on t2.id=btl2.tag and t2.name not like 'musicList%' and t2.name <> 'music' " +
-            (
-               !checkbox1->isChecked() ? "" :
-                  ( "inner join books_tags_link btl3 on btl3.book = b.id "
-                    "inner join tags t3 on t3.id = btl3.tag and t3.name = '" + checkbox1->text() + "' "
-                  )
-            ) +
-           (
-              !checkbox2->isChecked() ? "" :
-                 ( "inner join books_tags_link btl4 on btl4.book = b.id "
-                   "inner join tags t4 on t4.id = btl4.tag and t4.name = '" + checkbox2->text() + "' "
-                 )
-           ) +
-           (
-              !checkbox3->isChecked() ? "" :
-                 ( "inner join books_tags_link btl5 on btl5.book = b.id "
-                   "inner join tags t5 on t5.id = btl5.tag and t5.name = '" + checkbox3->text() + "' "
-                 )
-           ) +
-           (
-              !checkbox4->isChecked() ? "" :
-                 ( "inner join books_tags_link btl6 on btl6.book = b.id "
-                   "inner join tags t6 on t6.id = btl6.tag and t6.name = '" + checkbox4->text() + "' "
-                 )
-           ) +
-            (
-               !checkbox5->isChecked() ? "" :
-                  ( "inner join books_tags_link btl7 on btl7.book = b.id "
-                    "inner join tags t7 on t7.id = btl7.tag and t7.name = '" + checkbox5->text() + "' "
-                  )
-            ) +
-            (
-               !checkbox6->isChecked() ? "" :
-                  ( "inner join books_tags_link btl8 on btl8.book = b.id "
-                    "inner join tags t8 on t8.id = btl8.tag and t8.name = '" + checkbox6->text() + "' "
-                  )
-            ) +
-        "where t.name = '" + calibreMusicTag + "' "
-        "group  by b.id, b.sort, b.author_sort, b.path, d.name "
-//        "order by b.sort;";
-        "order by " +
-        (
-            ActiveListIndex == 0 ? "b.sort;" :"substr(tags,instr(tags,'" + calibreListPrefix + ActiveList + "'));"
-        );
-    queryBooks.exec(sql);
-    checkSqlError("Executed book query " + sql, queryBooks.lastError());
-    QSqlRecord rec = queryBooks.record();
+    QString sql, sqlEnd;
+    QVariantList values;
+    QString key = booksQuery(ActiveListIndex == 0 ? QString() : ActiveList, sql, sqlEnd, values);
+    booksSql = sql;
+    booksSqlEnd = sqlEnd;
+    booksValues = values;
+    delete snapshot;
+    snapshot = new librarySnapshot(key);
+    QStringList fields;
+    QList<QStringList> rows;
+    QString stamp;
+    if(!snapshot->load(fields, rows, stamp))
+    {
+        booksRefreshing = false;
+        booksLoading = true;
+        loader->query(libraryThread::booksQuery, ++booksSerial, sql + sqlEnd, values);
+        return;
+    }
+    setupColumns(fields);  // Show the snapshot, then bring it up to date
+    appendBooks(rows);
+    booksLoaded();
+    refreshBooks(stamp);
+}
+
+QString musicLibrary::booksQuery(const QString& list, QString& sql, QString& sqlEnd, QVariantList& values)
+{
+    // Names (of lists and tags) are bound as values, in the order their ?'s appear, so the SQL text only varies by
+    // whether a list is chosen and each variation is prepared just once.  Tag filters are applied to what's read (see
+    // tagFacets), not in the query.
+    // A list's books are those with one of its tags, found by a range of names (so by the index on them); they're put
+    // in the list's order by booksLoaded, from listOrder.
+    values.clear();
+    if(!list.isEmpty()) values << calibreListPrefix + list + "|" << librarySql::prefixEnd(calibreListPrefix + list + "|");
+    values.append(calibreMusicTag);
+    sql = librarySql::books(!list.isEmpty());
+    sqlEnd = librarySql::booksEnd();
+    QString key = calibrePath + "/" + calibreDatabase + "\n" + sql + sqlEnd;
+    for(const QVariant& value : values) key += "\n" + value.toString();
+    return key;
+}
+
+void musicLibrary::refreshBooks(QString stamp)
+{
+    // Read which books there are and which changed since stamp (to take out), and the changed ones that still belong
+    // in this list (to put back in), using the query loadBooks last built
+    qDebug() << "Refreshing books changed since " << stamp;
+    booksRefreshing = true;
+    bookIDs.clear();
+    changedBookIDs.clear();
+    changedBookRows.clear();
+    bookChangesDone = changedBooksDone = false;
+    loader->query(libraryThread::bookChangesQuery, ++bookChangesSerial, librarySql::bookChanges(), {stamp});
+    loader->query(libraryThread::booksQuery, ++booksSerial, booksSql + "and b.last_modified > ? " + booksSqlEnd, booksValues + QVariantList({stamp}));
+}
+
+// Slot
+void musicLibrary::databaseChanged()
+{
+    // Bring the library up to date now if it's showing, otherwise when it next is
+    loader->databaseChanged();
+    if(!isVisible() || booksLoading)
+    {
+        libraryChanged = true;
+        return;
+    }
+    loadPlayLists();
+    refreshBooks(libModel->latest(columnForModified));
+}
+
+void musicLibrary::booksLoaded()
+{
+    libModel->loadFinished();
+    sizeColumns();
+    libModel->setListOrder(columnForID, ActiveListIndex == 0 ? QHash<QString,int>() : listOrder->positions(ActiveList));
+    if(ActiveListIndex != 0) libTable->horizontalHeader()->setSortIndicator(-1, Qt::AscendingOrder);  // A list shows in its own order
+    libTable->setSortingEnabled(true);
+    loadTagBoxes();
+    indexSongs(true);
+}
+
+void musicLibrary::indexSongs(bool all)
+{
+    // Songs are found in the background, from what's stored for each book if it's been seen before (see bookInfo)
+    if(all)
+    {
+        songsIndexed.clear();
+        songsAdded.clear();
+    }
+    rowOfBook.clear();
+    rowOfPath.clear();
+    QList<thumbnailThread::thumbnailRequest> books;
+    for(int row = 0; row < libModel->loadedRows(); row++)
+        if(libModel->rowLive(row))
+        {
+            QString id = libModel->loadedText(row, columnForID);
+            rowOfBook.insert(id, row);
+            rowOfPath.insert(calibrePath + "/" + libModel->loadedText(row, columnForPath), row);
+            if(songsIndexed.contains(id)) continue;
+            songsIndexed.insert(id);
+            books.append({id, calibrePath + "/" + libModel->loadedText(row, columnForPath), !all});  // (if not all, these have changed)
+        }
+    thumbnails->index(books, all);
+}
+
+// Slot
+void musicLibrary::songsFound(QString key, QList<QStringList> songs)
+{
+    // Each song is its book's row with the song's title, and the book's title (and page) as its collection
+    int row = rowOfBook.value(key, -1);
+    if(row < 0 || songsAdded.contains(key) || !libModel->rowLive(row)) return;
+    songsAdded.insert(key);
+    QStringList book;
+    for(int field = 0; field < libModel->columnCount(); field++) book.append(libModel->loadedText(row, field));
+    int columnForCollection = libModel->fieldColumn("Collection");
+    QList<QStringList> rows;
+    QVector<int> pages;
+    for(const QStringList& song : songs)
+    {
+        QStringList values = book;
+        values[columnForTitle] = song[0];
+        if(columnForCollection >= 0) values[columnForCollection] = book[columnForTitle] + ", page " + song[1];
+        rows.append(values);
+        pages.append(song[1].toInt());
+    }
+    libModel->addSongs(rows, pages);
+}
+
+void musicLibrary::applyBookChanges()
+{
+    if(!bookChangesDone || !changedBooksDone) return;  // Wait for both
+    if(libModel->applyDelta(columnForID, bookIDs, changedBookIDs, changedBookRows))
+    {
+        snapshot->save(libModel, columnForModified);
+        loadTagBoxes();
+        songsIndexed.subtract(changedBookIDs);  // Their songs came out with them
+        songsAdded.subtract(changedBookIDs);
+        indexSongs(false);
+    }
+    bookIDs.clear();
+    changedBookIDs.clear();
+    changedBookRows.clear();
+}
+
+// Slot
+void musicLibrary::libraryQueryStarted(int kind, int serial, QStringList fieldNames)
+{
+    if(kind != libraryThread::booksQuery || serial != booksSerial || booksRefreshing) return;  // Only books need setting up (and only if still wanted and not already shown)
+    setupColumns(fieldNames);
+}
+
+void musicLibrary::setupColumns(const QStringList& fieldNames)
+{
     libTable->setFont(QFont("Arial",10,0,false));
-    libTable->setColumnCount(rec.count());
+    libModel->reset(fieldNames);
+    libModel->setTagFilter(checkedTags(), checkboxMatchAll->isChecked());  // Applied as the rows go in
     // First run through the columns and code appropriately in the table, hiding some fields, remembering position
-    for(int field = 0; field < rec.count(); field++)
+    for(int field = 0; field < fieldNames.size(); field++)
     {
-        libTable->setHorizontalHeaderItem(field, new QTableWidgetItem(rec.fieldName(field)));
-        if(rec.fieldName(field)=="BookID")
+        libTable->setColumnHidden(field,false);  // might be left from a previous load
+        if(fieldNames[field]=="BookID")
         {
             libTable->setColumnHidden(field,true);
+            libModel->setSearchable(field,false);
             columnForID=field;
         }
-        if(rec.fieldName(field)=="Path")  // Remember where we put this
+        if(fieldNames[field]=="Modified")  // Only used to bring snapshots up to date
+        {
+            libTable->setColumnHidden(field,true);
+            libModel->setSearchable(field,false);
+            columnForModified=field;
+        }
+        if(fieldNames[field]=="Path")  // Remember where we put this
         {
             libTable->setColumnHidden(field,true);
+            libModel->setSearchable(field,false);
             columnForPath=field;
+            libModel->setThumbnailKey(field);
         }
-        if(rec.fieldName(field)=="Title")
+        if(fieldNames[field]=="Title")
         {
             columnForTitle=field;  // And remember this one
+            libModel->setTitleFont(field, QFont("Arial",14,1,false)); // Do something to make this proportional to some constant???
         }
     }
-    int row=0;
-    while(queryBooks.next())
+}
+
+// Slot
+void musicLibrary::libraryRowsRead(int kind, int serial, QList<QStringList> rows)
+{
+    if(kind == libraryThread::booksQuery && serial == booksSerial)
     {
-        libTable->setRowCount(row+1);
-        for(int field=0; field < rec.count(); field++)
+        if(booksRefreshing) changedBookRows.append(rows);
+        else appendBooks(rows);
+    }
+    else if(kind == libraryThread::bookChangesQuery && serial == bookChangesSerial)
+    {
+        for(const QStringList& row : rows)
         {
-            libTable->setItem(row,field,new QTableWidgetItem(queryBooks.record().field(field).value().toString()));
-            if(rec.fieldName(field)=="Title") libTable->item(row,field)->setFont(QFont("Arial",14,1,false)); // Do something to make this proportional to some constant???
+            bookIDs.insert(row[0]);
+            if(row[1].toInt()) changedBookIDs.insert(row[0]);
         }
-        row++;
     }
-    libTable->resizeColumnsToContents();
-    qDebug() << "Completed by book retrieval and build of table";
+    else if(kind == libraryThread::playListsQuery && serial == playListsSerial) playListRows.append(rows);
+}
+
+// Slot
+void musicLibrary::libraryQueryFinished(int kind, int serial, int rowCount)
+{
+    if(kind == libraryThread::playListsQuery && serial == playListsSerial)
+    {
+        fillPlayLists(playListRows);
+        playListRows.clear();
+    }
+    if(kind == libraryThread::bookChangesQuery && serial == bookChangesSerial)
+    {
+        bookChangesDone = true;
+        applyBookChanges();
+    }
+    if(kind != libraryThread::booksQuery || serial != booksSerial) return;
+    if(booksRefreshing)
+    {
+        changedBooksDone = true;
+        applyBookChanges();
+        qDebug() << "Completed refresh of library snapshot, " << rowCount << " changed rows";
+        return;
+    }
+    booksLoading = false;
+    booksLoaded();
+    snapshot->save(libModel, columnForModified);
+    qDebug() << "Completed by book retrieval and build of table, " << rowCount << " rows";
+    if(libraryChanged && isVisible())  // Changed while we were reading it
+    {
+        libraryChanged = false;
+        databaseChanged();
+    }
+}
+
+void musicLibrary::appendBooks(const QList<QStringList>& rows)
+{
+    bool first = (libModel->totalRows() == 0);
+    libModel->appendRows(rows);  // Any search typed while we were loading is applied as they go in
+    if(first) sizeColumns();    // So the first screen looks right; done again when all are in
+}
+
+void musicLibrary::sizeColumns()
+{
+    // Measuring every cell (resizeColumnsToContents) grows with the library, so measure a fixed sample spread through it
+    QFontMetrics normal(libTable->font());
+    QFontMetrics title(QFont("Arial",14,1,false));
+    int samples = std::min(MUSICALPI_LIBRARY_WIDTH_SAMPLES, libModel->totalRows());
+    for(int column = 0; column < libModel->columnCount(); column++)
+    {
+        if(libTable->isColumnHidden(column)) continue;
+        const QFontMetrics& metrics = (column == columnForTitle) ? title : normal;
+        int width = normal.horizontalAdvance(libModel->fieldName(column)) + 30;  // room for sort indicator
+        for(int sample = 0; sample < samples; sample++)
+            width = std::max(width, metrics.horizontalAdvance(libModel->sampleText(sample, samples, column)) + 12);
+        libTable->setColumnWidth(column, width);
+    }
 }
 
 void musicLibrary::showEvent(QShowEvent *e)
 {
     qDebug() << "Entered";
     (void)e;
-//    if(!screenLoaded) // don't redo unless we need to
-      if(true) // temporarily deactivating previous if - sometimes missing loadPlaylists() that should be there
+    // Only the first show loads everything; after that the watcher tells us if Calibre's database changed while we
+    // were hidden, and if not there is nothing to do
+    if(!screenLoaded)
     {
-        m_db->open();
-        checkSqlError("Opening SQL database " + m_db->databaseName(), m_db->lastError());
-        loadPlayLists();
+        loadPlayLists();  // Both of these only start the load; the screen shows (and fills) while they run
         loadBooks();
-        m_db->close();
     }
+    else if(libraryChanged)
+    {
+        libraryChanged = false;
+        databaseChanged();
+    }
+    watcher->setPolling(true);
     connect(dropdown,SIGNAL(currentIndexChanged(int)),this,SLOT(changeList(int)));
     searchBox->installEventFilter(this);  // So we can catch keystrokes and do as-you-type filter
     searchBox->setText("");
     screenLoaded=true;
+    loadQuickAccess();  // (what was just played counts)
+    thumbnails->pause(openingAhead);
+    thumbnailTimer->start();
+}
+
+void musicLibrary::loadQuickAccess()
+{
+    qDeleteAll(quickButtons);
+    quickButtons.clear();
+    QList<usageLog::entry> played = mParent->usagePtr->mostUsed(MUSICALPI_QUICK_ACCESS_BOOKS);
+    for(const usageLog::entry& book : played)
+    {
+        QPushButton* button = new QPushButton(quickWidget);
+        button->setText(QFontMetrics(button->font()).elidedText(book.title, Qt::ElideRight, 200));
+        quickLayout->addWidget(button);
+        connect(button, &QPushButton::clicked, this, [this, book]
+        {
+            pathSelected = book.filepath;
+            titleSelected = book.title;
+            int row = rowOfPath.value(book.filepath, -1);  // (for playlist changes, if it's in the library as loaded)
+            if(row >= 0 && row < libModel->loadedRows()) bookIDSelected = libModel->loadedText(row, columnForID).toInt();
+            emit songSelected(pathSelected, titleSelected, book.startPage);
+        });
+        quickButtons.append(button);
+    }
+    quickWidget->setVisible(!played.isEmpty());
+
+    // Their first pages, as they were shown when last opened, are rendered ahead while we're showing
+    QList<thumbnailThread::prerenderRequest> wanted;
+    for(int i = 0; i < played.size() && i < MUSICALPI_PRERENDER_BOOKS; i++)
+        wanted.append({played[i].filepath, played[i].startPage, played[i].spreadPages, played[i].pageSize, mParent->pageImageFormat});
+    thumbnails->prerender(wanted);
 }
 
 void musicLibrary::hideEvent(QHideEvent *e)
@@ -357,6 +610,36 @@ void musicLibrary::hideEvent(QHideEvent *e)
     (void)e;
     disconnect(dropdown,SIGNAL(currentIndexChanged(int)),this,SLOT(changeList(int)));     // Need this so we don't signal when we reload it or use it from other routines
     searchBox->removeEventFilter(this);  // So we can catch keystrokes and do as-you-type filter
+    thumbnails->pause(true);  // Pages are being rendered now, leave the processors to that
+    watcher->setPolling(false);  // (a stalled share must not hold up page turns; inotify still says if it changed)
+    openAheadTimer->stop();
+    mParent->cancelOpen();  // (if one was taken up it's not there to cancel)
+}
+
+// Slot
+void musicLibrary::requestThumbnails()
+{
+    // Those on screen first, then the next screenful so they're ready when it's scrolled to
+    if(!isVisible()) return;
+    int top = libTable->rowAt(0);
+    if(top < 0) return;  // Nothing shown
+    int bottom = libTable->rowAt(libTable->viewport()->height() - 1);
+    if(bottom < 0) bottom = libModel->rowCount() - 1;
+    int last = std::min(libModel->rowCount() - 1, bottom + (bottom - top + 1));
+    QList<thumbnailThread::thumbnailRequest> wanted;
+    for(int row = top; row <= last; row++)
+        if(!libModel->hasThumbnail(row))
+        {
+            QString path = libModel->text(row, columnForPath);
+            wanted.append({path, calibrePath + "/" + path, true});
+        }
+    if(!wanted.isEmpty()) thumbnails->request(wanted);
+}
+
+// Slot
+void musicLibrary::thumbnailReady(QString key, QImage image)
+{
+    libModel->setThumbnail(key, QPixmap::fromImage(image));
 }
 
 void musicLibrary::changeList(int newListIndex)
@@ -365,21 +648,57 @@ void musicLibrary::changeList(int newListIndex)
     ActiveListIndex = newListIndex;
     ActiveList = dropdown->itemText(ActiveListIndex);
     qDebug() << "Entered with " << newListIndex << " which is " << ActiveList;
-    m_db->open();
-    checkSqlError("Opening SQL database " + m_db->databaseName(), m_db->lastError());
     loadBooks();
-    m_db->close();
 }
 
-void musicLibrary::checkSqlError(QString stage, QSqlError err) // Aborts on error
+void musicLibrary::checkSqlError(QString stage, QString error) // Aborts on error
+{
+    if(error != " / ")
+    {
+        qDebug() << stage << " resulted in error " << error;
+        assert(error == " / ");
+    }
+}
+
+void musicLibrary::onClicked(const QModelIndex& index)
+{
+    onChosen(index.row(), index.column());
+}
+
+// Slot
+void musicLibrary::onTouched(const QModelIndex& index)
+{
+    if(!index.isValid() || !isVisible()) return;
+    mParent->prepareOpen(calibrePath + "/" + libModel->text(index.row(),columnForPath), libModel->text(index.row(),columnForTitle), libModel->startPage(index.row()));
+}
+
+// Slot
+void musicLibrary::scrollerStateChanged(QScroller::State state)
 {
-    if(err.databaseText()!="" || err.driverText()!="")
+    // The scroller holds back the press until it knows it's not a drag, so the touch-down itself comes from it (as
+    // Pressed), at the cursor; a drag or fling means it wasn't a choice after all
+    if(state == QScroller::Pressed) onTouched(libTable->indexAt(libTable->viewport()->mapFromGlobal(QCursor::pos())));
+    else if(state == QScroller::Dragging || state == QScroller::Scrolling)
     {
-        qDebug() << stage << " resulted in error " << err;
-        assert(err.databaseText()=="" || err.driverText()=="");
+        openAheadTimer->stop();  // (the press selected the row too)
+        mParent->cancelOpen();
     }
 }
 
+// Slot
+void musicLibrary::rowSelected(const QModelIndex& index)
+{
+    openAheadIndex = index;
+    openAheadTimer->start();
+}
+
+// Slot
+void musicLibrary::openAheadBusy(bool busy)
+{
+    openingAhead = busy;
+    thumbnails->pause(busy || !isVisible());
+}
+
 void musicLibrary::onChosen(int row, int column)
 {
     QTime nowTime = QTime::currentTime();
@@ -392,114 +711,139 @@ void musicLibrary::onChosen(int row, int column)
     }
     lastTimeSelected = nowTime;
     // Move these to local items since the following are going to disappear
-    pathSelected = calibrePath + "/" + libTable->item(row,columnForPath)->text();
-    titleSelected = libTable->item(row,columnForTitle)->text();
+    pathSelected = calibrePath + "/" + libModel->text(row,columnForPath);
+    titleSelected = libModel->text(row,columnForTitle);
     qDebug() << "doubleclicked on row " << row <<  " column " << column << ", value=" << pathSelected;
     lastRowSelected = row;
-    bookIDSelected = libTable->item(row,columnForID)->text().toInt();
-    emit songSelected(pathSelected, titleSelected);
+    bookIDSelected = libModel->text(row,columnForID).toInt();
+    emit songSelected(pathSelected, titleSelected, libModel->startPage(row));
 }
 
 
-void musicLibrary::procCboxAll(int checkState)
-{
-    if (checkState == Qt::Checked) {
-        checkboxNone->setChecked(false);
-        checkbox1->setChecked(true);
-        checkbox2->setChecked(true);
-        checkbox3->setChecked(true);
-        checkbox4->setChecked(true);
-        checkbox5->setChecked(true);
-        checkbox6->setChecked(true);
-    }
-    changeList(0);
-}
-
+// Slot
 void musicLibrary::procCboxNone(int checkState)
 {
     if (checkState == Qt::Checked) {
-        checkboxAll->setChecked(false);
-        checkbox1->setChecked(false);
-        checkbox2->setChecked(false);
-        checkbox3->setChecked(false);
-        checkbox4->setChecked(false);
-        checkbox5->setChecked(false);
-        checkbox6->setChecked(false);
+        for(QCheckBox* box : tagBoxes)
+        {
+            box->blockSignals(true);  // One change for them all, below
+            box->setChecked(false);
+            box->blockSignals(false);
+        }
     }
-    changeList(0);
+    tagsChanged();
 }
 
-void musicLibrary::procCbox1(int checkState)
+// Slot
+void musicLibrary::tagsChanged()
 {
-    if (checkState == Qt::Checked) {
-        checkboxNone->setChecked(false);
-    }
-    changeList(0);
+    // Filtering by tag is done on the rows we already have, so there is no query to run
+    QStringList tags = checkedTags();
+    checkboxNone->blockSignals(true);
+    checkboxNone->setChecked(tags.isEmpty());
+    checkboxNone->blockSignals(false);
+    libModel->setTagFilter(tags, checkboxMatchAll->isChecked());
+    updateTagCounts();
 }
 
-void musicLibrary::procCbox2(int checkState)
+QStringList musicLibrary::checkedTags()
 {
-    if (checkState == Qt::Checked) {
-        checkboxNone->setChecked(false);
-    }
-    changeList(0);
+    QStringList tags;
+    for(QCheckBox* box : tagBoxes)
+        if(box->isChecked()) tags.append(box->property("tag").toString());
+    return tags;
 }
 
-void musicLibrary::procCbox3(int checkState)
+void musicLibrary::loadTagBoxes()
 {
-    if (checkState == Qt::Checked) {
-        checkboxNone->setChecked(false);
+    // A box for every tag the books have (other than ours), most used first, keeping those checked that still exist
+    QStringList checked = checkedTags();
+    qDeleteAll(tagBoxes);
+    tagBoxes.clear();
+    for(const QString& tag : libModel->facetNames(tagFacets::tags))
+    {
+        if(tag == calibreMusicTag || tag.startsWith(calibreListPrefix)) continue;
+        QCheckBox* box = new QCheckBox(tagWidget);
+        box->setProperty("tag", tag);
+        box->setChecked(checked.contains(tag));
+        tagLayout->addWidget(box);
+        connect(box, SIGNAL(stateChanged(int)), this, SLOT(tagsChanged()));
+        tagBoxes.append(box);
     }
-    changeList(0);
+    if(checkedTags().size() != checked.size()) tagsChanged();  // One we were filtering on has gone
+    else updateTagCounts();
 }
 
-void musicLibrary::procCbox4(int checkState)
+void musicLibrary::updateTagCounts()
 {
-    if (checkState == Qt::Checked) {
-        checkboxNone->setChecked(false);
+    QHash<QString,int> counts = libModel->facetCounts(tagFacets::tags);
+    for(QCheckBox* box : tagBoxes)
+    {
+        QString tag = box->property("tag").toString();
+        box->setText(tag + " (" + QString::number(counts.value(tag)) + ")");
     }
-    changeList(0);
+    loadFacetBox(collectionBox, tagFacets::collection, "All collections");  // (their counts depend on the tags too)
+    loadFacetBox(authorBox, tagFacets::author, "All authors");
 }
 
-void musicLibrary::procCbox5(int checkState)
+void musicLibrary::loadFacetBox(QComboBox* box, int facet, QString anyText)
 {
-    if (checkState == Qt::Checked) {
-        checkboxNone->setChecked(false);
-    }
-    changeList(0);
+    // Most used first, only those the other choices leave (and the one chosen, even if they now leave none of it)
+    QString chosen = box->currentData().toString();
+    QHash<QString,int> counts = libModel->facetCounts(facet);
+    box->blockSignals(true);  // Not the user choosing
+    box->clear();
+    box->addItem(anyText, QString());
+    for(const QString& name : libModel->facetNames(facet))
+        if(counts.contains(name) || name == chosen) box->addItem(name + " (" + QString::number(counts.value(name)) + ")", name);
+    box->setCurrentIndex(std::max(0, box->findData(chosen)));
+    box->blockSignals(false);
+    if(box->currentData().toString() != chosen) libModel->setFacet(facet, QString());  // It's gone from the library
 }
 
-void musicLibrary::procCbox6(int checkState)
+// Slot
+void musicLibrary::facetChosen()
 {
-    if (checkState == Qt::Checked) {
-        checkboxNone->setChecked(false);
-    }
-    changeList(0);
+    // As with tags, this is done on the rows we already have
+    libModel->setFacet(tagFacets::collection, collectionBox->currentData().toString());
+    libModel->setFacet(tagFacets::author, authorBox->currentData().toString());
+    updateTagCounts();
 }
 
 
 void musicLibrary::filterTable(QString filter)
 {
-    bool match;
+    // The model keeps the matching rows (not hidden view rows) so this is one change to the view, not one per row
     qDebug() << tr("Filtering for string '%1'").arg(filter);
-    libTable->setUpdatesEnabled(false);
-    for(int row = 0; row < libTable->rowCount(); row++)
+    libModel->setFilter(filter);
+    pageTextTimer->start();  // (restarted each keystroke)
+}
+
+// Slot
+void musicLibrary::searchPageText()
+{
+    // Each page found is its book's row with the words found as its title, and the book's title (and page) as its collection
+    QString filter = searchBox->text();
+    if(filter.trimmed().length() < MUSICALPI_TEXT_SEARCH_MIN_LENGTH) return;
+    QElapsedTimer timer;
+    timer.start();
+    QList<textIndex::hit> hits = pageText->search(filter, MUSICALPI_TEXT_SEARCH_RESULTS);
+    int columnForCollection = libModel->fieldColumn("Collection");
+    QList<QStringList> rows;
+    QVector<int> pages;
+    for(const textIndex::hit& hit : hits)
     {
-        if(filter=="")  match=true; // With no filter show everything (but go through loop in case it was previously hidden)
-        else
-        {  // see if any not-hidden field matches and show
-            match = false;
-            for(int col = 0; col < libTable->columnCount(); col++)
-                if (columnForPath != col && columnForID != col &&  libTable->item(row,col)->text().contains(filter,Qt::CaseInsensitive))
-                {
-                    match = true;
-                    break;
-                }
-        }
-        if(match) libTable->showRow(row);
-        else libTable->hideRow(row);
+        int row = rowOfPath.value(hit.filepath, -1);
+        if(row < 0 || row >= libModel->loadedRows() || !libModel->rowLive(row)) continue;  // (not in this list)
+        QStringList values;
+        for(int field = 0; field < libModel->columnCount(); field++) values.append(libModel->loadedText(row, field));
+        if(columnForCollection >= 0) values[columnForCollection] = values[columnForTitle] + ", page " + QString::number(hit.page);
+        values[columnForTitle] = hit.snippet;
+        rows.append(values);
+        pages.append(hit.page);
     }
-    libTable->setUpdatesEnabled(true);
+    libModel->setPageMatches(rows, pages);
+    qDebug() << "Found " << rows.size() << " pages (of " << hits.size() << ") with '" << filter << "' in " << timer.elapsed() << "ms";
 }
 
 void musicLibrary::showKeyboard()
@@ -532,9 +876,9 @@ void musicLibrary::keyPressEvent(QKeyEvent *e)
 {
     qDebug() << "Entered musicLibrary::keyPressEvent, e-Key()=" << e->key();
     if(e->key()==Qt::Key_Enter || e->key()==Qt::Key_Return) {
-    int row = libTable->currentRow();
-    int column = libTable->currentColumn();
-        emit libTable->cellClicked(row, column);
+    int row = libTable->currentIndex().row();
+    int column = libTable->currentIndex().column();
+        if(row >= 0) onChosen(row, column);
     } else {
         if( e->key()==Qt::Key_Backspace) {
             QString textString = searchBox->text().left(searchBox->text().size()-1);
@@ -565,173 +909,174 @@ void musicLibrary::paintEvent(QPaintEvent *) // Allows style sheets to apply in
     style()->drawPrimitive(QStyle::PE_Widget, &opt, &p, this);
 }
 
-bool musicLibrary::bookInList(int tag)
+QSet<QString> musicLibrary::listsContainingBook(int book)
 {
-    m_db->open();
-    checkSqlError("Opening SQL database " + m_db->databaseName(), m_db->lastError());
-    QSqlQuery queryList;
-    QString sql =
-        "select count(*) as Presence "
-        "from books_tags_link btl, tags t, tags t2 "
-        "where btl.book = " + QString::number(bookIDSelected) + " and btl.tag = t.id "
-                                                                "and t2.id =" +  QString::number(tag) + " "
-        "and substr(t.name,1,instr(t.name,'|'))=substr(t2.name,1,instr(t2.name,'|'));";
-    queryList.exec(sql);
-    checkSqlError("Executed book/tag query " + sql, queryList.lastError());
-    assert(queryList.next());
-    bool ret = queryList.record().field(0).value().toBool();
-    m_db->close();
-    qDebug() << "Checked tag id " << tag << " for book " << bookIDSelected << " and returning " << ret;
-    return ret;
+    return listsOfBook.value(book);
 }
 
 QString musicLibrary::addBookToList(int index)
 {
-    // This aborts if we can't open the database but returns other errors back to the caller (or blank for none)
-    qDebug() << "Request to add book " << bookIDSelected << " to tag id " << dropdown->itemData(index).toInt() << " which is " << dropdown->itemText(index);
-    m_db->open();
-    checkSqlError("Opening SQL database " + m_db->databaseName(), m_db->lastError());
-    QSqlQuery insert;
-    QString sql;
-    QSqlQuery query;
-    QString qsql = "select t.name from tags t where t.name like '" + calibreListPrefix + dropdown->itemText(index) + "%' order by t.name desc;";
-    query.exec(qsql);
-    QString qresult = query.lastError().databaseText() + " / " + query.lastError().driverText();
-    bool qfound = false;
-    QString qname;
-    QString result;
-    if(qresult == " / ")
-    {
-//        qDebug() << "musicLibrary::addNewList Inserting new name";
-        while(query.next()) {
-            qfound = true;
-            qname = query.record().field(0).value().toString();
-            break;
-        }
-        if(qfound) {
-            int ordinal = qname.split("|")[1].toInt();
-            ordinal++;
-            QString newName = calibreListPrefix + dropdown->itemText(index) + "|" + QString::number(ordinal).rightJustified(2, '0');
-            qDebug() << "musicLibrary::addNewList newName = " +  newName;
-            sql = "insert into tags (name) values('" + newName + "')";
-            insert.exec(sql);
-            result = insert.lastError().databaseText() + " / " + insert.lastError().driverText();
-            qDebug() << "musicLibrary::addNewList result = " +  result;
-        }
+    return addBooksToList({bookIDSelected}, index);
+}
 
+QString musicLibrary::addBooksToList(QList<int> books, int index)
+{
+    // Each book in a list has its own tag, numbered so the list keeps its order; these go on the end, in order
+    if(index <= 0 || index >= dropdown->count()) return "No list chosen";
+    playListEdit edit = {playListEdit::addBooks, dropdown->itemText(index), QList<int>(), false};
+    for(int book : books)
+        if(!listsOfBook.value(book).contains(edit.list) && !edit.books.contains(book)) edit.books.append(book);
+    qDebug() << "Request to add " << edit.books.size() << " books to tag id " << dropdown->itemData(index).toInt() << " which is " << edit.list;
+    if(edit.books.isEmpty()) return "Already in " + edit.list;
+    QString prefix = calibreListPrefix + edit.list;
+    QList<QPair<int,QString>> adding;  // (book, tag name)
+    int position = listOrder->lastPosition(edit.list);
+    for(int book : edit.books)
+    {
+        position += MUSICALPI_PLAYLIST_GAP;
+        listOrder->add(edit.list, position, book);
+        adding.append(qMakePair(book, playListOrder::tagName(prefix, position)));
     }
-    qint32 rowid = insert.lastInsertId().toInt();
-    sql = "insert into books_tags_link(tag, book) values (" + QString::number(rowid) + "," + QString::number(bookIDSelected) +  ");";
-    insert.exec(sql);
-    result = insert.lastError().databaseText() + " / " + insert.lastError().driverText();
-    m_db->close();
-    return (result == " / " ? "Added to " + dropdown->itemText(index) : result);
+    if(edit.list == ActiveList && ActiveListIndex != 0) edit.viewChanged = showAddedBooks(edit.books);  // (if not, the list is read again once written)
+    startEdit(edit, librarySql::addToList(adding));
+    return "Adding to " + edit.list;
 }
+
 QString musicLibrary::removeBookFromList(int index)
 {
-    // This aborts if we can't open the database but returns other errors back to the caller (or blank for none)
-    qDebug() << "Request to remove book " << bookIDSelected << " to tag id " << dropdown->itemData(index).toInt() << " which is " << dropdown->itemText(index);
-    m_db->open();
-    checkSqlError("Opening SQL database " + m_db->databaseName(), m_db->lastError());
-    QSqlQuery query;
-    QString qsql = "SELECT btl.tag, t.name as tag_name, count(1) as count FROM tags t, books_tags_link btl where t.id=btl.tag and t.name like '"
-            + calibreListPrefix + dropdown->itemText(index) + "%' and book = " + QString::number(bookIDSelected) + " order by t.name desc;";
-    query.exec(qsql);
-    QString qresult = query.lastError().databaseText() + " / " + query.lastError().driverText();
-    bool qfound = false;
-    QString qname;
-    int qtag;
-    if(qresult == " / ")
+    if(index <= 0 || index >= dropdown->count()) return "No list chosen";
+    playListEdit edit = {playListEdit::removeBook, dropdown->itemText(index), {bookIDSelected}, false};
+    qDebug() << "Request to remove book " << bookIDSelected << " from tag id " << dropdown->itemData(index).toInt() << " which is " << edit.list;
+    int position = listOrder->position(edit.list, bookIDSelected);
+    if(position < 0) return "Not in " + edit.list;
+    listOrder->remove(edit.list, bookIDSelected);
+    if(edit.list == ActiveList)  // Out of the list being shown, so out of the view
     {
-        while(query.next()) {
-            qfound = true;
-            qtag = query.record().field(0).value().toInt();
-            qname = query.record().field(1).value().toString();
-            break;
-        }
+        libModel->removeIds(columnForID, {QString::number(bookIDSelected)});
+        updateTagCounts();
+        edit.viewChanged = true;
     }
-    if(qfound) {
-        QSqlQuery del;
-        QString sql = "delete from books_tags_link where tag = " + QString::number(qtag) + " and book = " + QString::number(bookIDSelected) +  ";";
-        del.exec(sql);
-        QString result = del.lastError().databaseText() + " / " + del.lastError().driverText();
-        if(qresult == " / ")
-        {
-            qsql = "SELECT count(1) as count FROM tags t, books_tags_link btl where t.id=btl.tag and btl.tag = " + QString::number(qtag) + ";";
-            query.exec(qsql);
-            qresult = query.lastError().databaseText() + " / " + query.lastError().driverText();
-            // Delete from tags if empty
-            if(qresult == " / ")
-            {
-                qfound = false;
-                int qcount = -1;
-                while(query.next()) {
-                    qfound = true;
-                    qcount = query.record().field(0).value().toInt();
-                    break;
-                }
-                if(qcount==0) {
-                    QString sql = "delete from tags where id = " + QString::number(qtag) + ";";
-                    del.exec(sql);
-                    QString result = del.lastError().databaseText() + " / " + del.lastError().driverText();
-                    if(qresult == " / ") {
-                        qDebug() << "Tag: " << qname << " deleted";
-                    } else {
-                        qDebug() << "Database error: " + qresult;
-                    }
-                }
-            } else {
-                qDebug() << "Database error: " + qresult;
-            }
+    startEdit(edit, librarySql::removeFromList(bookIDSelected, playListOrder::tagName(calibreListPrefix + edit.list, position)));
+    return "Removing from " + edit.list;
+}
 
-        }
+QString musicLibrary::moveBookInList(int index, int places)
+{
+    // Usually only the book's tag is renamed, to a number between its new neighbours'; if there's no room between them
+    // the whole list is numbered again.  Renamed in two steps, so no new name is taken while it's still an old one.
+    if(index <= 0 || index >= dropdown->count()) return "No list chosen";
+    playListEdit edit = {playListEdit::moveBook, dropdown->itemText(index), {bookIDSelected}, false};
+    qDebug() << "Request to move book " << bookIDSelected << " by " << places << " in " << edit.list;
+    playListOrder::renames renamed = listOrder->move(edit.list, bookIDSelected, places);
+    if(renamed.isEmpty()) return (places < 0 ? "Already first in " : "Already last in ") + edit.list;
+    if(edit.list == ActiveList)
+    {
+        libModel->setListOrder(columnForID, listOrder->positions(edit.list));
+        edit.viewChanged = true;
     }
-//        qDebug() << "musicLibrary::addNewList Inserting new name";
-
-    m_db->close();
-    changeList(ActiveListIndex);
-    return (qresult == " / " ? "Removed from " + dropdown->itemText(index) : qresult);
+    QString prefix = calibreListPrefix + edit.list;
+    QStringList from, to;
+    for(const QPair<int,int>& rename : renamed)
+    {
+        from.append(playListOrder::tagName(prefix, rename.first));
+        to.append(playListOrder::tagName(prefix, rename.second));
+    }
+    startEdit(edit, librarySql::renameTags(from, to));
+    return "Moving in " + edit.list;
 }
+
 QString musicLibrary::addNewList(QString name)
 {
-    // This aborts if we can't open the database but returns other errors back to the caller (or blank for none)
     qDebug() << "Request to insert new playList " << name;
-    m_db->open();
-    checkSqlError("Opening SQL database " + m_db->databaseName(), m_db->lastError());
-    QSqlQuery query;
-    QSqlQuery insert;
-    QString qsql = "select t.name from tags t where t.name like '" + name + "%' order by t.name desc;";
-    query.exec(qsql);
-    QString qresult = query.lastError().databaseText() + " / " + query.lastError().driverText();
-    bool qfound = false;
-    QString qname;
-    if(qresult == " / ")
+    playListEdit edit = {playListEdit::newList, QString(name).replace(calibreListPrefix,""), {bookIDSelected}, false};
+    if(dropdown->findText(edit.list) > 0) return "List " + edit.list + " already exists";  // (nothing to do)
+    listOrder->add(edit.list, MUSICALPI_PLAYLIST_GAP, bookIDSelected);
+    startEdit(edit, librarySql::newList(name + "|", bookIDSelected, playListOrder::tagName(name, MUSICALPI_PLAYLIST_GAP)));
+    return "Adding list " + edit.list;
+}
+
+bool musicLibrary::showAddedBooks(const QList<int>& books)
+{
+    // A book's row is the same in a list as in all books (list tags aren't in it), so it's taken from the snapshot of
+    // all books rather than read again
+    QString sql, sqlEnd, stamp;
+    QVariantList values;
+    QStringList fields;
+    QList<QStringList> rows;
+    if(booksLoading || !librarySnapshot(booksQuery(QString(), sql, sqlEnd, values)).load(fields, rows, stamp)) return false;
+    if(fields.size() != libModel->columnCount() || fields.indexOf("BookID") != columnForID) return false;
+    QSet<QString> adding, present;
+    for(int book : books) adding.insert(QString::number(book));
+    QList<QStringList> added;
+    for(const QStringList& row : rows)
+        if(adding.contains(row[columnForID])) added.append(row);
+    if(added.size() != adding.size()) return false;
+    for(int row = 0; row < libModel->loadedRows(); row++)
+        if(libModel->rowLive(row)) present.insert(libModel->loadedText(row, columnForID));
+    libModel->applyDelta(columnForID, present.unite(adding), QSet<QString>(), added);
+    libModel->setListOrder(columnForID, listOrder->positions(ActiveList));
+    loadTagBoxes();
+    indexSongs(false);
+    return true;
+}
+
+void musicLibrary::startEdit(playListEdit edit, libraryThread::transactionWork work)
+{
+    // Show it now, and write it behind
+    pendingEdits.insert(++transactionSerial, edit);
+    applyEdit(edit, false);
+    loader->transaction(transactionSerial, work);
+}
+
+void musicLibrary::applyEdit(const playListEdit& edit, bool undo)
+{
+    if(edit.kind == playListEdit::moveBook) return;  // (in the same lists still)
+    bool adding = (edit.kind != playListEdit::removeBook) != undo;
+    for(int book : edit.books)
+        if(adding) listsOfBook[book].insert(edit.list);
+        else listsOfBook[book].remove(edit.list);
+    if(edit.kind != playListEdit::newList) return;
+    dropdown->blockSignals(true);  // Not the user changing lists
+    int at = dropdown->findText(edit.list);
+    if(undo && at > 0 && at != ActiveListIndex)
     {
-//        qDebug() << "musicLibrary::addNewList Inserting new name";
-        while(query.next()) {
-            qfound = true;
-            qname = query.record().field(0).value().toString();
-            break;
-        }
+        dropdown->removeItem(at);
+        if(at < ActiveListIndex) ActiveListIndex--;
+    }
+    else if(!undo && at < 0)
+    {
+        for(at = 1; at < dropdown->count() && dropdown->itemText(at) < edit.list; at++);  // Lists are in name order
+        dropdown->insertItem(at, edit.list, 0);  // (its tag id comes when the lists are next loaded)
+        if(at <= ActiveListIndex) ActiveListIndex++;
+    }
+    dropdown->blockSignals(false);
+}
 
+// Slot
+void musicLibrary::libraryTransactionDone(int serial, QString error)
+{
+    if(!pendingEdits.contains(serial)) return;
+    playListEdit edit = pendingEdits.take(serial);
+    if(error != " / ")
+    {
+        qDebug() << "Change to list " << edit.list << " failed with " << error << ", undoing it";
+        applyEdit(edit, true);
+        loadPlayLists();  // In case it was partly our mistake, see what's really there
+        if(edit.viewChanged) changeList(ActiveListIndex);
+        emit playListWritten(error);
+        return;
     }
-    QString result;
-    if(qfound) {
-        qDebug() << "musicLibrary::addNewList Query name: " + qname;
-    } else {
-        qDebug() << "musicLibrary::addNewList No Query name found: ";
-        QString sql = "insert into tags (name) values('" + name + "|01')";
-        insert.exec(sql);
-        result = insert.lastError().databaseText() + " / " + insert.lastError().driverText();
-        if(result == " / ")  // If no error then also add the current book to it
-        {
-            qint32 rowid = insert.lastInsertId().toInt();
-            sql = "insert into books_tags_link(tag, book) values (" + QString::number(rowid) + "," + QString::number(bookIDSelected) +  ");";
-            insert.exec(sql);
-            result = insert.lastError().databaseText() + " / " + insert.lastError().driverText();
-            loadPlayLists();  // Need to reload since we added one -- this does not change active list though
-        }
+    // List membership isn't in Calibre's last_modified, so the list's snapshot can't catch up with this; if it's the
+    // one showing, what's shown has the change, otherwise it's read afresh next time.  Other snapshots (all books
+    // included) have no list tags in them, so are still good.
+    if(edit.kind != playListEdit::moveBook)
+    {
+        QString sql, sqlEnd;
+        QVariantList values;
+        if(edit.list == ActiveList && ActiveListIndex != 0 && !booksLoading && (edit.kind != playListEdit::addBooks || edit.viewChanged)) snapshot->save(libModel, columnForModified);
+        else librarySnapshot(booksQuery(edit.list, sql, sqlEnd, values)).discard();
     }
-    m_db->close();
-    return (result == " / " ? "Added to " + name.replace(calibreListPrefix,"") : result);
+    if(edit.kind == playListEdit::newList) loadPlayLists();
+    else if(edit.kind == playListEdit::addBooks && edit.list == ActiveList && !edit.viewChanged) changeList(ActiveListIndex);  // Rows to add to the view
+    emit playListWritten((edit.kind == playListEdit::removeBook ? "Removed from " : edit.kind == playListEdit::moveBook ? "Moved in " : "Added to ") + edit.list);
 }
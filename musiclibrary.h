@@ -7,21 +7,39 @@
 #include <QWidget>
 #include "keyboard.h"
 #include <QTime>
+#include <QStringList>
+#include <QList>
+#include <QVector>
+#include <QSet>
+#include <QHash>
+#include <QMap>
+#include <QVariant>
+#include <QImage>
+#include <QPersistentModelIndex>
+#include <QScroller>
+#include "librarythread.h"
 
 // This is a container widget that holds both a label, a search text box, the playlist drop down and a table widget with the library
 
 class MainWindow;
-class QSqlDatabase;
 class QWidget;
 class QVBoxLayout;
 class QHBoxLayout;
 class QLabel;
 class QLineEdit;
 class QComboBox;
-class QTableWidget;
-class QSqlError;
+class QTableView;
+class libraryModel;
 class QListView;
 class QCheckBox;
+class QScrollArea;
+class librarySnapshot;
+class libraryWatcher;
+class thumbnailThread;
+class textIndex;
+class playListOrder;
+class QTimer;
+class QPushButton;
 
 class musicLibrary : public QWidget
 {
@@ -33,10 +51,14 @@ public:
 
     void showKeyboard();         // If needed show the OnBoard keyboard
     void hideKeyboard();         //      or hide it
-    bool bookInList(int);        // utility routine for other callers to find if current book is in a given list (by index into the dropdown)
-    QString addBookToList(int);      // utility routine to link a book to a list
-    QString removeBookFromList(int); // .... or remove one
-    QString addNewList(QString);     // or add a completely new list (and reload the dropdown)
+    QSet<QString> listsContainingBook(int book);  // Names of the lists (as in the dropdown) a book is in
+    // Playlist changes show at once and are written in the background (then playListWritten says how it went, and if it
+    // failed they are undone).  Each returns a description of what it's doing, or an error if it can't be started.
+    QString addBookToList(int);      // utility routine to link the selected book to a list (by dropdown index)
+    QString addBooksToList(QList<int> books, int index);  // .... or several books, in that order, in one transaction
+    QString removeBookFromList(int); // .... or remove it
+    QString moveBookInList(int index, int places);  // .... or move it earlier (negative) or later in the list
+    QString addNewList(QString);     // or add a completely new list with the selected book in it
 
     QString ActiveList;     // Persist the (full) name of the tag for the currently active list
     int ActiveListIndex;    // index inside of dropdown
@@ -44,14 +66,54 @@ public:
     QString calibreListPrefix;    // Prefix for all play lists
 
 private:
-    QSqlDatabase* m_db;
+    libraryThread* loader;        // Owns our (one) database connection; reads playlists and books off the GUI thread and we fill in as rows arrive
+    int playListsSerial;          // Number of our latest request of each kind, older results are ignored
+    int booksSerial;
+    QList<QStringList> playListRows;  // Gathered until the query finishes, as the dropdown is rebuilt all at once
+    QHash<int, QSet<QString>> listsOfBook;  // Book id -> lists it is in; loaded with the lists, and kept up as we change them
+    struct playListEdit
+    {
+        enum {addBooks, removeBook, newList, moveBook} kind;
+        QString list;         // Name as in the dropdown
+        QList<int> books;
+        bool viewChanged;     // The library view was changed to suit (so needs reloading if this is undone)
+    };
+    int transactionSerial;
+    QMap<int, playListEdit> pendingEdits;  // Sent to be written, by transaction serial (so in the order sent)
+    playListOrder* listOrder;     // Order of the books in each list, as in Calibre (changed here first, then written there)
+    librarySnapshot* snapshot;    // Local copy of the current books query's result
+    libraryWatcher* watcher;      // Says when Calibre's database changes
+    thumbnailThread* thumbnails;  // Makes the pictures of books shown with their titles (and their bookInfo)
+    QTimer* thumbnailTimer;       // Asks for those on screen once scrolling (or loading) pauses
+    QHash<QString,int> rowOfBook; // Book id -> its row in libModel (as loaded), to put its songs with
+    QSet<QString> songsIndexed;   // Books sent to thumbnails to be indexed, since the books were last loaded
+    QSet<QString> songsAdded;     //     and those whose songs are in libModel
+    QHash<QString,int> rowOfPath; // PDF (full path) -> its row, to put the pages found in its text with
+    textIndex* pageText;          // Our own connection to the words of each page (thumbnails fills them in)
+    QTimer* pageTextTimer;        // Searches them once typing pauses
+    QTimer* openAheadTimer;       // Opens the row selected ahead once the selection stays on it
+    QPersistentModelIndex openAheadIndex;
+    bool openingAhead;            // MainWindow is rendering books opened ahead, so thumbnails wait
+    bool libraryChanged;          // It changed while we were hidden (or loading), so refresh when we can
+    bool booksLoading;            // Reading the whole books query (no snapshot)
+    QString booksSql;             // Books query last built by loadBooks, in two parts so a condition can go between
+    QString booksSqlEnd;
+    QVariantList booksValues;
+    bool booksRefreshing;         // Books shown from the snapshot, and the books query is only reading changes since
+    int bookChangesSerial;
+    QSet<QString> bookIDs;        // While refreshing: every book in Calibre,
+    QSet<QString> changedBookIDs; //     those changed since the snapshot,
+    QList<QStringList> changedBookRows;  // and the changed ones that are still in our list
+    bool bookChangesDone;         // Both the above queries are needed before applying changes
+    bool changedBooksDone;
     QWidget* ourParent;
     MainWindow* mParent;
     Keyboard kbd;
 
-    int columnForPath;     // Stash column in libTable where we store these items in case we need them
+    int columnForPath;     // Stash column in libModel where we store these items in case we need them
     int columnForID;
     int columnForTitle;
+    int columnForModified;
 
 
     // widget structure as indicated below
@@ -62,18 +124,23 @@ private:
                   QLabel* prompt;               // Prompt for search box
                   QLineEdit* searchBox;         // Search box for data entry
 public:           QComboBox* dropdown;          // dropdown combo to select the active play list
-                  QLabel* checkboxLabel;
-                  QCheckBox* checkboxAll;
-                  QCheckBox* checkboxNone;
-                  QCheckBox* checkbox1;
-                  QCheckBox* checkbox2;
-                  QCheckBox* checkbox3;
-                  QCheckBox* checkbox4;
-                  QCheckBox* checkbox5;
-                  QCheckBox* checkbox6;
                   void keyPressEvent(QKeyEvent *e);
 private:          QListView* listDropdown;      // Used to view the combo
-          QTableWidget* libTable;               // The music library display (filtered by list doesn't retrieve items, by search just hides rows)
+                  QComboBox* collectionBox;     // Only books in this collection (the first item is any), with how many each has
+                  QComboBox* authorBox;         //     or by this author; each counting only what the other choices leave
+                  QLabel* checkboxLabel;
+                  QCheckBox* checkboxNone;      // No tag filters (checking it unchecks them)
+                  QCheckBox* checkboxMatchAll;  // Books must have all checked tags, rather than any of them
+                  QScrollArea* tagArea;
+                      QWidget* tagWidget;
+                          QHBoxLayout* tagLayout;
+                              QVector<QCheckBox*> tagBoxes;  // One per tag in the library, made when it loads
+          QWidget* quickWidget;                 // Books played most (and most lately, see usageLog), to open with one touch
+              QHBoxLayout* quickLayout;
+                  QLabel* quickLabel;
+                  QVector<QPushButton*> quickButtons;
+          QTableView* libTable;                 // The music library display (filtered by list doesn't retrieve items, by search just hides rows)
+          libraryModel* libModel;               //     and what it shows
 
     bool eventFilter(QObject *object, QEvent *event);
     void paintEvent(QPaintEvent *);
@@ -89,31 +156,58 @@ private:          QListView* listDropdown;      // Used to view the combo
     QString pathSelected;
     QString titleSelected;
 
-    void checkSqlError(QString stage, QSqlError err); // utility routine after any sql call
-
-    void loadPlayLists();        // Load the dropdown
-    void loadBooks();            // Load the library
+    void checkSqlError(QString stage, QString error); // utility routine after any sql call
+
+    void loadPlayLists();        // Load the dropdown (in background)
+    void loadBooks();            // Load the library (in background)
+    QString booksQuery(const QString& list, QString& sql, QString& sqlEnd, QVariantList& values);  // The books query for a list (empty for all books), returning its snapshot's key
+    bool showAddedBooks(const QList<int>& books);  // Into the list being shown, from the snapshot of all books; false if they aren't all there
+    void fillPlayLists(const QList<QStringList>& rows);
+    void appendBooks(const QList<QStringList>& rows);
+    void setupColumns(const QStringList& fieldNames);
+    void booksLoaded();
+    void indexSongs(bool all);   // Have the songs in books found (all, or those not yet sent)
+    void applyBookChanges();
+    void refreshBooks(QString stamp);
+    QStringList checkedTags();
+    void loadTagBoxes();
+    void updateTagCounts();
+    void loadFacetBox(QComboBox* box, int facet, QString anyText);
+    void loadQuickAccess();      // From the usage log (and have the best of them rendered ahead)
+    void sizeColumns();
+    void applyEdit(const playListEdit& edit, bool undo);  // Make (or undo) an edit in listsOfBook and the dropdown
+    void startEdit(playListEdit edit, libraryThread::transactionWork work);
 
     void showEvent(QShowEvent *e);  // Overriden so we know when to load or release our data
     void hideEvent(QHideEvent *e);
-    bool screenLoaded;    // We will only load it once, so keep track (this means we won't see library changes without exit)
+    bool screenLoaded;    // We will only load it once, so keep track (after that libraryWatcher tells us of changes)
 
 
 signals:
-    void songSelected(QString, QString);
+    void songSelected(QString, QString, int);  // Path, title and page to start at
+    void playListWritten(QString result);  // A playlist change was written (result says what was done) or undone (the error)
 
 private slots:
     void onChosen(int, int);
+    void onClicked(const QModelIndex& index);
+    void onTouched(const QModelIndex& index);  // Pressed or selected, so likely to be chosen next
+    void scrollerStateChanged(QScroller::State state);
+    void rowSelected(const QModelIndex& index);
+    void openAheadBusy(bool busy);
+    void libraryQueryStarted(int kind, int serial, QStringList fieldNames);
+    void libraryRowsRead(int kind, int serial, QList<QStringList> rows);
+    void libraryQueryFinished(int kind, int serial, int rowCount);
+    void databaseChanged();
+    void requestThumbnails();
+    void thumbnailReady(QString key, QImage image);
+    void songsFound(QString key, QList<QStringList> songs);
+    void libraryTransactionDone(int serial, QString error);
     void filterTable(QString);
+    void searchPageText();
     void changeList(int);
-    void procCboxAll(int);
     void procCboxNone(int);
-    void procCbox1(int);
-    void procCbox2(int);
-    void procCbox3(int);
-    void procCbox4(int);
-    void procCbox5(int);
-    void procCbox6(int);
+    void tagsChanged();
+    void facetChosen();
 };
 
 
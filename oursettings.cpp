@@ -25,17 +25,30 @@ void ourSettings::getSaveValues()
     setPtr->setValue("calibreDatabase",setPtr->value("calibreDatabase","metadata.db").toString());             // Database file name
     setPtr->setValue("calibreMusicTag",setPtr->value("calibreMusicTag","music").toString());                  // Tag must be setup in Calibre
     setPtr->setValue("calibreListPrefix",setPtr->value("calibreListPrefix","musicList_").toString());     // Prefix for any lists we maintain
+    setPtr->setValue("calibreImmutable",setPtr->value("calibreImmutable",false).toBool());                // Read without any locking (only safe if Calibre isn't writing as we read)
+    setPtr->setValue("calibreMmapMB",setPtr->value("calibreMmapMB",64).toInt());                          // SQLite memory mapped I/O for reads
+    setPtr->setValue("calibreCacheMB",setPtr->value("calibreCacheMB",16).toInt());                        // SQLite page cache for reads
+    setPtr->setValue("libraryThumbnailHeight",setPtr->value("libraryThumbnailHeight",48).toInt());       // Pictures of each book in the library (0 for none)
     setPtr->setValue("logoPct",setPtr->value("logoPct",20).toInt());                                   // How wide should logo be on non-play window
     setPtr->setValue("pageBorderWidth",setPtr->value("pageBorderWidth",10).toInt());                          // Border around pages
     setPtr->setValue("forceOnboardKeyboard",setPtr->value("forceOnboardKeyboard",true).toBool());  // should we do a dbus command to bring up onboard?
 
     // This one can be smaller than calculated below, but is set to allow twice the number of pages
-    // ahead of, and the same number behind, the max "up" display, plus some slop, so page forward/back works.
+    // ahead of, and the same number behind, a 4 x 2 display, plus some slop, so page forward/back works.
     // The 2:1 ratio of ahead to behind is hard coded into the cache range calculation routine
-    // Large impact if larger; if "up" changes and this gets too large it can be smaller and will
-    // only really impact performance when paging through with very high "up" size.
+    // Large impact if larger; larger grids (e.g. the overview) use thumbnails kept separately, so
+    // this need not grow with them.
 
-    setPtr->setValue("maxCache",setPtr->value("maxCache",(4 * (MUSICALPI_MAXROWS * MUSICALPI_MAXCOLUMNS) + 3)).toInt());
+    setPtr->setValue("maxCache",setPtr->value("maxCache",(4 * 8 + 3)).toInt());
+
+    // Memory for zoomed in page tiles, per page shown; least recently used tiles go first
+
+    setPtr->setValue("tileCacheMB",setPtr->value("tileCacheMB",64).toInt());
+
+    // Grid for the overview button (thumbnails of this many pages across and down)
+
+    setPtr->setValue("overviewAcross",setPtr->value("overviewAcross",6).toInt());
+    setPtr->setValue("overviewDown",setPtr->value("overviewDown",3).toInt());
 
     // Duration and sizing of "where to touch" overlay hint went switched to play mode
 
@@ -67,6 +80,7 @@ void ourSettings::getSaveValues()
     setPtr->setValue("debugMidiFileParseDetails",setPtr->value("debugMidiFileParseDetails",false).toBool()); // Should parse of file be itemized
     setPtr->setValue("debugMidiMeasureDetails",setPtr->value("debugMidiMeasureDetails",false).toBool());   // During file parse should measure contains be itemized
     setPtr->setValue("debugQueueInfoInterval",setPtr->value("debugQueueInfoInterval",500).toUInt());      // How often should queue status debugging be written (msec)
+    setPtr->setValue("debugPageTurnDetails",setPtr->value("debugPageTurnDetails",false).toBool());       // Debug output on each page turn (off keeps it from allocating on each turn)
 
     // Note this one is special as it caches the value for later use
     setPtr->setValue("debugSettingsAsLoaded",debugSettingsAsLoaded = setPtr->value("debugSettingsAsLoaded",false).toBool());      // Show each settings file entry as loaded or written
@@ -0,0 +1,50 @@
+// Copyright 2023 by Linwood Ferguson, licensed under GNU GPLv3
+
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QSet>
+#include <QStandardPaths>
+#include <QCryptographicHash>
+
+#include "pagecache.h"
+
+QString pageCache::folder()
+{
+    return QStandardPaths::writableLocation(QStandardPaths::AppLocalDataLocation) + "/pages";
+}
+
+QString pageCache::fileName(const QString& path, qint64 modified, int page, QSize size)
+{
+    QString key = path + "\n" + QString::number(modified) + "\n" + QString::number(page) + "\n" + QString::number(size.width()) + "x" + QString::number(size.height());
+    return folder() + "/" + QCryptographicHash::hash(key.toUtf8(), QCryptographicHash::Sha1).toHex().left(16) + ".png";
+}
+
+QImage pageCache::find(const QString& path, qint64 modified, int page, QSize size)
+{
+    QImage image;
+    image.load(fileName(path, modified, page, size));  // (stays null if it isn't there)
+    return image;
+}
+
+bool pageCache::save(const QString& path, qint64 modified, int page, QSize size, const QImage& image)
+{
+    QDir().mkpath(folder());
+    QSaveFile file(fileName(path, modified, page, size));  // So renderThread never finds one half written
+    if(file.open(QIODevice::WriteOnly) && image.save(&file, "PNG") && file.commit()) return true;
+    qDebug() << "Could not save page " << page << " of " << path << " to " << file.fileName();
+    return false;
+}
+
+void pageCache::prune(const QStringList& keep)
+{
+    QSet<QString> kept(keep.begin(), keep.end());
+    for(const QFileInfo& info : QDir(folder()).entryInfoList({"*.png"}, QDir::Files))
+        if(!kept.contains(info.absoluteFilePath()))
+        {
+            qDebug() << "Removing " << info.fileName() << " from page cache";
+            QFile::remove(info.absoluteFilePath());
+        }
+}
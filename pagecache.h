@@ -0,0 +1,28 @@
+#ifndef PAGECACHE_H
+#define PAGECACHE_H
+
+// Copyright 2023 by Linwood Ferguson, licensed under GNU GPLv3
+
+#include <QString>
+#include <QStringList>
+#include <QImage>
+#include <QSize>
+
+// Rendered pages kept on local storage, so the first spread of a book played often shows as soon as it's opened
+// rather than after Poppler renders it.  thumbnailThread fills it in, while the library is idle, for the books
+// usageLog ranks highest; renderThread looks here before rendering.  Each is filed by the PDF's path and
+// modification time and the size it was rendered for, so a changed PDF (or a different screen) just doesn't find it.
+
+class pageCache
+{
+public:
+    static QImage find(const QString& path, qint64 modified, int page, QSize size);  // Starting page 1; null if not there
+    static bool save(const QString& path, qint64 modified, int page, QSize size, const QImage& image);
+    static QString fileName(const QString& path, qint64 modified, int page, QSize size);
+    static void prune(const QStringList& keep);  // Remove all but these (as from fileName)
+
+private:
+    static QString folder();
+};
+
+#endif // PAGECACHE_H
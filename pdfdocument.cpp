@@ -1,8 +1,8 @@
 // Copyright 2023 by Linwood Ferguson, licensed under GNU GPLv3
 
 #include <QPainter>
-#include <QFileInfo>
 #include <QThread>
+#include <QTimer>
 
 #include "pdfdocument.h"
 #include "mainwindow.h"
@@ -34,9 +34,13 @@ PDFDocument::PDFDocument(MainWindow* parent, QString _filePath, QString _titleNa
     imageWidth = 0;
     imageHeight = 0;
     totalPagesRequested = totalPagesRendered = 0;
+    thumbWidth = thumbHeight = 0;
+    thumbRangeStart = thumbRangeEnd = 0;
+    thumbnailsScheduled = false;
     for(int i=0; i<MUSICALPI_MAXPAGES; i++)
     {
         pageImagesAvailable[i] = false;  // pages will start at 1 but stored at index 0, so using 0 for page number means empty
+        thumbImagesAvailable[i] = false;
     }
     for(int i=0; i<MUSICALPI_THREADS; i++)
     {
@@ -45,24 +49,18 @@ PDFDocument::PDFDocument(MainWindow* parent, QString _filePath, QString _titleNa
                 this,               SLOT(updateImage(int,int,int,int)));
         pageThreadActive[i]=false;
         pageThreadPageLoading[i]=0;
+        pageThreadThumbnail[i]=false;
     }
-    if(filepath.endsWith(".pdf",Qt::CaseInsensitive))
-    {
-        midiFilePath = filepath;
-        midiFilePath.replace(filepath.length() - 4,4,".mid");  // tentative path
-        QFileInfo check_file(midiFilePath);
-        if(!check_file.exists() || !check_file.isFile()) midiFilePath = ""; // if not there, just blank it out to tell others
-    }
-    else midiFilePath = "";
-
-    document = Poppler::Document::load(filepath);
-    document->setRenderBackend(MUSICALPI_POPPLER_BACKEND);
-    assert(document && !document->isLocked());
-    numPages = document->numPages();   // Count of pages in document
-    // not needed to delete as managed now >> DELETE_LOG(document); // If we are letting the thread render we don't need this any more, close it
+    // Page count and .mid come from what's stored about the book, if it's there and current, so we need not open the
+    // PDF here at all (the render threads open their own); otherwise this reads (and stores) it
+    bool found = info.get(filepath);
+    assert(found);
+    (void)found;
+    numPages = info.pageCount;   // Count of pages in document
+    midiFilePath = info.hasMidi ? bookInfo::midiPath(filepath) : "";  // if not there, just blank it out to tell others
 
     assert(numPages <= MUSICALPI_MAXPAGES);
-    cacheRangeStart = 1;  // Start at the beginning, then adjust as we get asked for images
+    cacheRangeStart = cacheFocus = 1;  // Start at the beginning, then adjust as we get asked for images
     maxCache = cacheRangeEnd = mParent->ourSettingsPtr->getSetting("maxCache").toInt();
 
 
@@ -101,6 +99,11 @@ PDFDocument::~PDFDocument()
             DELETE_LOG(pageImages[i]);
             pageImagesAvailable[i]=false;
         }
+        if (thumbImagesAvailable[i])
+        {
+            delete thumbImages[i];
+            thumbImagesAvailable[i]=false;
+        }
         lockOrUnlockMutex(false);
     }
     // not needed to delete as managed now >> DELETE_LOG(document);
@@ -110,6 +113,19 @@ PDFDocument::~PDFDocument()
 void PDFDocument::updateImage(int which, int page, int maxWidthUsed, int maxHeightUsed)
 {
     // This just records the returned image it doesn't display it itself
+    if(pageThreadThumbnail[which])
+    {
+        // Keep it only if it is still wanted at this size and we didn't make one from a cached page meanwhile
+        if(thumbImagesAvailable[page - 1] || page < thumbRangeStart || page > thumbRangeEnd || maxWidthUsed != thumbWidth || maxHeightUsed != thumbHeight)
+            delete thumbImages[page - 1];
+        else thumbImagesAvailable[page - 1] = true;
+        pageThreadActive[which] = false;
+        pageThreadPageLoading[which] = 0;
+        pageThreadThumbnail[which] = false;
+        checkCaching();
+        emit newImageReady();
+        return;
+    }
     pageImagesAvailable[page - 1] = true;
     if(maxWidthUsed < imageWidth || maxHeightUsed < imageHeight)
     {
@@ -143,13 +159,37 @@ void PDFDocument::checkCaching()
     // keep up.
 
     lockOrUnlockMutex(true); // We don't want to delete something half delivered so lock out thread; this is a bit broad but this section is pretty fast.
+
+    // Thumbnails for small grid cells are made by scaling down cached full size pages (in makeThumbnails, a few at a
+    // time).  Only pages with none cached are rendered at thumbnail size, and only by threads the full pages leave idle
+    // (after the page loop below), so overview cells never hold up the pages being played.
     for(int i=0; i<numPages; i++)
     {
+        if(!usingThumbnails() || i+1 < thumbRangeStart || i+1 > thumbRangeEnd)
+        {
+            if(thumbImagesAvailable[i])
+            {
+                delete thumbImages[i];
+                thumbImagesAvailable[i]=false;
+            }
+        }
+        else if(!thumbImagesAvailable[i] && pageImagesAvailable[i] && !thumbnailsScheduled)
+        {
+            thumbnailsScheduled = true;
+            QTimer::singleShot(0, this, &PDFDocument::makeThumbnails);
+        }
+    }
+
+    // Pages on screen and ahead first, then those behind, so a book opened part way in (at a song) shows that spread first
+    bool pagesWaiting = false;
+    for(int k=0; k<numPages; k++)
+    {
+        int i = (cacheFocus - 1 + k) % numPages;
         if(i+1 < cacheRangeStart || i+1 > cacheRangeEnd)  // outside of caching range
         {
             if(pageImagesAvailable[i])
             {
-                qDebug() << "Removing page " << i + 1 << " from cache as expired.";
+                if(mParent->debugPageTurns) qDebug() << "Removing page " << i + 1 << " from cache as expired.";
                 delete pageImages[i];
                 pageImagesAvailable[i]=false;
             }
@@ -162,7 +202,7 @@ void PDFDocument::checkCaching()
                 int availableThread = -1;
                 for(int t=0; t < MUSICALPI_THREADS; t++)
                 {
-                    if (pageThreadPageLoading[t] == i+1) // Already doing this page
+                    if (pageThreadPageLoading[t] == i+1 && !pageThreadThumbnail[t]) // Already doing this page
                     {
                         found = true;  // but don't "continue" as we are also looking for available threads
                     }
@@ -186,7 +226,8 @@ void PDFDocument::checkCaching()
                     else // we don't have available threads (and because !found we looked the whole way)
                     {
                         //qDebug() << "Need to load page " << i + 1 << " but no threads (or first set).";
-                        break;  // this will break the scan of pages (i)
+                        pagesWaiting = true;
+                        break;  // this will break the scan of pages (k)
                     }
                 } // we found it so just keep looking for another in outer loop
                 // else qDebug() << "Checking page " << i+1 << "showing it is loading now";
@@ -194,6 +235,26 @@ void PDFDocument::checkCaching()
             //else qDebug() << "Checking page " << i+1 << " showing available.";
         }
     }
+
+    // Then thumbnails with no cached page to scale down, rendered small (much quicker than a full page), with what
+    // threads the full pages didn't need; a cell shows its page once it's rendered or cached
+    for(int i = thumbRangeStart - 1; usingThumbnails() && !pagesWaiting && i >= 0 && i < thumbRangeEnd; i++)
+    {
+        if(thumbImagesAvailable[i] || pageImagesAvailable[i]) continue;
+        bool found=false;
+        int availableThread = -1;
+        for(int t=0; t < MUSICALPI_THREADS; t++)
+        {
+            if (pageThreadPageLoading[t] == i+1) found = true;  // either kind; a full page will be scaled down when it arrives
+            if(!pageThreadActive[t]) availableThread = t;
+        }
+        if(found) continue;
+        if(availableThread == -1) break;
+        pageThreadPageLoading[availableThread]=i+1;
+        pageThreadActive[availableThread]=true;
+        pageThreadThumbnail[availableThread]=true;
+        pageThreads[availableThread]->render(&thumbImages[i],i+1,thumbWidth,thumbHeight);
+    }
     lockOrUnlockMutex(false);
 }
 
@@ -202,18 +263,83 @@ void PDFDocument::adjustCache(int leftmostPage)
     // This seems to do the same calculation twice, but we want to extend anything outside of the normal range
     // to the other side if we hit one end.
 
+    cacheFocus = std::max(1, std::min(numPages, leftmostPage));
     int nominalStart = std::max(1,std::min(numPages, leftmostPage - (int)(0.33 * maxCache)));
     int nominalEnd    = std::max(1,std::min(numPages, nominalStart + maxCache - 1));
     nominalStart  = std::max(1,std::min(numPages, nominalEnd  - maxCache + 1));
     if(nominalStart != cacheRangeStart || nominalEnd != cacheRangeEnd)
     {
-        qDebug() << "With leftmostpage as " << leftmostPage << " cache changed from [" << cacheRangeStart << "," << cacheRangeEnd << "] to ["<< nominalStart << "," << nominalEnd << "]";
+        if(mParent->debugPageTurns) qDebug() << "With leftmostpage as " << leftmostPage << " cache changed from [" << cacheRangeStart << "," << cacheRangeEnd << "] to ["<< nominalStart << "," << nominalEnd << "]";
         cacheRangeStart = nominalStart;
         cacheRangeEnd = nominalEnd;
     }
+    if(usingThumbnails())
+    {
+        // Same 2:1 bias forward as the page cache, measured in screens of the grid
+        int up = mParent->pagesNowAcross * mParent->pagesNowDown;
+        thumbRangeStart = std::max(1, leftmostPage - up);
+        thumbRangeEnd = std::min(numPages, leftmostPage + 2 * up - 1);
+    }
     checkCaching();
 }
 
+void PDFDocument::stopCaching()
+{
+    // With no size set checkCaching starts nothing; pages rendering still land (and are kept) but aren't looked at
+    imageWidth = imageHeight = 0;
+    thumbWidth = thumbHeight = 0;
+}
+
+bool PDFDocument::idle()
+{
+    for(int t=0; t < MUSICALPI_THREADS; t++) if(pageThreadActive[t]) return false;
+    return true;
+}
+
+void PDFDocument::checkResetThumbnailSize(int width, int height)
+{
+    // Zero turns thumbnails off; any size change discards them, as they are made to fit the cell exactly
+    if(width == thumbWidth && height == thumbHeight) return;
+    qDebug() << "Thumbnail size changed to [" << width << "x" << height << "]";
+    thumbWidth = width;
+    thumbHeight = height;
+    lockOrUnlockMutex(true);
+    for(int i = 0; i < MUSICALPI_MAXPAGES; i++)
+        if(thumbImagesAvailable[i])
+        {
+            delete thumbImages[i];
+            thumbImagesAvailable[i]=false;
+        }
+    lockOrUnlockMutex(false);
+    // Range is set by adjustCache, which callers do next, so no need to check caching here
+}
+
+// Slot
+void PDFDocument::makeThumbnails()
+{
+    // Scale cached full size pages down to thumbnails, only a few per pass so a large grid doesn't hold up the event loop
+    thumbnailsScheduled = false;
+    if(!usingThumbnails()) return;
+    int made = 0;
+    for(int i = thumbRangeStart - 1; i < thumbRangeEnd && made < MUSICALPI_THUMBNAILS_PER_PASS; i++)
+    {
+        if(thumbImagesAvailable[i] || !pageImagesAvailable[i]) continue;
+        bool rendering = false;
+        for(int t=0; t < MUSICALPI_THREADS; t++) if(pageThreadThumbnail[t] && pageThreadPageLoading[t] == i+1) rendering = true;
+        if(rendering) continue;  // would be written over when the render lands
+        QImage scaled = pageImages[i]->scaled(thumbWidth, thumbHeight, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+        if(scaled.format() != mParent->pageImageFormat) scaled.convertTo(mParent->pageImageFormat);
+        thumbImages[i] = new QImage(scaled);
+        thumbImagesAvailable[i] = true;
+        made++;
+    }
+    if(made)
+    {
+        checkCaching();  // re-queues us if there are more to do
+        emit newImageReady();
+    }
+}
+
 void PDFDocument::checkResetImageSize(int width, int height)
 {
     if(width == imageWidth && height == imageHeight)
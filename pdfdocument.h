@@ -7,7 +7,7 @@
 
 #include "docpagelabel.h"
 #include "piconstants.h"
-#include <poppler/qt6/poppler-qt6.h>
+#include "bookinfo.h"
 
 #include <cassert>
 
@@ -28,12 +28,21 @@ public:
     int numPages;  // Number of pages in document
     int imageWidth;  // Current width of image window we are using (adjusted for roomForMenu if needed)
     int imageHeight;   // Current height of image window we are using
-    std::unique_ptr<Poppler::Document> document;   // Document (or null)
+    bookInfo info;   // Page sizes, outline and so on
     void checkResetImageSize(int width, int height);
     QImage *pageImages[MUSICALPI_MAXPAGES];
     bool pageImagesAvailable[MUSICALPI_MAXPAGES]; // do not use image unless true
+    // Thumbnails are kept separately from full size pages for small grid cells (see checkResetThumbnailSize)
+    QImage *thumbImages[MUSICALPI_MAXPAGES];
+    bool thumbImagesAvailable[MUSICALPI_MAXPAGES]; // do not use thumbnail unless true
+    int thumbWidth;   // Current thumbnail cell size, zero if not using thumbnails
+    int thumbHeight;
+    void checkResetThumbnailSize(int width, int height);
+    bool usingThumbnails() { return thumbWidth > 0; }
     void checkCaching();
     void adjustCache(int leftmostPage);
+    void stopCaching();   // Start no more renders (those running finish), as it's about to be deleted
+    bool idle();          // No renders running, so deleting it won't wait for one
     QMutex PDFMutex;
     void lockOrUnlockMutex(bool lockFlag);
     MainWindow* mParent;
@@ -45,10 +54,17 @@ private:
     renderThread *pageThreads[MUSICALPI_THREADS];
     bool pageThreadActive[MUSICALPI_THREADS];
     int pageThreadPageLoading[MUSICALPI_THREADS];
+    bool pageThreadThumbnail[MUSICALPI_THREADS];   // thread is rendering a thumbnail (into thumbImages) not a page
+
+    // Thumbnails wanted (one screen back, two forward), and whether a pass of makeThumbnails is already queued
+    int thumbRangeStart;
+    int thumbRangeEnd;
+    bool thumbnailsScheduled;
 
     // Target range for cache (it's a moving target so may or may not actually be present)
     int cacheRangeStart;  // Beginning page (ref 1)
     int cacheRangeEnd;    // End page (ref 1)
+    int cacheFocus;       // Leftmost page shown, where caching starts
     int maxCache;
     int totalPagesRendered; // Used as a slight optimization, we only use "up" pages until we have rendered that many so the first "up" come up fast.
     int totalPagesRequested; // as above.
@@ -57,6 +73,7 @@ signals:
 
 private slots:
     void updateImage(int which, int page, int maxWidth, int maxHeight);
+    void makeThumbnails();
 
 };
 
@@ -9,10 +9,80 @@
 
 #define MUSICALPI_MAXPAGES 1000   // Maximum pages in any PDF -- minimal impact to make bigger
 
-// review/play screen maximum "up" sizes - moderate memory impact if larger (but indirect large impact on cache as below)
+// review/play screen panes are created as grids are asked for, so there is no maximum "up" size.  Grids whose cells are
+// well under the cached page size (e.g. 4 x 2 and the overview) are filled with thumbnails made from cached pages,
+// this many per pass through the event loop so a large grid never blocks the screen.
 
-#define MUSICALPI_MAXROWS 2
-#define MUSICALPI_MAXCOLUMNS 4
+#define MUSICALPI_THUMBNAILS_PER_PASS 4
+
+// Zoom (review mode only) goes in steps of this factor, up to the max number of steps.  Zoomed pages are rendered
+// in square tiles this many pixels on a side, kept in a cache whose size is a setting (tileCacheMB).
+
+#define MUSICALPI_ZOOM_STEP 1.25
+#define MUSICALPI_ZOOM_MAX_LEVEL 12
+#define MUSICALPI_TILE_SIZE 256
+
+// The library is read on a thread (librarythread.h) and sent to the view this many rows at a time
+
+#define MUSICALPI_LIBRARY_CHUNK_ROWS 250
+
+// Library column widths are set from this many rows spread through the library, rather than measuring every row
+
+#define MUSICALPI_LIBRARY_WIDTH_SAMPLES 200
+
+// Library searches this long or longer also find titles, authors and collections within this many typing mistakes
+
+#define MUSICALPI_FUZZY_MIN_LENGTH 6
+#define MUSICALPI_FUZZY_MAX_EDITS 2
+
+// Calibre's database is checked for changes this often (it is also watched, but network shares may not report changes),
+// and after a change is reported this long is left for writes to settle before looking
+
+#define MUSICALPI_LIBRARY_POLL_MS 5000
+#define MUSICALPI_LIBRARY_SETTLE_MS 500
+
+// Library reads give up after this long if Calibre has the database locked (and are retried on the next change), but
+// our own playlist writes wait this much longer for it
+
+#define MUSICALPI_LIBRARY_BUSY_MS 250
+#define MUSICALPI_LIBRARY_WRITE_BUSY_MS 5000
+
+// Library thumbnails (see thumbnailThread) are kept in memory for this many books, most recently made or shown
+
+#define MUSICALPI_THUMBNAILS_KEPT 1000
+
+// Books with at least this many pages are looked through for the songs in them (see bookInfo), from the outline or
+// else from titles: text near the top of a page at least this many times the usual height on it
+
+#define MUSICALPI_SONG_INDEX_MIN_PAGES 6
+#define MUSICALPI_SONG_TITLE_SCALE 1.5
+
+// Library searches this long or longer, once typing has paused this long, also look through the words on each page
+// (see textIndex) for up to this many of the pages that best match
+
+#define MUSICALPI_TEXT_SEARCH_MIN_LENGTH 4
+#define MUSICALPI_TEXT_SEARCH_DELAY_MS 300
+#define MUSICALPI_TEXT_SEARCH_RESULTS 50
+
+// Books played are scored (see usageLog) by opens, and time open counting as an open every this long, halving every
+// this many days; this many are kept.  The library offers the best few at the top, and has the first pages of the
+// best of those rendered ahead into the page cache (see pageCache) while it's idle.
+
+#define MUSICALPI_USAGE_HALF_LIFE_DAYS 14
+#define MUSICALPI_USAGE_MS_PER_OPEN (10 * 60 * 1000)
+#define MUSICALPI_USAGE_KEPT 200
+#define MUSICALPI_QUICK_ACCESS_BOOKS 8
+#define MUSICALPI_PRERENDER_BOOKS 4
+
+// Books in a playlist are this far apart in position (see playListOrder), so one can be moved between two others
+// without renumbering the list
+
+#define MUSICALPI_PLAYLIST_GAP 100
+
+// A library row selected (rather than touched, e.g. arrowing through the table) is opened ahead only once the
+// selection has stayed on it this long, so moving through rows doesn't open each one
+
+#define MUSICALPI_OPEN_AHEAD_DELAY_MS 250
 
 // A Good rule of thumb is cores - 1
 
@@ -28,6 +98,14 @@
 // Define this to get colored borders on key widgets (from stylesheet in main)
 //#define MUSICALPI_DEBUG_WIDGET_BORDERS
 
+// Define this to check the page turn path by hand.  While playing, F12 then runs the scripted turns below:
+// once to warm up, once counting heap allocations (see allocationcounter.h), and once timed including the
+// repaint.  It asserts our own code made no allocations (the update and timer calls into Qt, which do
+// allocate, are reported but not counted) and that no stage changed pixel format (nothing was converted).
+// Nothing runs this automatically, so it is only as current as the last time someone pressed F12.
+//#define MUSICALPI_DEBUG_PAGE_TURN_CHECK
+#define MUSICALPI_DEBUG_PAGE_TURN_CHECK_TURNS 10
+
 // SplashBackend seems to render better quality and only slightly slower (based on 2017 testing -- may be different now)
 
 //#define MUSICALPI_POPPLER_BACKEND Poppler::Document::RenderBackend::SplashBackend
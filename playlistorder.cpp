@@ -0,0 +1,180 @@
+// Copyright 2023 by Linwood Ferguson, licensed under GNU GPLv3
+
+#include <QDebug>
+#include <QDir>
+#include <QStandardPaths>
+#include <QSqlDatabase>
+#include <QSqlQuery>
+#include <QSqlError>
+
+#include "playlistorder.h"
+#include "piconstants.h"
+
+#include <algorithm>
+
+playListOrder::playListOrder(const QString& connectionName)
+{
+    connection = connectionName;
+    QString folder = QStandardPaths::writableLocation(QStandardPaths::AppLocalDataLocation);
+    QDir().mkpath(folder);
+    QSqlDatabase db = QSqlDatabase::addDatabase("QSQLITE", connection);
+    db.setDatabaseName(folder + "/playlists.db");
+    open = db.open();
+    QSqlQuery query(db);
+    open = open && exec(query, "CREATE TABLE IF NOT EXISTS entries (list TEXT NOT NULL, position INTEGER NOT NULL, book INTEGER NOT NULL, PRIMARY KEY (list, position)) WITHOUT ROWID;")
+                && exec(query, "CREATE INDEX IF NOT EXISTS entriesByBook ON entries (list, book);");
+    if(!open) qDebug() << "Playlist order " << db.databaseName() << " could not be opened";
+}
+
+playListOrder::~playListOrder()
+{
+    {   // Scope so the database object is gone before we remove the connection
+        QSqlDatabase::database(connection, false).close();
+    }
+    QSqlDatabase::removeDatabase(connection);
+}
+
+bool playListOrder::exec(QSqlQuery& query, const QString& sql, const QVariantList& values)
+{
+    query.prepare(sql);
+    for(int i = 0; i < values.size(); i++) query.bindValue(i, values[i]);
+    if(query.exec()) return true;
+    qDebug() << sql << " resulted in error " << query.lastError();
+    return false;
+}
+
+QString playListOrder::tagName(const QString& prefix, int position)
+{
+    return prefix + "|" + QString::number(position).rightJustified(2, '0');  // (as lists were first numbered, 01 on)
+}
+
+bool playListOrder::sync(const QString& list, QList<entry> calibreEntries)
+{
+    std::sort(calibreEntries.begin(), calibreEntries.end(), [](const entry& a, const entry& b) { return a.position < b.position; });
+    QList<entry> ours = entries(list);
+    bool same = ours.size() == calibreEntries.size();
+    for(int i = 0; same && i < ours.size(); i++) same = ours[i].position == calibreEntries[i].position && ours[i].book == calibreEntries[i].book;
+    if(same || !open) return false;
+    qDebug() << "Playlist " << list << " changed in Calibre, now " << calibreEntries.size() << " books";
+    QSqlDatabase db = QSqlDatabase::database(connection, false);
+    db.transaction();
+    QSqlQuery query(db);
+    bool ok = exec(query, "delete from entries where list = ?", {list});
+    for(int i = 0; ok && i < calibreEntries.size(); i++)
+        ok = exec(query, "insert or replace into entries (list, position, book) values (?, ?, ?)", {list, calibreEntries[i].position, calibreEntries[i].book});
+    if(ok) db.commit();
+    else db.rollback();
+    return ok;
+}
+
+void playListOrder::keepOnly(const QStringList& lists)
+{
+    if(!open) return;
+    QSqlQuery query(QSqlDatabase::database(connection, false));
+    QStringList gone;
+    if(exec(query, "select distinct list from entries"))
+        while(query.next())
+            if(!lists.contains(query.value(0).toString())) gone.append(query.value(0).toString());
+    for(const QString& list : gone) exec(query, "delete from entries where list = ?", {list});
+}
+
+QList<playListOrder::entry> playListOrder::entries(const QString& list)
+{
+    QList<entry> result;
+    if(!open) return result;
+    QSqlQuery query(QSqlDatabase::database(connection, false));
+    query.setForwardOnly(true);
+    if(exec(query, "select position, book from entries where list = ? order by position", {list}))
+        while(query.next()) result.append({query.value(0).toInt(), query.value(1).toInt()});
+    return result;
+}
+
+QHash<QString,int> playListOrder::positions(const QString& list)
+{
+    QHash<QString,int> result;
+    for(const entry& thisEntry : entries(list)) result.insert(QString::number(thisEntry.book), thisEntry.position);
+    return result;
+}
+
+int playListOrder::position(const QString& list, int book)
+{
+    if(!open) return -1;
+    QSqlQuery query(QSqlDatabase::database(connection, false));
+    if(!exec(query, "select min(position) from entries where list = ? and book = ?", {list, book}) || !query.next() || query.value(0).isNull()) return -1;
+    return query.value(0).toInt();
+}
+
+int playListOrder::lastPosition(const QString& list)
+{
+    if(!open) return 0;
+    QSqlQuery query(QSqlDatabase::database(connection, false));
+    if(!exec(query, "select max(position) from entries where list = ?", {list}) || !query.next()) return 0;
+    return query.value(0).toInt();  // (null, so 0, if empty)
+}
+
+int playListOrder::neighbour(const QString& list, int position, bool before)
+{
+    QSqlQuery query(QSqlDatabase::database(connection, false));
+    if(!exec(query, before ? "select max(position) from entries where list = ? and position < ?" : "select min(position) from entries where list = ? and position > ?", {list, position})
+       || !query.next() || query.value(0).isNull()) return -1;
+    return query.value(0).toInt();
+}
+
+bool playListOrder::add(const QString& list, int position, int book)
+{
+    if(!open) return false;
+    QSqlQuery query(QSqlDatabase::database(connection, false));
+    return exec(query, "insert or replace into entries (list, position, book) values (?, ?, ?)", {list, position, book});
+}
+
+bool playListOrder::remove(const QString& list, int book)
+{
+    if(!open) return false;
+    QSqlQuery query(QSqlDatabase::database(connection, false));
+    return exec(query, "delete from entries where list = ? and book = ?", {list, book});
+}
+
+playListOrder::renames playListOrder::move(const QString& list, int book, int places)
+{
+    renames result;
+    int from = position(list, book);
+    if(from < 0 || places == 0) return result;
+    // Step to the books it goes between (the far one 0, or a gap past the end, if there's none)
+    int near = from;
+    for(int i = 0; i < std::abs(places) && near >= 0; i++) near = neighbour(list, near, places < 0);
+    if(near < 0) return result;   // Already first (or last)
+    int far = neighbour(list, near, places < 0);
+    if(far < 0) far = places < 0 ? 0 : near + 2 * MUSICALPI_PLAYLIST_GAP;
+    int to = (near + far) / 2;
+    QSqlQuery query(QSqlDatabase::database(connection, false));
+    if(to != near && to != far)
+    {
+        if(exec(query, "update entries set position = ? where list = ? and position = ?", {to, list, from})) result.append(qMakePair(from, to));
+        return result;
+    }
+
+    // No room between them, so number the list again (in its new order) with gaps
+    QList<entry> ordered = entries(list);
+    int at = 0;
+    while(at < ordered.size() && ordered[at].position != from) at++;
+    if(at == ordered.size()) return result;
+    entry moving = ordered.takeAt(at);
+    at = std::max(0, std::min((int)ordered.size(), at + places));
+    ordered.insert(at, moving);
+    QSqlDatabase db = QSqlDatabase::database(connection, false);
+    db.transaction();
+    bool ok = exec(query, "delete from entries where list = ?", {list});
+    for(int i = 0; ok && i < ordered.size(); i++)
+    {
+        int renumbered = (i + 1) * MUSICALPI_PLAYLIST_GAP;
+        ok = exec(query, "insert into entries (list, position, book) values (?, ?, ?)", {list, renumbered, ordered[i].book});
+        if(ordered[i].position != renumbered) result.append(qMakePair(ordered[i].position, renumbered));
+    }
+    if(ok) db.commit();
+    else
+    {
+        db.rollback();
+        result.clear();
+    }
+    return result;
+}
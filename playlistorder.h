@@ -0,0 +1,55 @@
+#ifndef PLAYLISTORDER_H
+#define PLAYLISTORDER_H
+
+// Copyright 2023 by Linwood Ferguson, licensed under GNU GPLv3
+
+#include <QString>
+#include <QStringList>
+#include <QList>
+#include <QHash>
+#include <QPair>
+#include <QVariant>
+
+class QSqlQuery;
+
+// The order of the books in each playlist, kept in our own SQLite database on local storage and indexed by list and
+// position (and by list and book), so showing a list in order, adding to its end, and moving or taking out a book
+// are each a few index lookups, never a look through Calibre's tags.
+//
+// Calibre still holds the lists: each book in one has its own tag, the list's name then "|" and its position, and
+// every change here is written there too (see musicLibrary), by those exact names.  Positions have gaps between them
+// (MUSICALPI_PLAYLIST_GAP), so a book moved goes between its new neighbours without the others changing; only if
+// there is no room left is the list numbered again.  When the playlists are loaded each list is made to match what
+// Calibre has, so changes made in Calibre itself come through.
+
+class playListOrder
+{
+public:
+    struct entry
+    {
+        int position;
+        int book;
+    };
+    typedef QList<QPair<int,int>> renames;    // (old, new) positions, to rename the tags of
+
+    playListOrder(const QString& connectionName);
+    ~playListOrder();
+    bool sync(const QString& list, QList<entry> entries);  // Make it what Calibre has; false if it was already
+    void keepOnly(const QStringList& lists);         // Forget any others (gone from Calibre)
+    QList<entry> entries(const QString& list);       // In order
+    QHash<QString,int> positions(const QString& list);  // Position of each book, by id (as the library has them)
+    int position(const QString& list, int book);     // -1 if it's not in the list
+    int lastPosition(const QString& list);           // 0 if the list is empty
+    bool add(const QString& list, int position, int book);
+    bool remove(const QString& list, int book);
+    renames move(const QString& list, int book, int places);  // Earlier (negative) or later by places; none if it can't
+    static QString tagName(const QString& prefix, int position);  // prefix is the list's tag without the position
+
+private:
+    QString connection;
+    bool open;
+    bool exec(QSqlQuery& query, const QString& sql, const QVariantList& values = QVariantList());  // Logs any error
+    int neighbour(const QString& list, int position, bool before);  // Position next to it, -1 if none
+};
+
+#endif // PLAYLISTORDER_H
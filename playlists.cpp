@@ -45,6 +45,8 @@ playLists::playLists(MainWindow* parent, musicLibrary* lib, QString thisTitle, i
     dropdown->setObjectName("dropdown");
     dropdown->setView(listDropdown);
     changeState = new QPushButton(this);
+    moveEarlier = new QPushButton(this);
+    moveLater = new QPushButton(this);
 
     // Show our title
     gl->addWidget(titlePrompt,0,0,1,2,Qt::AlignCenter);
@@ -53,30 +55,34 @@ playLists::playLists(MainWindow* parent, musicLibrary* lib, QString thisTitle, i
     gl->addWidget(changePrompt,1,0,1,2,Qt::AlignLeft);
     gl->addWidget(dropdown,    2,0,1,1,Qt::AlignLeft); // Note we don't put the qlistview here or for reasons unclear it screws up.
     gl->addWidget(changeState, 2,1,1,1,Qt::AlignRight);
+    gl->addWidget(moveEarlier, 3,0,1,1,Qt::AlignLeft);
+    gl->addWidget(moveLater,   3,1,1,1,Qt::AlignRight);
 
     // Separator line
     hline = new QFrame(this);
     hline->setFrameShape(QFrame::HLine);
     hline->setFrameShadow(QFrame::Sunken);
-    gl->addWidget(hline,    3,0,1,2);
+    gl->addWidget(hline,    4,0,1,2);
     hline->setFixedHeight(30);
 
     // To create a new list
     addPrompt = new QLabel(this);
     newList = new QLineEdit(this);
     saveNew = new QPushButton(this);
-    gl->addWidget(addPrompt,4,0,1,2,Qt::AlignLeft);
-    gl->addWidget(newList,  5,0,1,1,Qt::AlignLeft);
-    gl->addWidget(saveNew,  5,1,1,1,Qt::AlignRight);
+    gl->addWidget(addPrompt,5,0,1,2,Qt::AlignLeft);
+    gl->addWidget(newList,  6,0,1,1,Qt::AlignLeft);
+    gl->addWidget(saveNew,  6,1,1,1,Qt::AlignRight);
 
     errorMsg = new QLabel(this);
-    gl->addWidget(errorMsg, 6,0,1,2,Qt::AlignLeft);
+    gl->addWidget(errorMsg, 7,0,1,2,Qt::AlignLeft);
 
     titlePrompt->setText("Song: " + mTitle);
     titlePrompt->setProperty("Heading",true);
 
     changePrompt->setText("Use dropdown to pick a list to change as indicated");
     changeState->setText("Save");
+    moveEarlier->setText("Move earlier");
+    moveLater->setText("Move later");
 
     addPrompt->setText("Use this to add entirely new list (title is added automatically):");
     saveNew->setText("Add New");
@@ -90,7 +96,10 @@ playLists::playLists(MainWindow* parent, musicLibrary* lib, QString thisTitle, i
     connect(dropdown,SIGNAL(currentIndexChanged(int)),this,SLOT(changeList(int)));
     connect(newList,SIGNAL(textChanged(QString)),this,SLOT(newListChanged(QString)));
     connect(changeState,SIGNAL(pressed()),this,SLOT(doChangeState()));
+    connect(moveEarlier,SIGNAL(pressed()),this,SLOT(doMoveEarlier()));
+    connect(moveLater,SIGNAL(pressed()),this,SLOT(doMoveLater()));
     connect(saveNew,SIGNAL(pressed()),this,SLOT(doSaveNew()));
+    connect(mMusicLibrary,SIGNAL(playListWritten(QString)),this,SLOT(written(QString)));
 
     this->setLayout(gl);
     this->show();
@@ -104,9 +113,10 @@ void playLists::loadDropdown()
     // The musicLibrary knows this info already, for loading we just load its dropdown data (which it persists)
     dropdown->clear();
     dropdown->addItem("Pull down to select list/action",0);
+    QSet<QString> lists = mMusicLibrary->listsContainingBook(mMusicLibrary->bookIDSelected);  // Known already, no need to ask the database
     for(int i=1; i < mMusicLibrary->dropdown->count(); i++)     // Skip zero which is the "All lists"; if we have no others this is empty
     {
-        if(mMusicLibrary->bookInList(mMusicLibrary->dropdown->itemData((i)).toInt()))
+        if(lists.contains(mMusicLibrary->dropdown->itemText(i)))
             dropdown->addItem("Remove: " + mMusicLibrary->dropdown->itemText(i) + " (already present)",mMusicLibrary->dropdown->itemData(i));
         else
             dropdown->addItem("Add into: " + mMusicLibrary->dropdown->itemText(i),mMusicLibrary->dropdown->itemData(i));
@@ -119,6 +129,9 @@ void playLists::changeList(int newIndex)
     qDebug() << "new index = " << newIndex << ", which is " << dropdown->itemText(newIndex) << " with value " << dropdown->itemData(newIndex).toInt();
     if(newIndex == 0) changeState->hide();
     else changeState->show();
+    bool inList = dropdown->itemText(newIndex).startsWith("Remove");  // Only a list it's in has a place to move it from
+    moveEarlier->setVisible(inList);
+    moveLater->setVisible(inList);
 }
 
 void playLists::newListChanged(QString val)
@@ -134,19 +147,31 @@ void playLists::doChangeState()
     if(dropdown->currentText().left(3)=="Add") result = mMusicLibrary->addBookToList(dropdown->currentIndex());
     else result = mMusicLibrary->removeBookFromList(dropdown->currentIndex());
     errorMsg->setText(result);
-    if(result=="")
-    {
-        loadDropdown();
-    }
+    loadDropdown();  // Shows the change already, it's written in the background
+}
+
+void playLists::doMoveEarlier()
+{
+    errorMsg->setText(mMusicLibrary->moveBookInList(dropdown->currentIndex(), -1));  // (still in the same lists, so the dropdown stays)
 }
+
+void playLists::doMoveLater()
+{
+    errorMsg->setText(mMusicLibrary->moveBookInList(dropdown->currentIndex(), 1));
+}
+
 void playLists::doSaveNew()
 {
     QString result;
     result = mMusicLibrary->addNewList(mMusicLibrary->calibreListPrefix + newList->text());
     errorMsg->setText(result);
-    if(result=="")
-    {
-        loadDropdown();
-        newList->setText("");
-    }
+    loadDropdown();
+    if(!result.endsWith(" already exists")) newList->setText("");  // Otherwise leave it to be changed
+}
+
+void playLists::written(QString result)
+{
+    // A change finished writing; if it failed it has been undone, so show that too
+    errorMsg->setText(result);
+    loadDropdown();
 }
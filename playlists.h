@@ -38,6 +38,7 @@ private:
             QLabel* titlePrompt;
             QLabel* changePrompt;
             QComboBox*   dropdown; QListView*   listDropdown; /*view of dropdown */   QPushButton* changeState;
+            QPushButton* moveEarlier;  QPushButton* moveLater;   // Only for lists it's in
             QFrame*      hline;
             QLabel*      addPrompt;
             QLineEdit*   newList;    QPushButton* saveNew;
@@ -49,7 +50,10 @@ public slots:
     void changeList(int);
     void newListChanged(QString);
     void doChangeState();
+    void doMoveEarlier();
+    void doMoveLater();
     void doSaveNew();
+    void written(QString);
 
 };
 
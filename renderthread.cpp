@@ -7,6 +7,7 @@
 #include "pdfdocument.h"
 #include "mainwindow.h"
 #include "oursettings.h"
+#include "pagecache.h"
 
 #include <cassert>
 #include <cmath>
@@ -66,32 +67,52 @@ void renderThread::render(QImage** image, int thePage, int maxWidth, int maxHeig
     return;
 }
 
+QImage renderThread::renderPage(Poppler::Document* document, int page, int maxWidth, int maxHeight, QImage::Format format)
+{
+    document->setRenderBackend(MUSICALPI_POPPLER_BACKEND);
+    std::unique_ptr<Poppler::Page> tmpPage = document->page(page - 1);
+    assert(tmpPage!=NULL);
+    double scaleFactor = (double)144.0;
+    QSizeF thisPageSize = tmpPage->pageSizeF();  // in 72's of inch
+    double scaleX = (double)maxWidth / ((double)thisPageSize.width() / scaleFactor);
+    double scaleY = (double)maxHeight / ((double)thisPageSize.height() / scaleFactor);
+    double desiredScale = std::trunc(std::min(scaleX, scaleY));  // For notational scores integers seem to give better alignment, sometimes.
+
+    document->setRenderHint(Poppler::Document::Antialiasing, true);    // Note you can't ignore paper color as some PDF's apparently come up black backgrounds
+    document->setRenderHint(Poppler::Document::TextAntialiasing, true);
+    document->setRenderHint(Poppler::Document::TextHinting, false);
+    document->setRenderHint(Poppler::Document::OverprintPreview, false);
+    document->setRenderHint(Poppler::Document::ThinLineSolid,true);
+    QImage rendered = tmpPage->renderToImage(desiredScale,desiredScale);
+    qDebug() << "Page " << page << ", pt size " << thisPageSize.width() << "x" << thisPageSize.height() << " at scale " << desiredScale << " produced size " << rendered.width() << "x" << rendered.height();
+
+    // The render is done at about twice the size for quality; scale it down to fit the requested size, and into the
+    // native format page frames are composed in, here rather than on every page turn, so placing it in play mode is just a copy.
+    if(rendered.width() > maxWidth || rendered.height() > maxHeight)
+        rendered = rendered.scaled(maxWidth, maxHeight, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+    if(rendered.format() != format) rendered.convertTo(format);
+    return rendered;
+}
+
 void renderThread::run()
 {
     forever
     {
         running = true;
-        qDebug()<<"Opening PDF document inside of thread now " << ourParent->filepath;
-        document = Poppler::Document::load(ourParent->filepath);
-        document->setRenderBackend(MUSICALPI_POPPLER_BACKEND);
-        assert(document && !document->isLocked());
-        std::unique_ptr<Poppler::Page> tmpPage = document->page(mPage - 1);
-        assert(tmpPage!=NULL);
-        double scaleFactor = (double)144.0;
-        QSizeF thisPageSize = tmpPage->pageSizeF();  // in 72's of inch
-        double scaleX = (double)mWidth / ((double)thisPageSize.width() / scaleFactor);
-        double scaleY = (double)mHeight / ((double)thisPageSize.height() / scaleFactor);
-        double desiredScale = std::trunc(std::min(scaleX, scaleY));  // For notational scores integers seem to give better alignment, sometimes.
-
-        qDebug() << "Starting render on thread " << mWhich << " id " << currentThreadId() << " for page " << mPage << ", pt size " << thisPageSize.width() << "x" << thisPageSize.height() << " at scale " << desiredScale << " targeting " << mWidth << "x" << mHeight;
-        document->setRenderHint(Poppler::Document::Antialiasing, true);    // Note you can't ignore paper color as some PDF's apparently come up black backgrounds
-        document->setRenderHint(Poppler::Document::TextAntialiasing, true);
-        document->setRenderHint(Poppler::Document::TextHinting, false);
-        document->setRenderHint(Poppler::Document::OverprintPreview, false);
-        document->setRenderHint(Poppler::Document::ThinLineSolid,true);
-        QImage* theImage = new QImage(tmpPage->renderToImage(desiredScale,desiredScale));
+        // Pages of books opened often are rendered ahead, while the library is idle (see pageCache)
+        QImage rendered = pageCache::find(ourParent->filepath, ourParent->info.modified, mPage, QSize(mWidth, mHeight));
+        if(!rendered.isNull()) qDebug() << "Page " << mPage << " was found in the page cache on thread " << mWhich;
+        else
+        {
+            qDebug()<<"Opening PDF document inside of thread now " << ourParent->filepath;
+            document = Poppler::Document::load(ourParent->filepath);
+            assert(document && !document->isLocked());
+            qDebug() << "Starting render on thread " << mWhich << " id " << currentThreadId() << " for page " << mPage << " targeting " << mWidth << "x" << mHeight;
+            rendered = renderPage(document.get(), mPage, mWidth, mHeight, mParent->pageImageFormat);
+        }
+        if(rendered.format() != mParent->pageImageFormat) rendered.convertTo(mParent->pageImageFormat);
+        QImage* theImage = new QImage(rendered);
         assert(theImage);
-        qDebug() << "Page " << mPage << " was rendered on thread " << mWhich << " produced size " << theImage->width() << "x" << theImage->height();
 
         { // Put in a block so it will remove the painter and not leave it attached to the passed-out QImage
             QPainter painter(theImage);
@@ -21,6 +21,7 @@ public:
     renderThread(PDFDocument *parent=0, int which = -1, MainWindow* mp = 0);   // which is index of thread so we can find it on return
     ~renderThread();
     void render(QImage** image, int thisPage, int maxWidth, int maxHeight);
+    static QImage renderPage(Poppler::Document* document, int page, int maxWidth, int maxHeight, QImage::Format format);  // Starting page 1, without the page number (as pageCache keeps it)
 
 protected:
     void run() Q_DECL_OVERRIDE;
@@ -0,0 +1,246 @@
+// Copyright 2023 by Linwood Ferguson, licensed under GNU GPLv3
+
+#include "searchindex.h"
+
+#include <algorithm>
+#include <iterator>
+
+searchIndex::searchIndex()
+{
+    lastValid = false;
+    rankedCount = 0;
+}
+
+void searchIndex::clear()
+{
+    folded.clear();
+    postings.clear();
+    lastFound.clear();
+    lastValid = false;
+    spans.clear();
+}
+
+void searchIndex::setRankedFields(const QVector<int>& ranks)
+{
+    fieldRanks = ranks;
+    rankedCount = 0;
+    for(int rank : ranks) rankedCount = std::max(rankedCount, rank + 1);
+}
+
+void searchIndex::addRow(int row, const QStringList& fields)
+{
+    if(folded.size() <= row)
+    {
+        folded.resize(row + 1);
+        spans.resize((row + 1) * rankedCount);
+    }
+    QString& f = folded[row];
+    f.clear();
+    for(int field = 0; field < fields.size(); field++)
+    {
+        int rank = fieldRanks.value(field, -1);
+        if(rank >= 0) spans[row * rankedCount + rank] = ((quint32)std::min(f.size(), (qsizetype)0xFFFF) << 16) | (quint32)std::min(fields[field].size(), (qsizetype)0xFFFF);
+        f += fields[field].toCaseFolded();  // Simple folding, so lengths (and so spans) are unchanged
+        f += QChar('\n');                   // so a search can't match across fields
+    }
+    for(int i = 0; i + 3 <= f.size(); i++)
+    {
+        QVector<int>& rows = postings[trigram(f.constData() + i)];
+        if(rows.isEmpty() || rows.last() != row) rows.append(row);  // once per row however often it appears
+    }
+    lastValid = false;  // A row the last result doesn't know about
+}
+
+bool searchIndex::rowContains(int row, const QString& text)
+{
+    if(text.isEmpty()) return true;
+    return row < folded.size() && folded[row].contains(text.toCaseFolded());
+}
+
+const QVector<int>& searchIndex::find(const QString& text)
+{
+    QString f = text.toCaseFolded();
+    bool narrowing = lastValid && f.contains(lastFolded);  // Anything matching this matched the last search too
+
+    // Start from the shortest trigram list (or the last result if that is shorter), then intersect with the rest
+    QVector<const QVector<int>*> lists;
+    for(int i = 0; i + 3 <= f.size(); i++)
+    {
+        auto found = postings.constFind(trigram(f.constData() + i));
+        if(found == postings.constEnd())
+        {
+            lastFolded = f;
+            lastFound.clear();
+            lastValid = true;
+            return lastFound;  // A trigram no row has
+        }
+        lists.append(&found.value());
+    }
+    if(narrowing) lists.append(&lastFound);
+    std::sort(lists.begin(), lists.end(), [](const QVector<int>* a, const QVector<int>* b) { return a->size() < b->size(); });
+
+    QVector<int> candidates;
+    if(lists.isEmpty())  // Too short to index and nothing to narrow from, so every row
+    {
+        candidates.resize(folded.size());
+        for(int row = 0; row < folded.size(); row++) candidates[row] = row;
+    }
+    else
+    {
+        candidates = *lists[0];
+        QVector<int> both;
+        for(int l = 1; l < lists.size() && !candidates.isEmpty(); l++)
+        {
+            if(lists[l] == lists[l - 1]) continue;  // repeated trigram
+            both.clear();
+            std::set_intersection(candidates.begin(), candidates.end(), lists[l]->begin(), lists[l]->end(), std::back_inserter(both));
+            candidates.swap(both);
+        }
+    }
+
+    // Having every trigram doesn't mean they are together, so check the text itself
+    QVector<int> found;
+    found.reserve(candidates.size());
+    for(int row : candidates)
+        if(folded[row].contains(f)) found.append(row);
+    lastFolded = f;
+    lastFound.swap(found);
+    lastValid = true;
+    return lastFound;
+}
+
+quint64 searchIndex::fuzzyPattern::mask(QChar c) const
+{
+    if(c.unicode() < 128) return ascii[c.unicode()];
+    for(const QPair<QChar,quint64>& other : others)
+        if(other.first == c) return other.second;
+    return 0;
+}
+
+void searchIndex::preparePattern(const QString& text, fuzzyPattern& pattern)
+{
+    pattern.length = std::min(text.size(), (qsizetype)64);  // one machine word
+    std::fill(pattern.ascii, pattern.ascii + 128, 0);
+    pattern.others.clear();
+    for(int i = 0; i < pattern.length; i++)
+    {
+        QChar c = text[i];
+        if(c.unicode() < 128)
+        {
+            pattern.ascii[c.unicode()] |= (quint64)1 << i;
+            continue;
+        }
+        bool found = false;
+        for(QPair<QChar,quint64>& other : pattern.others)
+            if(other.first == c)
+            {
+                other.second |= (quint64)1 << i;
+                found = true;
+            }
+        if(!found) pattern.others.append(qMakePair(c, (quint64)1 << i));
+    }
+}
+
+int searchIndex::fuzzyDistance(const fuzzyPattern& pattern, const QChar* text, int length)
+{
+    // Myers' bit-vector algorithm, in the form that lets the match start anywhere in the text: the vertical deltas of a
+    // whole column of the edit distance matrix are kept in two words, so each text character costs a few word operations.
+    quint64 pv = ~(quint64)0;
+    quint64 mv = 0;
+    quint64 last = (quint64)1 << (pattern.length - 1);
+    int score = pattern.length;
+    int best = score;
+    for(int i = 0; i < length && best > 0; i++)
+    {
+        quint64 eq = pattern.mask(text[i]);
+        quint64 xv = eq | mv;
+        quint64 xh = (((eq & pv) + pv) ^ pv) | eq;
+        quint64 ph = mv | ~(xh | pv);
+        quint64 mh = pv & xh;
+        if(ph & last) score++;
+        else if(mh & last) score--;
+        ph <<= 1;  // (no carry in: a match may begin at any character)
+        mh <<= 1;
+        pv = mh | ~(xv | ph);
+        mv = ph & xv;
+        best = std::min(best, score);
+    }
+    return best;
+}
+
+int searchIndex::bestField(int row, const QString& text, const fuzzyPattern* pattern, int maxDistance, int& distance)
+{
+    // Best (distance, rank) over the ranked fields, or rank rankedCount for an exact match elsewhere; -1 if none is close enough
+    const QString& f = folded[row];
+    int bestRank = -1;
+    distance = maxDistance + 1;
+    for(int rank = 0; rank < rankedCount; rank++)
+    {
+        quint32 span = spans[row * rankedCount + rank];
+        int start = span >> 16;
+        int length = span & 0xFFFF;
+        int d;
+        if(QStringView(f).mid(start, length).contains(text)) d = 0;
+        else if(pattern) d = fuzzyDistance(*pattern, f.constData() + start, length);
+        else continue;
+        if(d < distance)
+        {
+            distance = d;
+            bestRank = rank;
+            if(d == 0) break;  // ranks are in order, so nothing later can beat this
+        }
+    }
+    if(bestRank == -1 && f.contains(text))
+    {
+        distance = 0;
+        bestRank = rankedCount;
+    }
+    return bestRank;
+}
+
+const QVector<QPair<int,int>>& searchIndex::findRanked(const QString& text)
+{
+    ranked.clear();
+    QString f = text.toCaseFolded();
+
+    // Allow more mistakes in longer searches, but few enough that a close row still shares a trigram with the search
+    // (each edit can spoil at most three, so it shares at least trigrams - 3 * edits).
+    int trigrams = f.size() - 2;
+    int maxDistance = f.size() < MUSICALPI_FUZZY_MIN_LENGTH ? 0 : std::min(MUSICALPI_FUZZY_MAX_EDITS, (int)((f.size() - 2) / 4));
+    int needed = trigrams - 3 * maxDistance;
+
+    QVector<int> candidates;
+    if(maxDistance == 0 || needed < 1)
+    {
+        candidates = find(text);  // Exact matches only
+        maxDistance = 0;
+    }
+    else
+    {
+        // Count the distinct search trigrams each row has, and check only rows with enough
+        trigramHits.fill(0, folded.size());
+        QVector<quint64> seen;
+        for(int i = 0; i + 3 <= f.size(); i++)
+        {
+            quint64 t = trigram(f.constData() + i);
+            if(seen.contains(t)) continue;
+            seen.append(t);
+            auto found = postings.constFind(t);
+            if(found == postings.constEnd()) continue;
+            for(int row : found.value())
+                if(trigramHits[row] < 255) trigramHits[row]++;
+        }
+        for(int row = 0; row < folded.size(); row++)
+            if(trigramHits[row] >= needed) candidates.append(row);
+    }
+
+    fuzzyPattern pattern;
+    if(maxDistance > 0) preparePattern(f, pattern);
+    for(int row : candidates)
+    {
+        int distance;
+        int rank = bestField(row, f, maxDistance > 0 ? &pattern : NULL, maxDistance, distance);
+        if(rank >= 0) ranked.append(qMakePair(row, distance * (rankedCount + 1) + rank));
+    }
+    return ranked;
+}
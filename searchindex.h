@@ -0,0 +1,61 @@
+#ifndef SEARCHINDEX_H
+#define SEARCHINDEX_H
+
+// Copyright 2023 by Linwood Ferguson, licensed under GNU GPLv3
+
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <QHash>
+#include <QPair>
+#include "piconstants.h"
+
+// Substring search over the library for as-you-type filtering.  Each row's searchable text is case folded once
+// as it is loaded, and every three character sequence (trigram) in it is indexed, so a search only checks the rows
+// that contain all of the search's trigrams.  Typing more of the same search narrows from the last result rather
+// than starting over.
+//
+// findRanked also allows for misspellings in a few fields (title, author, collection), ranking rows by how close
+// the best match is and in which field.  Rows close enough to a search still share some of its trigrams, so only
+// those are checked, using a bit-parallel edit distance (Myers) that handles a whole search of up to 64 characters
+// per step.
+
+class searchIndex
+{
+public:
+    searchIndex();
+    void clear();
+    void setRankedFields(const QVector<int>& fieldRanks);  // For each field given to addRow, its rank (0 best) for findRanked, or -1
+    void addRow(int row, const QStringList& fields);       // Rows must be added in increasing order
+    const QVector<int>& find(const QString& text);         // Rows containing text (case insensitive), in increasing order
+    const QVector<QPair<int,int>>& findRanked(const QString& text);  // (row, score) for rows containing text or close to it in a ranked field; lower scores are better
+    bool rowContains(int row, const QString& text);        // Check one row (as find would), for rows added after a find
+
+private:
+    QVector<QString> folded;                 // folded[row] is the case folded text of that row, fields separated by newlines
+    QHash<quint64, QVector<int>> postings;   // trigram -> rows containing it, increasing
+    QString lastFolded;                      // Last search, and what it found, to narrow from
+    QVector<int> lastFound;
+    bool lastValid;
+
+    QVector<int> fieldRanks;
+    int rankedCount;                         // Number of ranked fields
+    QVector<quint32> spans;                  // rankedCount per row, by rank: start << 16 | length, within folded[row]
+    QVector<quint8> trigramHits;             // Scratch for findRanked, distinct search trigrams in each row
+    QVector<QPair<int,int>> ranked;
+
+    // Search prepared for the edit distance: a bit per search position for each character in it
+    struct fuzzyPattern
+    {
+        int length;
+        quint64 ascii[128];
+        QVector<QPair<QChar,quint64>> others;
+        quint64 mask(QChar c) const;
+    };
+    static void preparePattern(const QString& text, fuzzyPattern& pattern);
+    static int fuzzyDistance(const fuzzyPattern& pattern, const QChar* text, int length);  // Fewest edits to match somewhere in text
+    int bestField(int row, const QString& text, const fuzzyPattern* pattern, int maxDistance, int& distance);
+    static quint64 trigram(const QChar* c) { return ((quint64)c[0].unicode() << 32) | ((quint64)c[1].unicode() << 16) | (quint64)c[2].unicode(); }
+};
+
+#endif // SEARCHINDEX_H
@@ -77,6 +77,10 @@ void settingsWidget::loadData()
     new settingsItem(this, containingWidget, "calibreDatabase","Database file name (only):", "SettingStr");
     new settingsItem(this, containingWidget, "calibreMusicTag","Calibre tag for music items:","SettingStr");
     new settingsItem(this, containingWidget, "calibreListPrefix","Calibre tag for play lists items:","SettingStr");
+    new settingsItem(this, containingWidget, "calibreImmutable","Read library without locking (Calibre idle):");
+    new settingsItem(this, containingWidget, "calibreMmapMB","Library memory mapped reads (MB):",0,1024);
+    new settingsItem(this, containingWidget, "calibreCacheMB","Library page cache (MB):",1,256);
+    new settingsItem(this, containingWidget, "libraryThumbnailHeight","Library thumbnail height (0 for none):",0,200);
 
     subHeading("Embedded Midi Player (only type '.mid' accompany PDF's)");
 
@@ -94,6 +98,9 @@ void settingsWidget::loadData()
     new settingsItem(this, containingWidget, "overlaySidePortion","Screen % height of top area in play:",5,50);
     new settingsItem(this, containingWidget, "pageBorderWidth","Width of page border (between):",0,100);
     new settingsItem(this, containingWidget, "maxCache","Cache: Max number of pages kept:",5,100);
+    new settingsItem(this, containingWidget, "tileCacheMB","Cache: Zoomed tiles per page shown (MB):",8,1024);
+    new settingsItem(this, containingWidget, "overviewAcross","Overview grid, pages across:",1,20);
+    new settingsItem(this, containingWidget, "overviewDown","Overview grid, pages down:",1,20);
     new settingsItem(this, containingWidget, "overlayDuration","Duration of help overlay during play (ms):",0,5000);
     new settingsItem(this, containingWidget, "pageTurnDelay","Page turn, time to overwrite current page (ms):",0,5000);
     new settingsItem(this, containingWidget, "pageHighlightDelay","Page turn, time new page highlights:",0,5000);
@@ -108,6 +115,7 @@ void settingsWidget::loadData()
     new settingsItem(this, containingWidget, "debugMidiMeasureDetails","Debug output for each midi measure parsed:");
     new settingsItem(this, containingWidget, "debugQueueInfoInterval","Debug output rate (ms) for queue info:",10,20000);
     new settingsItem(this, containingWidget, "debugSettingsAsLoaded","Debug: output settings as read/written:");
+    new settingsItem(this, containingWidget, "debugPageTurnDetails","Debug output for each page turn:");
 
     errorSubHeading = new QLabel(containingWidget);
     errorSubHeading->setProperty("ErrorMessage",true);
@@ -0,0 +1,252 @@
+// Copyright 2023 by Linwood Ferguson, licensed under GNU GPLv3
+
+#include "tagfacets.h"
+
+#include <QtAlgorithms>
+
+#include <algorithm>
+
+tagFacets::tagFacets()
+{
+    matchAll = true;
+    for(int facet = 0; facet < facetCount; facet++) chosenValues.append(QString());
+    clear();
+}
+
+void tagFacets::clear()
+{
+    valueNumbers = QVector<QHash<QString,int>>(facetCount);
+    valueCounts.clear();
+    valueFacet.clear();
+    tagRows.clear();
+    valueRowList.clear();
+    rowValueStart.clear();
+    rowValues.clear();
+    liveRows.clear();
+    countedRows.clear();
+    selection.clear();
+    selecting = !selectedTags.isEmpty() || !chosenValues.join("").isEmpty();  // What's chosen stays chosen, for the rows to come
+}
+
+void tagFacets::set(QVector<quint64>& bits, int row, bool on)
+{
+    if(row / 64 >= bits.size()) bits.resize(row / 64 + 1);
+    if(on) bits[row / 64] |= (quint64)1 << (row % 64);
+    else bits[row / 64] &= ~((quint64)1 << (row % 64));
+}
+
+QStringList tagFacets::split(int facet, const QString& text)
+{
+    QStringList values;
+    if(facet == tags) values = text.split(',', Qt::SkipEmptyParts);
+    else if(facet == author)
+        for(const QString& name : text.split('&', Qt::SkipEmptyParts))  // ("Last, First & Last, First")
+        {
+            QString trimmed = name.trimmed();
+            if(!trimmed.isEmpty()) values.append(trimmed);
+        }
+    else if(!text.isEmpty()) values.append(text);
+    return values;
+}
+
+int tagFacets::valueNumber(int facet, const QString& value) const
+{
+    return valueNumbers[facet].value(value, -1);
+}
+
+void tagFacets::rowValueRange(int row, int& start, int& end) const
+{
+    if(row < 0 || row >= rowValueStart.size())
+    {
+        start = end = 0;
+        return;
+    }
+    start = rowValueStart[row];
+    end = row + 1 < rowValueStart.size() ? rowValueStart[row + 1] : rowValues.size();
+}
+
+bool tagFacets::rowHas(int row, int value) const
+{
+    if(value < 0) return false;
+    int start, end;
+    rowValueRange(row, start, end);
+    for(int i = start; i < end; i++) if(rowValues[i] == value) return true;
+    return false;
+}
+
+void tagFacets::addRow(int row, const QString& tagText, const QString& collectionText, const QString& authorText, bool counted)
+{
+    set(liveRows, row, true);
+    set(countedRows, row, counted);
+    while(rowValueStart.size() <= row) rowValueStart.append(rowValues.size());  // (rows with no values in between have none)
+    const QString* text[facetCount] = {&tagText, &collectionText, &authorText};
+    for(int facet = 0; facet < facetCount; facet++)
+        for(const QString& value : split(facet, *text[facet]))
+        {
+            auto found = valueNumbers[facet].constFind(value);
+            if(found == valueNumbers[facet].constEnd())
+            {
+                found = valueNumbers[facet].insert(value, valueCounts.size());
+                valueCounts.append(0);
+                valueFacet.append(facet);
+                tagRows.append(QVector<quint64>());
+                valueRowList.append(QVector<int>());
+            }
+            int number = found.value();
+            if(rowHas(row, number)) continue;  // (named twice)
+            rowValues.append(number);
+            if(counted) valueCounts[number]++;
+            if(facet == tags) set(tagRows[number], row, true);
+            else valueRowList[number].append(row);
+        }
+    // A row added while selecting is in the selection if it passes (rows are added only during loads, refreshes and searches)
+    if(!selecting) return;
+    bool pass = true;
+    if(!selectedTags.isEmpty())
+    {
+        pass = matchAll;
+        for(const QString& tag : selectedTags)
+            if(rowHas(row, valueNumber(tags, tag)) != matchAll)
+            {
+                pass = !matchAll;
+                break;
+            }
+    }
+    for(int facet = collection; facet < facetCount && pass; facet++)
+        if(!chosenValues[facet].isEmpty()) pass = rowHas(row, valueNumber(facet, chosenValues[facet]));
+    if(pass) set(selection, row, true);
+}
+
+void tagFacets::removeRow(int row)
+{
+    // Only this row's own values need their counts taking down (if it's a book) and, for tags, their bits clearing;
+    // a collection's or author's list keeps the row, as it's no longer live
+    if(!has(liveRows, row)) return;
+    bool wasCounted = has(countedRows, row);
+    int start, end;
+    rowValueRange(row, start, end);
+    for(int i = start; i < end; i++)
+    {
+        int value = rowValues[i];
+        if(wasCounted) valueCounts[value]--;
+        if(valueFacet[value] == tags) set(tagRows[value], row, false);
+    }
+    set(countedRows, row, false);
+    set(liveRows, row, false);
+    if(selecting) set(selection, row, false);
+}
+
+QStringList tagFacets::names(int facet) const
+{
+    QVector<QPair<int,QString>> byCount;  // (-count, name) so the sort puts the most used first
+    for(auto value = valueNumbers[facet].constBegin(); value != valueNumbers[facet].constEnd(); ++value)
+        if(valueCounts[value.value()] > 0) byCount.append(qMakePair(-valueCounts[value.value()], value.key()));  // (not those only on rows since taken out)
+    std::sort(byCount.begin(), byCount.end());
+    QStringList result;
+    for(const QPair<int,QString>& value : byCount) result.append(value.second);
+    return result;
+}
+
+QVector<quint64> tagFacets::within(int exceptFacet) const
+{
+    QVector<quint64> result = liveRows;
+    if(!selectedTags.isEmpty() && (exceptFacet != tags || matchAll))
+    {
+        static const QVector<quint64> none;
+        QVector<quint64> any(matchAll ? 0 : result.size(), 0);
+        for(const QString& tag : selectedTags)
+        {
+            int number = valueNumber(tags, tag);
+            const QVector<quint64>& rows = number < 0 ? none : tagRows[number];
+            for(int word = 0; word < result.size(); word++)
+            {
+                quint64 bits = word < rows.size() ? rows[word] : 0;
+                if(matchAll) result[word] &= bits;
+                else any[word] |= bits;
+            }
+        }
+        if(!matchAll)
+            for(int word = 0; word < result.size(); word++) result[word] &= any[word];
+    }
+    for(int facet = collection; facet < facetCount; facet++)
+        if(facet != exceptFacet && !chosenValues[facet].isEmpty())
+        {
+            // Its few rows as bits, to narrow the rest by
+            QVector<quint64> chosenRows(result.size(), 0);
+            int number = valueNumber(facet, chosenValues[facet]);
+            if(number >= 0)
+                for(int row : valueRowList[number])
+                    if(row / 64 < chosenRows.size()) chosenRows[row / 64] |= (quint64)1 << (row % 64);
+            for(int word = 0; word < result.size(); word++) result[word] &= chosenRows[word];
+        }
+    return result;
+}
+
+void tagFacets::select(const QStringList& tags, bool all)
+{
+    selectedTags = tags;
+    matchAll = all;
+    selecting = !selectedTags.isEmpty() || !chosenValues.join("").isEmpty();
+    if(selecting) selection = within(-1);
+}
+
+void tagFacets::choose(int facet, const QString& value)
+{
+    if(facet <= tags || facet >= facetCount) return;
+    chosenValues[facet] = value;
+    select(selectedTags, matchAll);
+}
+
+QHash<QString,int> tagFacets::counts(int facet) const
+{
+    QHash<QString,int> result;
+    bool narrowed = !selectedTags.isEmpty() && (facet != tags || matchAll);
+    for(int other = collection; other < facetCount; other++) narrowed = narrowed || (other != facet && !chosenValues[other].isEmpty());
+    if(!narrowed)
+    {
+        // Nothing else chosen, so it's the counts kept as rows came and went
+        for(auto value = valueNumbers[facet].constBegin(); value != valueNumbers[facet].constEnd(); ++value)
+            if(valueCounts[value.value()] > 0) result.insert(value.key(), valueCounts[value.value()]);
+        return result;
+    }
+    QVector<quint64> rows = within(facet);
+    for(int word = 0; word < rows.size(); word++) rows[word] &= word < countedRows.size() ? countedRows[word] : 0;
+    if(facet == tags)
+    {
+        // Few tags, on many rows each: count each tag's bits among them
+        for(auto value = valueNumbers[facet].constBegin(); value != valueNumbers[facet].constEnd(); ++value)
+        {
+            const QVector<quint64>& bits = tagRows[value.value()];
+            int count = 0;
+            for(int word = 0; word < bits.size() && word < rows.size(); word++) count += qPopulationCount(bits[word] & rows[word]);
+            if(count > 0) result.insert(value.key(), count);
+        }
+        return result;
+    }
+    // Many collections (or authors), on few rows each: go through the rows left, counting their own values
+    QVector<int> valueRowCounts(valueCounts.size(), 0);
+    for(int word = 0; word < rows.size(); word++)
+        for(quint64 bits = rows[word]; bits != 0; bits &= bits - 1)
+        {
+            int start, end;
+            rowValueRange(word * 64 + qCountTrailingZeroBits(bits), start, end);
+            for(int i = start; i < end; i++)
+                if(valueFacet[rowValues[i]] == facet) valueRowCounts[rowValues[i]]++;
+        }
+    for(auto value = valueNumbers[facet].constBegin(); value != valueNumbers[facet].constEnd(); ++value)
+        if(valueRowCounts[value.value()] > 0) result.insert(value.key(), valueRowCounts[value.value()]);
+    return result;
+}
+
+qint64 tagFacets::bytes() const
+{
+    qint64 total = (liveRows.capacity() + countedRows.capacity() + selection.capacity()) * sizeof(quint64)
+                 + valueCounts.capacity() * sizeof(int) + valueFacet.capacity()
+                 + (rowValueStart.capacity() + rowValues.capacity()) * sizeof(int);
+    for(const QVector<quint64>& bits : tagRows) total += sizeof(bits) + bits.capacity() * sizeof(quint64);
+    for(const QVector<int>& rows : valueRowList) total += sizeof(rows) + rows.capacity() * sizeof(int);
+    for(const QHash<QString,int>& numbers : valueNumbers)
+        for(auto value = numbers.constBegin(); value != numbers.constEnd(); ++value)
+            total += sizeof(QString) + sizeof(int) + value.key().size() * sizeof(QChar) + 16;  // (hash node and string header, roughly)
+    return total;
+}
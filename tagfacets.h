@@ -0,0 +1,65 @@
+#ifndef TAGFACETS_H
+#define TAGFACETS_H
+
+// Copyright 2023 by Linwood Ferguson, licensed under GNU GPLv3
+
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <QHash>
+
+// Which library rows have which tags, collection and authors, so choosing them and counting how many rows each would
+// leave need no query.  Tags are chosen several at a time (rows with all of them, or any of them); a collection and an
+// author one at a time, each narrowing what the others leave, so the library can be browsed down to a few books.
+//
+// There are a few hundred tags at most, each on many rows, so each has a bit per row and choosing and counting them
+// are a few word operations per 64 rows.  Collections and authors can number tens of thousands, each on a few rows,
+// where a bit per row each would take hundreds of MB, so each has just the list of its rows; and each row has the
+// list of its values (of every facet), so a row is counted, or taken out, by going through only its own.
+//
+// How many books have each value is kept as rows come and go, so the most used are known at once; how many of
+// those the other choices leave is counted when asked, from the rows they leave.  Song (and page) rows are chosen
+// along with their books but not counted.  Rows are added in increasing order, as libraryModel appends them.
+
+class tagFacets
+{
+public:
+    enum facet {tags, collection, author, facetCount};
+    tagFacets();
+    void clear();                                      // (what's chosen stays chosen)
+    void addRow(int row, const QString& tagText, const QString& collectionText, const QString& authorText, bool counted);  // Tags separated by commas, authors by &'s, as Calibre (and our query) has them
+    void removeRow(int row);                           // Row is no longer in the library (its bits are ignored)
+    QStringList names(int facet = tags) const;         // Every tag (or collection or author), the most used first
+    void select(const QStringList& tags, bool all);    // Rows with all (or any) of these tags; none means every row
+    void choose(int facet, const QString& value);      // Rows in this collection (or by this author) as well; empty means any
+    QString chosen(int facet) const { return chosenValues.value(facet); }
+    bool filtering() const { return selecting; }
+    bool selected(int row) const { return !selecting || has(selection, row); }
+    QHash<QString,int> counts(int facet) const;        // Books with each value the other choices leave (for tags, if matching all, the selected tags too); none with 0
+    qint64 bytes() const;                              // Roughly what it holds, for librarybench
+
+private:
+    QVector<QHash<QString,int>> valueNumbers;  // By facet, value -> number
+    QVector<int> valueCounts;              // By number, counted rows with it still in the library
+    QVector<char> valueFacet;              //     which facet it's in
+    QVector<QVector<quint64>> tagRows;     //     for a tag, a bit per row (cleared as rows go); short if the last rows don't have it
+    QVector<QVector<int>> valueRowList;    //     for a collection or author, its rows in order (including any since taken out)
+    QVector<int> rowValueStart;            // By row, where its value numbers start in rowValues (they end where the next row's start)
+    QVector<int> rowValues;
+    QVector<quint64> liveRows;             // Rows still in the library
+    QVector<quint64> countedRows;          //     those that are books
+    QVector<quint64> selection;            // Rows passing select and choose
+    QStringList selectedTags;
+    QStringList chosenValues;              // By facet (tags not used)
+    bool selecting;
+    bool matchAll;
+    static bool has(const QVector<quint64>& bits, int row) { return row / 64 < bits.size() && (bits[row / 64] >> (row % 64)) & 1; }
+    static void set(QVector<quint64>& bits, int row, bool on);
+    static QStringList split(int facet, const QString& text);
+    int valueNumber(int facet, const QString& value) const;  // -1 if no row has had it
+    bool rowHas(int row, int value) const;
+    void rowValueRange(int row, int& start, int& end) const;
+    QVector<quint64> within(int exceptFacet) const;  // Live rows the choices leave, other than for this facet
+};
+
+#endif // TAGFACETS_H
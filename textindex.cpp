@@ -0,0 +1,142 @@
+// Copyright 2023 by Linwood Ferguson, licensed under GNU GPLv3
+
+#include <QDebug>
+#include <QDir>
+#include <QRectF>
+#include <QStandardPaths>
+#include <QSqlDatabase>
+#include <QSqlQuery>
+#include <QSqlError>
+#include <QVariant>
+#include <QStringList>
+
+#include "textindex.h"
+#include "bookinfo.h"
+#include "piconstants.h"
+
+#include <poppler/qt6/poppler-qt6.h>
+
+#include <algorithm>
+#include <memory>
+
+// A page's row id is its book's id times this plus its page number, so a book's pages are one range of row ids
+// (FTS5 finds those quickly, where finding them by an unindexed column would look through every page)
+
+#define TEXTINDEX_ROWS_PER_BOOK 4096   // more than MUSICALPI_MAXPAGES
+
+textIndex::textIndex(const QString& connectionName)
+{
+    connection = connectionName;
+    QString folder = QStandardPaths::writableLocation(QStandardPaths::AppLocalDataLocation);
+    QDir().mkpath(folder);
+    QSqlDatabase db = QSqlDatabase::addDatabase("QSQLITE", connection);
+    db.setConnectOptions("QSQLITE_BUSY_TIMEOUT=" + QString::number(MUSICALPI_LIBRARY_WRITE_BUSY_MS));
+    db.setDatabaseName(folder + "/textindex.db");
+    open = db.open();
+    QSqlQuery query(db);
+    // WAL so searches aren't held up by a book being written (or the other way round)
+    open = open && exec(query, "PRAGMA journal_mode=WAL;")
+                && exec(query, "CREATE TABLE IF NOT EXISTS files (id INTEGER PRIMARY KEY, path TEXT UNIQUE NOT NULL, size INTEGER, modified INTEGER);")
+                && exec(query, "CREATE VIRTUAL TABLE IF NOT EXISTS pages USING fts5(text, tokenize = 'unicode61 remove_diacritics 2');");
+    if(!open) qDebug() << "Text index " << db.databaseName() << " could not be opened, pages will not be searched";
+}
+
+textIndex::~textIndex()
+{
+    {   // Scope so the database object is gone before we remove the connection
+        QSqlDatabase::database(connection, false).close();
+    }
+    QSqlDatabase::removeDatabase(connection);
+}
+
+bool textIndex::exec(QSqlQuery& query, const QString& sql, const QVariantList& values)
+{
+    query.prepare(sql);
+    for(int i = 0; i < values.size(); i++) query.bindValue(i, values[i]);
+    if(query.exec()) return true;
+    qDebug() << sql << " resulted in error " << query.lastError();
+    return false;
+}
+
+bool textIndex::current(const bookInfo& info)
+{
+    if(!open) return false;
+    QSqlQuery query(QSqlDatabase::database(connection, false));
+    if(!exec(query, "select size, modified from files where path = ?", {info.filepath}) || !query.next()) return false;
+    return query.value(0).toLongLong() == info.fileSize && query.value(1).toLongLong() == info.modified;
+}
+
+bool textIndex::update(const bookInfo& info)
+{
+    if(!open) return false;
+    if(current(info)) return true;
+    std::unique_ptr<Poppler::Document> document = Poppler::Document::load(info.filepath);
+    if(!document || document->isLocked())
+    {
+        qDebug() << "Could not open " << info.filepath << " for its text";
+        return false;
+    }
+    QStringList pageText;
+    for(int page = 0; page < std::min(document->numPages(), MUSICALPI_MAXPAGES); page++)
+    {
+        std::unique_ptr<Poppler::Page> thisPage = document->page(page);
+        pageText.append(thisPage ? thisPage->text(QRectF()).simplified() : QString());
+    }
+
+    // All of a book at once, so a search never sees it half replaced
+    QSqlDatabase db = QSqlDatabase::database(connection, false);
+    if(!db.transaction()) return false;
+    QSqlQuery query(db);
+    qint64 id = -1;
+    bool ok = exec(query, "select id from files where path = ?", {info.filepath});
+    if(ok && query.next())
+    {
+        id = query.value(0).toLongLong();
+        ok = exec(query, "update files set size = ?, modified = ? where id = ?", {info.fileSize, info.modified, id});
+    }
+    else if(ok)
+    {
+        ok = exec(query, "insert into files (path, size, modified) values (?, ?, ?)", {info.filepath, info.fileSize, info.modified});
+        id = query.lastInsertId().toLongLong();
+    }
+    ok = ok && exec(query, "delete from pages where rowid between ? and ?", {id * TEXTINDEX_ROWS_PER_BOOK, id * TEXTINDEX_ROWS_PER_BOOK + TEXTINDEX_ROWS_PER_BOOK - 1});
+    for(int page = 0; ok && page < pageText.size(); page++)
+        if(!pageText[page].isEmpty()) ok = exec(query, "insert into pages (rowid, text) values (?, ?)", {id * TEXTINDEX_ROWS_PER_BOOK + page + 1, pageText[page]});
+    if(ok) ok = db.commit();
+    if(!ok)
+    {
+        qDebug() << "Text of " << info.filepath << " not stored, rolling back";
+        db.rollback();
+    }
+    return ok;
+}
+
+QString textIndex::matchExpression(const QString& text)
+{
+    // Each word quoted (so nothing typed is taken as FTS5 syntax), all needed, and the last one may still be being typed
+    QStringList words;
+    QString word;
+    for(QChar c : text + " ")
+        if(c.isLetterOrNumber()) word += c;
+        else if(!word.isEmpty())
+        {
+            words.append("\"" + word + "\"");
+            word.clear();
+        }
+    if(!words.isEmpty() && !text.isEmpty() && text.back().isLetterOrNumber()) words.last() += "*";
+    return words.join(" ");
+}
+
+QList<textIndex::hit> textIndex::search(const QString& text, int limit)
+{
+    QList<hit> hits;
+    QString match = matchExpression(text);
+    if(!open || match.isEmpty()) return hits;
+    QSqlQuery query(QSqlDatabase::database(connection, false));
+    query.setForwardOnly(true);
+    if(!exec(query, "select files.path, pages.rowid % " + QString::number(TEXTINDEX_ROWS_PER_BOOK) + ", snippet(pages, 0, '', '', '...', 8) "
+                    "from pages join files on files.id = pages.rowid / " + QString::number(TEXTINDEX_ROWS_PER_BOOK) + " "
+                    "where pages match ? order by rank limit ?", {match, limit})) return hits;
+    while(query.next()) hits.append({query.value(0).toString(), query.value(1).toInt(), query.value(2).toString()});
+    return hits;
+}
@@ -0,0 +1,44 @@
+#ifndef TEXTINDEX_H
+#define TEXTINDEX_H
+
+// Copyright 2023 by Linwood Ferguson, licensed under GNU GPLv3
+
+#include <QString>
+#include <QList>
+#include <QVariant>
+
+class bookInfo;
+class QSqlQuery;
+
+// The words on every page of every book (the PDFs' text layers, as Poppler reads them), so a piece can be found by a
+// line of its lyrics or a tempo marking.  They are kept in our own SQLite database on local storage (an FTS5 full
+// text table, one row per page), not in Calibre's, and each book's are good for as long as its PDF's size and
+// modification time are unchanged, as with bookInfo.  thumbnailThread fills it in as it indexes songs; the library
+// searches it, best matches (by FTS5's bm25 rank) first.
+//
+// Each thread using it needs its own, as each has its own connection.
+
+class textIndex
+{
+public:
+    struct hit
+    {
+        QString filepath;
+        int page;             // Starting page 1
+        QString snippet;      // The words found, with a few either side
+    };
+    textIndex(const QString& connectionName);
+    ~textIndex();
+    bool isOpen() const { return open; }              // False if it couldn't be (e.g. SQLite without FTS5), and then it does nothing
+    bool current(const bookInfo& info);               // The book's pages are in, as of the PDF info was got from
+    bool update(const bookInfo& info);                // Read the book's pages from the PDF unless current; false if they couldn't be
+    QList<hit> search(const QString& text, int limit);  // Pages with all the words (the last may be the start of one), best first
+
+private:
+    QString connection;
+    bool open;
+    bool exec(QSqlQuery& query, const QString& sql, const QVariantList& values = QVariantList());  // Logs any error
+    static QString matchExpression(const QString& text);
+};
+
+#endif // TEXTINDEX_H
@@ -0,0 +1,191 @@
+// Copyright 2023 by Linwood Ferguson, licensed under GNU GPLv3
+
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QDateTime>
+#include <QImageReader>
+#include <QStandardPaths>
+#include <QCryptographicHash>
+
+#include "thumbnailthread.h"
+#include "bookinfo.h"
+#include "textindex.h"
+#include "pagecache.h"
+#include "renderthread.h"
+
+#include <poppler/qt6/poppler-qt6.h>
+
+#define THUMBNAILTHREAD_CONNECTION "thumbnailThread"   // Connections are per thread, so named to keep it apart from any others
+
+thumbnailThread::thumbnailThread(QObject *parent, int height) : QThread(parent)
+{
+    // Constructor is running in the parent thread
+    qDebug() << "in constructor with height " << height;
+    abort = false;
+    mPaused = false;
+    mHeight = height;
+}
+
+thumbnailThread::~thumbnailThread()
+{
+    qDebug() << "In destructor";
+    mutex.lock();
+    abort = true;
+    condition.wakeOne();
+    mutex.unlock();
+    wait();  // Let it finish the one it is on
+    qDebug() << "Wait finished, leaving destructor";
+}
+
+void thumbnailThread::request(const QList<thumbnailRequest>& wanted)
+{
+    // Run in the parent thread.  What was queued was for rows no longer on the screen, so it's replaced.
+    mutex.lock();
+    queue = wanted;
+    if(this->isRunning()) condition.wakeOne();
+    else start(QThread::IdlePriority);
+    mutex.unlock();
+}
+
+void thumbnailThread::index(const QList<thumbnailRequest>& books, bool replace)
+{
+    mutex.lock();
+    if(replace) indexQueue = books;
+    else indexQueue.append(books);
+    if(this->isRunning()) condition.wakeOne();
+    else start(QThread::IdlePriority);
+    mutex.unlock();
+}
+
+void thumbnailThread::prerender(const QList<prerenderRequest>& wanted)
+{
+    mutex.lock();
+    prerenderQueue = wanted;
+    prerendered.clear();
+    if(this->isRunning()) condition.wakeOne();
+    else start(QThread::IdlePriority);
+    mutex.unlock();
+}
+
+void thumbnailThread::pause(bool paused)
+{
+    mutex.lock();
+    mPaused = paused;
+    condition.wakeOne();
+    mutex.unlock();
+}
+
+QString thumbnailThread::folder()
+{
+    return QStandardPaths::writableLocation(QStandardPaths::AppLocalDataLocation) + "/thumbnails";
+}
+
+QImage thumbnailThread::makeThumbnail(const QString& filepath)
+{
+    QImage image;
+    QFileInfo info(filepath);
+    if(!info.exists()) return image;
+    QString key = filepath + "\n" + QString::number(info.lastModified().toMSecsSinceEpoch()) + "\n" + QString::number(mHeight);
+    QString cacheFile = folder() + "/" + QCryptographicHash::hash(key.toUtf8(), QCryptographicHash::Sha1).toHex().left(16) + ".jpg";
+    if(image.load(cacheFile)) return image;
+
+    QImageReader cover(info.absolutePath() + "/cover.jpg");
+    if(cover.canRead())
+    {
+        QSize size = cover.size();
+        if(size.height() > mHeight) cover.setScaledSize(size.scaled(size.width(), mHeight, Qt::KeepAspectRatio));  // Decodes at the small size
+        image = cover.read();
+    }
+    if(image.isNull())
+    {
+        std::unique_ptr<Poppler::Document> document = Poppler::Document::load(filepath);
+        if(!document || document->isLocked() || document->numPages() < 1)
+        {
+            qDebug() << "Could not open " << filepath << " for a thumbnail";
+            return image;
+        }
+        document->setRenderBackend(MUSICALPI_POPPLER_BACKEND);
+        document->setRenderHint(Poppler::Document::Antialiasing, true);
+        document->setRenderHint(Poppler::Document::TextAntialiasing, true);
+        std::unique_ptr<Poppler::Page> page = document->page(0);
+        if(!page) return image;
+        double resolution = 72.0 * mHeight / page->pageSizeF().height();
+        image = page->renderToImage(resolution, resolution);
+    }
+    if(image.isNull()) return image;
+    QDir().mkpath(folder());
+    if(!image.convertToFormat(QImage::Format_RGB32).save(cacheFile, "JPG", 85)) qDebug() << "Could not save thumbnail " << cacheFile;
+    return image;
+}
+
+QStringList thumbnailThread::prerenderPages(const prerenderRequest& wanted)
+{
+    QStringList files;
+    bookInfo info;
+    if(!info.get(wanted.filepath) || wanted.size.isEmpty()) return files;
+    std::unique_ptr<Poppler::Document> document;
+    for(int page = wanted.firstPage; page < wanted.firstPage + wanted.pages && page <= info.pageCount; page++)
+    {
+        files.append(pageCache::fileName(wanted.filepath, info.modified, page, wanted.size));
+        if(QFile::exists(files.last())) continue;  // Done before
+        if(!document)
+        {
+            document = Poppler::Document::load(wanted.filepath);
+            if(!document || document->isLocked())
+            {
+                qDebug() << "Could not open " << wanted.filepath << " to render ahead";
+                return files;
+            }
+        }
+        pageCache::save(wanted.filepath, info.modified, page, wanted.size, renderThread::renderPage(document.get(), page, wanted.size.width(), wanted.size.height(), wanted.format));
+    }
+    return files;
+}
+
+void thumbnailThread::run()
+{
+    textIndex pageText(THUMBNAILTHREAD_CONNECTION);  // (made here as it's this thread's connection)
+    forever
+    {
+        mutex.lock();
+        while(((queue.isEmpty() && prerenderQueue.isEmpty() && indexQueue.isEmpty()) || mPaused) && !abort) condition.wait(&mutex);
+        if(abort) { mutex.unlock(); qDebug() << "Returning with abort"; return; }
+        if(queue.isEmpty() && !prerenderQueue.isEmpty())
+        {
+            prerenderRequest thisPrerender = prerenderQueue.takeFirst();
+            mutex.unlock();
+            QStringList files = prerenderPages(thisPrerender);
+            mutex.lock();
+            prerendered.append(files);
+            if(prerenderQueue.isEmpty()) pageCache::prune(prerendered);  // (within the lock, so a new list can't come between)
+            mutex.unlock();
+            continue;
+        }
+        bool indexing = queue.isEmpty();
+        thumbnailRequest thisRequest = indexing ? indexQueue.takeFirst() : queue.takeFirst();
+        mutex.unlock();
+
+        if(indexing)
+        {
+            bookInfo info;
+            if((!info.find(thisRequest.filepath, thisRequest.verify) || !info.songsKnown) && !info.read(thisRequest.filepath, true)) continue;  // (what's stored will otherwise do for searching)
+            if(!info.songs.isEmpty())
+            {
+                QList<QStringList> songs;
+                for(const bookInfo::song& thisSong : info.songs) songs.append({thisSong.title, QString::number(thisSong.firstPage), QString::number(thisSong.lastPage)});
+                emit songsFound(thisRequest.key, songs);
+            }
+            pageText.update(info);
+            continue;
+        }
+
+        QImage image;
+        if(mHeight > 0) image = makeThumbnail(thisRequest.filepath);
+        bookInfo info;
+        if(info.find(thisRequest.filepath)) info.checkMidi();  // (a .mid may be added without the PDF changing)
+        else info.read(thisRequest.filepath);
+        emit thumbnailReady(thisRequest.key, image);
+    }
+}
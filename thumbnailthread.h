@@ -0,0 +1,78 @@
+#ifndef THUMBNAILTHREAD_H
+#define THUMBNAILTHREAD_H
+
+// Copyright 2023 by Linwood Ferguson, licensed under GNU GPLv3
+
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QImage>
+#include <QList>
+#include <QStringList>
+#include <QSize>
+#include "piconstants.h"
+
+// Makes the small pictures of each book shown in the library: Calibre's cover.jpg from the book's folder if it has
+// one, otherwise page one rendered by Poppler.  Each is kept on disk (named from the PDF's path and modification
+// time, so a changed PDF gets a new one), so it's only made once.  It also fills in each book's bookInfo while it's
+// there, which is why it runs even with thumbnails turned off (height 0).
+//
+// When there are no pictures wanted it goes through the books given to index, for the songs in each (from bookInfo,
+// reading the PDF only if they have not been looked for), so the library can search for songs in any book.  The words
+// on each page go into the textIndex then too, read only when the PDF is new or changed.
+//
+// Before indexing, it renders the first pages of the books given to prerender into the pageCache, at the size they
+// will be shown, so they open at once.
+//
+// This runs at idle priority and only while the library is showing (musicLibrary pauses it when hidden), so it never
+// takes time from the page renders while playing.
+
+class thumbnailThread : public QThread
+{
+    Q_OBJECT
+
+public:
+    struct thumbnailRequest
+    {
+        QString key;          // returned with the picture so the caller can file it
+        QString filepath;     // the PDF
+        bool verify;          // (indexing) check the PDF is unchanged since its bookInfo was stored, as it's known to have been changed
+    };
+    thumbnailThread(QObject *parent, int height);
+    ~thumbnailThread();
+    void request(const QList<thumbnailRequest>& wanted);  // Replaces anything not yet started, so ask in priority order
+    void index(const QList<thumbnailRequest>& books, bool replace);  // Adds to (or replaces) those waiting to be indexed
+    struct prerenderRequest
+    {
+        QString filepath;
+        int firstPage;        // Starting page 1
+        int pages;
+        QSize size;           // As renderThread is asked for
+        QImage::Format format;
+    };
+    void prerender(const QList<prerenderRequest>& wanted);  // Replaces those not yet done; when these are, anything else is taken out of the pageCache
+    void pause(bool paused);
+
+protected:
+    void run() Q_DECL_OVERRIDE;
+
+signals:
+    void thumbnailReady(QString key, QImage image);  // Null if there's none (or turned off), so it isn't asked for again
+    void songsFound(QString key, QList<QStringList> songs);  // Title, first and last page of each song in a book being indexed (if any)
+
+private:
+    bool abort;
+    bool mPaused;
+    QMutex mutex;             // Protects the queues and goes with the condition below
+    QWaitCondition condition; // Thread sleeps on this when there is nothing to do (or it's paused)
+    QList<thumbnailRequest> queue;
+    QList<thumbnailRequest> indexQueue;
+    QList<prerenderRequest> prerenderQueue;
+    QStringList prerendered;  // pageCache files for those done, since the last prerender call
+    int mHeight;              // of each picture, in pixels
+    static QString folder();
+    QImage makeThumbnail(const QString& filepath);
+    QStringList prerenderPages(const prerenderRequest& wanted);  // Returns the pageCache files for them
+};
+
+#endif // THUMBNAILTHREAD_H
@@ -0,0 +1,88 @@
+// Copyright 2023 by Linwood Ferguson, licensed under GNU GPLv3
+
+#include <QDebug>
+
+#include "tilerenderthread.h"
+#include "mainwindow.h"
+
+#include <algorithm>
+
+tileRenderThread::tileRenderThread(QObject *parent, MainWindow* mp) : QThread(parent)
+{
+    // Constructor is running in the parent thread
+    qDebug() << "in constructor";
+    abort = false;
+    mParent = mp;
+}
+
+tileRenderThread::~tileRenderThread()
+{
+    qDebug() << "In destructor";
+    mutex.lock();
+    abort = true;
+    condition.wakeOne();
+    mutex.unlock();
+    wait();  // Let the worker finish the tile it is on and exit before the base class destructor is called
+    qDebug() << "Wait finished, leaving destructor";
+}
+
+void tileRenderThread::render(QString filepath, const QList<tileRequest>& tiles)
+{
+    // Run in the parent thread.  Whatever was queued is stale (the user has moved on) so it is replaced, not added to.
+    mutex.lock();
+    mFilepath = filepath;
+    queue = tiles;
+    if(this->isRunning()) condition.wakeOne();
+    else start(QThread::LowPriority);
+    mutex.unlock();
+}
+
+void tileRenderThread::run()
+{
+    forever
+    {
+        mutex.lock();
+        while(queue.isEmpty() && !abort) condition.wait(&mutex);
+        if(abort) { mutex.unlock(); qDebug() << "Returning with abort"; return; }
+        tileRequest thisTile = queue.takeFirst();
+        QString filepath = mFilepath;
+        mutex.unlock();
+
+        if(filepath != openFilepath)  // Unlike page renders we keep the document open, as tiles come many at a time
+        {
+            qDebug() << "Opening PDF document inside of tile thread " << filepath;
+            document = Poppler::Document::load(filepath);
+            if(!document || document->isLocked())
+            {
+                qDebug() << "Failed to open (or locked) in tile thread " << filepath;  // (moved or unreadable since it was opened)
+                document.reset();
+                openFilepath = "";
+                continue;
+            }
+            document->setRenderBackend(MUSICALPI_POPPLER_BACKEND);
+            document->setRenderHint(Poppler::Document::Antialiasing, true);
+            document->setRenderHint(Poppler::Document::TextAntialiasing, true);
+            document->setRenderHint(Poppler::Document::TextHinting, false);
+            document->setRenderHint(Poppler::Document::OverprintPreview, false);
+            document->setRenderHint(Poppler::Document::ThinLineSolid,true);
+            openFilepath = filepath;
+        }
+        std::unique_ptr<Poppler::Page> tmpPage = document->page(thisTile.page - 1);
+        if(tmpPage == NULL)
+        {
+            qDebug() << "Failed to get page " << thisTile.page << " in tile thread of " << filepath;
+            document.reset();
+            openFilepath = "";
+            continue;
+        }
+        QSizeF thisPageSize = tmpPage->pageSizeF();  // in 72's of inch
+        double resolution = 72.0 * (double)thisTile.pageWidth / thisPageSize.width();
+        int pageHeight = thisPageSize.height() * resolution / 72.0;
+        int w = std::min(MUSICALPI_TILE_SIZE, thisTile.pageWidth - thisTile.x);  // Edge tiles are only what is left of the page
+        int h = std::min(MUSICALPI_TILE_SIZE, pageHeight - thisTile.y);
+        if(w <= 0 || h <= 0) continue;
+        QImage tile = tmpPage->renderToImage(resolution, resolution, thisTile.x, thisTile.y, w, h);
+        if(tile.format() != mParent->pageImageFormat) tile.convertTo(mParent->pageImageFormat);  // so painting it is a copy
+        emit renderedTile(thisTile.key, thisTile.generation, tile);
+    }
+}
@@ -0,0 +1,55 @@
+#ifndef TILERENDERTHREAD_H
+#define TILERENDERTHREAD_H
+
+// Copyright 2023 by Linwood Ferguson, licensed under GNU GPLv3
+
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QImage>
+#include <QList>
+#include "piconstants.h"
+
+#include <poppler/qt6/poppler-qt6.h>
+
+class MainWindow;
+
+// Renders square pieces (tiles) of one page at a zoomed size, for docPageLabel when zoomed in.  Only the region asked
+// for is rendered (Poppler region rendering), so a zoomed page costs no more than the part of it that is visible.
+
+class tileRenderThread : public QThread
+{
+    Q_OBJECT
+
+public:
+    struct tileRequest
+    {
+        quint64 key;      // returned with the tile so the caller can file it
+        int generation;   //     and this, so it can tell one asked for before it last dropped its tiles
+        int page;         // Starting page 1
+        int pageWidth;    // width of the whole page at this zoom, in pixels; sets the resolution
+        int x;            // top left of the tile within the zoomed page, in pixels
+        int y;
+    };
+    tileRenderThread(QObject *parent, MainWindow* mp);
+    ~tileRenderThread();
+    void render(QString filepath, const QList<tileRequest>& tiles);  // Replaces anything not yet started, so ask in priority order
+
+protected:
+    void run() Q_DECL_OVERRIDE;
+
+signals:
+    void renderedTile(quint64 key, int generation, QImage tile);
+
+private:
+    bool abort;
+    QMutex mutex;             // Protects the queue and path, and goes with the condition below
+    QWaitCondition condition; // Thread sleeps on this when there is nothing to render
+    QList<tileRequest> queue;
+    QString mFilepath;
+    QString openFilepath;     // What document holds (only used in thread)
+    MainWindow* mParent;
+    std::unique_ptr<Poppler::Document> document;
+};
+
+#endif // TILERENDERTHREAD_H
@@ -0,0 +1,39 @@
+#--------------------------------------------------------------------
+#
+# Copyright 2023 by Linwood Ferguson, licensed under GNU GPLv3
+#
+# Library benchmark: makes a synthetic Calibre library and times
+# the library's load, search, tag and playlist operations on it
+# (see the top of main.cpp).  Built on its own, e.g.
+#     qmake tools/librarybench && make
+#
+#--------------------------------------------------------------------
+
+QT       += core gui sql
+QT       -= widgets
+
+TEMPLATE = app
+CONFIG += console c++11
+CONFIG -= app_bundle
+
+TARGET = librarybench
+
+DEFINES += QT_MESSAGELOGCONTEXT
+
+INCLUDEPATH += ../..
+
+SOURCES += main.cpp \
+    ../../librarythread.cpp \
+    ../../librarysql.cpp \
+    ../../playlistorder.cpp \
+    ../../librarymodel.cpp \
+    ../../searchindex.cpp \
+    ../../tagfacets.cpp
+
+HEADERS += ../../librarythread.h \
+    ../../librarysql.h \
+    ../../playlistorder.h \
+    ../../librarymodel.h \
+    ../../searchindex.h \
+    ../../tagfacets.h \
+    ../../piconstants.h
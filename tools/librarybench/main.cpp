@@ -0,0 +1,470 @@
+// Copyright 2023 by Linwood Ferguson, licensed under GNU GPLv3
+
+// Library benchmark, so changes to the library (musicLibrary and the classes under it) can be judged by numbers
+// rather than by feel against whatever library is at hand.
+//
+//     librarybench generate <folder> <books>     Makes <folder>/metadata.db, a Calibre library of that many music books
+//     librarybench run <folder> [options]        Times the library's operations on it (see --help for options)
+//
+// The generated database has the tables and columns our queries use (books, tags, books_tags_link, data, series and
+// books_series_link, as Calibre defines them), with every book tagged "music", a few other tags each, a third of them
+// in collections (series) of about 10 books, a quarter with an arranger as well as a composer (so there are about as
+// many authors as a large library has, most on a few books), and playlists made as we make them: a "musicList_" tag per book numbered |01, |02 ... in
+// list order.  It has no PDFs, so it's only for the library, not for opening books.  1000, 10000 and 100000 books
+// are the sizes worth comparing.
+//
+// run goes through the same classes the library does (libraryThread, libraryModel, playListOrder) with the same SQL
+// (librarySql), timing: reading all books, the playlists query and bringing the playlist order store up to date with
+// it, reading one playlist's books and putting them in its order, loading the model, searches (exact and misspelled),
+// tag filters and counts, choosing a collection and counting authors, taking 1000 books out of the model, checking
+// for changes, and adding 30 books to a list in one transaction then taking them out again one transaction each, as
+// the library does.  Each is done several times and the median shown, then the memory the tag, collection and author
+// facets (tagFacets) take.
+
+#include <QGuiApplication>
+#include <QCommandLineParser>
+#include <QSqlDatabase>
+#include <QSqlQuery>
+#include <QSqlError>
+#include <QRandomGenerator>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QTextStream>
+#include <QFileInfo>
+#include <QFile>
+#include <QDir>
+#include <QDebug>
+
+#include "librarythread.h"
+#include "librarysql.h"
+#include "librarymodel.h"
+#include "playlistorder.h"
+#include "piconstants.h"
+
+#include <algorithm>
+
+#define LIBRARYBENCH_MUSIC_TAG "music"
+#define LIBRARYBENCH_LIST_PREFIX "musicList_"
+#define LIBRARYBENCH_LISTS 20
+#define LIBRARYBENCH_BULK_BOOKS 30
+#define LIBRARYBENCH_REMOVED_BOOKS 1000
+
+static QTextStream out(stdout);
+
+static bool check(const QSqlQuery& query, const QString& stage)
+{
+    if(query.lastError().type() == QSqlError::NoError) return true;
+    out << stage << " failed: " << query.lastError().text() << Qt::endl;
+    return false;
+}
+
+static QString pick(QRandomGenerator& random, const QStringList& words)
+{
+    return words[random.bounded(words.size())];
+}
+
+static int generate(const QString& folder, int books)
+{
+    static const QStringList forms = {"Sonata", "Prelude", "Etude", "Nocturne", "Waltz", "Fugue", "Ballade", "Rhapsody", "Suite",
+                                      "Minuet", "Gavotte", "Impromptu", "Fantasia", "Serenade", "Romance", "Toccata", "Mazurka", "Polonaise"};
+    static const QStringList keys = {"C", "D", "E", "F", "G", "A", "B", "B Flat", "E Flat", "A Flat", "F Sharp", "C Sharp"};
+    static const QStringList songWords = {"Moon", "River", "Blue", "Night", "Heart", "Rain", "Summer", "Autumn", "Road", "Home", "Dream",
+                                          "Light", "Morning", "Star", "Love", "Lonely", "Dance", "Sweet", "Old", "Wind", "Shadow", "Song"};
+    static const QStringList surnames = {"Bach", "Mozart", "Beethoven", "Chopin", "Schubert", "Brahms", "Debussy", "Satie", "Joplin",
+                                         "Gershwin", "Ellington", "Porter", "Kern", "Berlin", "Carmichael", "Rodgers", "Arlen", "Mancini",
+                                         "Grieg", "Liszt", "Haydn", "Handel", "Vivaldi", "Faure", "Ravel", "Tchaikovsky", "Dvorak", "Elgar"};
+    static const QStringList givenNames = {"Johann", "Wolfgang", "Ludwig", "Frederic", "Franz", "Johannes", "Claude", "Erik", "Scott",
+                                           "George", "Duke", "Cole", "Jerome", "Irving", "Hoagy", "Richard", "Harold", "Henry"};
+    static const QStringList genres = {"Piano", "Guitar", "Vocal", "Jazz", "Classical", "Folk", "Hymn", "Christmas", "Duet",
+                                       "Lead Sheet", "Fake Book", "Exercise", "Ragtime", "Blues", "Baroque", "Romantic"};
+    static const QStringList collectionWords = {"Real Book", "Anthology", "Favorites", "Collection", "Album", "Songbook", "Method", "Studies"};
+
+    QDir().mkpath(folder);
+    QString path = folder + "/metadata.db";
+    QFile::remove(path);
+    QSqlDatabase db = QSqlDatabase::addDatabase("QSQLITE", "generate");
+    db.setDatabaseName(path);
+    if(!db.open())
+    {
+        out << "Could not create " << path << ": " << db.lastError().text() << Qt::endl;
+        return 1;
+    }
+    QSqlQuery query(db);
+    static const QStringList schema = {
+        "CREATE TABLE books (id INTEGER PRIMARY KEY AUTOINCREMENT, title TEXT NOT NULL DEFAULT 'Unknown' COLLATE NOCASE, sort TEXT COLLATE NOCASE, "
+            "timestamp TIMESTAMP DEFAULT CURRENT_TIMESTAMP, pubdate TIMESTAMP DEFAULT CURRENT_TIMESTAMP, series_index REAL NOT NULL DEFAULT 1.0, "
+            "author_sort TEXT COLLATE NOCASE, isbn TEXT DEFAULT '' COLLATE NOCASE, lccn TEXT DEFAULT '' COLLATE NOCASE, path TEXT NOT NULL DEFAULT '', "
+            "flags INTEGER NOT NULL DEFAULT 1, uuid TEXT, has_cover BOOL DEFAULT 0, last_modified TIMESTAMP NOT NULL DEFAULT '2000-01-01 00:00:00+00:00')",
+        "CREATE TABLE tags (id INTEGER PRIMARY KEY, name TEXT NOT NULL COLLATE NOCASE, UNIQUE (name))",
+        "CREATE TABLE books_tags_link (id INTEGER PRIMARY KEY, book INTEGER NOT NULL, tag INTEGER NOT NULL, UNIQUE(book, tag))",
+        "CREATE TABLE data (id INTEGER PRIMARY KEY, book INTEGER NOT NULL, format TEXT NOT NULL COLLATE NOCASE, uncompressed_size INTEGER NOT NULL, "
+            "name TEXT NOT NULL, UNIQUE(book, format))",
+        "CREATE TABLE series (id INTEGER PRIMARY KEY, name TEXT NOT NULL COLLATE NOCASE, sort TEXT COLLATE NOCASE, UNIQUE (name))",
+        "CREATE TABLE books_series_link (id INTEGER PRIMARY KEY, book INTEGER NOT NULL, series INTEGER NOT NULL, UNIQUE(book))",
+        "CREATE INDEX books_idx ON books (sort COLLATE NOCASE)",
+        "CREATE INDEX books_tags_link_aidx ON books_tags_link (tag)",
+        "CREATE INDEX books_tags_link_bidx ON books_tags_link (book)",
+        "CREATE INDEX data_idx ON data (book)",
+        "CREATE INDEX books_series_link_aidx ON books_series_link (series)",
+        "CREATE INDEX books_series_link_bidx ON books_series_link (book)",
+        "CREATE INDEX tags_idx ON tags (name COLLATE NOCASE)"};
+    for(const QString& sql : schema)
+        if(!query.exec(sql) || !check(query, sql)) return 1;
+
+    QRandomGenerator random(20230101);  // Same library every time for a given size
+    db.transaction();
+    QSqlQuery insertTag(db), insertBook(db), insertLink(db), insertData(db), insertSeries(db), insertSeriesLink(db);
+    insertTag.prepare("insert into tags (name) values (?)");
+    insertBook.prepare("insert into books (title, sort, author_sort, path, uuid, last_modified) values (?, ?, ?, ?, ?, ?)");
+    insertLink.prepare("insert into books_tags_link (book, tag) values (?, ?)");
+    insertData.prepare("insert into data (book, format, uncompressed_size, name) values (?, 'PDF', ?, ?)");
+    insertSeries.prepare("insert into series (name, sort) values (?, ?)");
+    insertSeriesLink.prepare("insert into books_series_link (book, series) values (?, ?)");
+
+    auto addTag = [&](const QString& name) -> int
+    {
+        insertTag.addBindValue(name);
+        insertTag.exec();
+        check(insertTag, "Adding tag " + name);
+        return insertTag.lastInsertId().toInt();
+    };
+    int musicTag = addTag(LIBRARYBENCH_MUSIC_TAG);
+    QVector<int> genreTags;
+    for(const QString& genre : genres) genreTags.append(addTag(genre));
+    QVector<int> seriesIds;
+    for(int series = 0; series < std::max(10, books / 30); series++)
+    {
+        QString name = pick(random, surnames) + " " + pick(random, collectionWords) + " " + QString::number(series + 1);
+        insertSeries.addBindValue(name);
+        insertSeries.addBindValue(name);
+        insertSeries.exec();
+        check(insertSeries, "Adding series " + name);
+        seriesIds.append(insertSeries.lastInsertId().toInt());
+    }
+
+    for(int book = 1; book <= books; book++)
+    {
+        QString title = random.bounded(2) ? pick(random, forms) + " in " + pick(random, keys) + " No. " + QString::number(random.bounded(1, 40))
+                                          : pick(random, songWords) + " " + pick(random, songWords) + (random.bounded(3) ? "" : " " + pick(random, songWords));
+        QString given = pick(random, givenNames);
+        QString surname = pick(random, surnames);
+        QString folderName = given + " " + surname + "/" + title + " (" + QString::number(book) + ")";
+        QString authors = surname + ", " + given;
+        if(random.bounded(4) == 0) authors += " & Arranger, " + QString::number(random.bounded(1, std::max(2, books / 4)));  // As Calibre's author_sort has a second author
+        insertBook.addBindValue(title);
+        insertBook.addBindValue(title);
+        insertBook.addBindValue(authors);
+        insertBook.addBindValue(folderName);
+        insertBook.addBindValue(QString("%1-bench").arg(book));
+        insertBook.addBindValue(QString("2023-%1-%2 12:%3:00+00:00").arg(random.bounded(1, 13), 2, 10, QChar('0')).arg(random.bounded(1, 29), 2, 10, QChar('0'))
+                                .arg(random.bounded(60), 2, 10, QChar('0')));
+        insertBook.exec();
+        if(!check(insertBook, "Adding book")) return 1;
+        int id = insertBook.lastInsertId().toInt();
+        insertLink.addBindValue(id);
+        insertLink.addBindValue(musicTag);
+        insertLink.exec();
+        QVector<int> chosen;
+        for(int tags = random.bounded(4); tags > 0; tags--)
+        {
+            int tag = genreTags[random.bounded(genreTags.size())];
+            if(chosen.contains(tag)) continue;
+            chosen.append(tag);
+            insertLink.addBindValue(id);
+            insertLink.addBindValue(tag);
+            insertLink.exec();
+        }
+        insertData.addBindValue(id);
+        insertData.addBindValue(random.bounded(50000, 5000000));
+        insertData.addBindValue(title + " - " + given + " " + surname);
+        insertData.exec();
+        if(random.bounded(3) == 0)
+        {
+            insertSeriesLink.addBindValue(id);
+            insertSeriesLink.addBindValue(seriesIds[random.bounded(seriesIds.size())]);
+            insertSeriesLink.exec();
+        }
+    }
+
+    for(int list = 1; list <= LIBRARYBENCH_LISTS; list++)
+    {
+        QString name = QString(LIBRARYBENCH_LIST_PREFIX "Concert %1").arg(list, 2, 10, QChar('0'));
+        QVector<int> chosen;
+        int size = std::min(books, (int)random.bounded(10, 60));
+        while(chosen.size() < size)
+        {
+            int book = random.bounded(1, books + 1);
+            if(!chosen.contains(book)) chosen.append(book);
+        }
+        for(int ordinal = 1; ordinal <= chosen.size(); ordinal++)
+        {
+            int tag = addTag(name + "|" + QString::number(ordinal).rightJustified(2, '0'));
+            insertLink.addBindValue(chosen[ordinal - 1]);
+            insertLink.addBindValue(tag);
+            insertLink.exec();
+        }
+    }
+    if(!db.commit())
+    {
+        out << "Could not commit: " << db.lastError().text() << Qt::endl;
+        return 1;
+    }
+    query.exec("analyze");
+    out << "Made " << path << " with " << books << " books, " << genres.size() << " tags, " << seriesIds.size() << " collections and "
+        << LIBRARYBENCH_LISTS << " playlists" << Qt::endl;
+    return 0;
+}
+
+struct queryRun
+{
+    QStringList fields;
+    QList<QList<QStringList>> chunks;  // As they came from the thread
+    int rows;
+    double firstMs;                    // Until the first chunk arrived
+    double totalMs;
+};
+
+static queryRun runQuery(libraryThread* loader, libraryThread::queryKind kind, const QString& sql, const QVariantList& values)
+{
+    static int serial = 0;
+    int mine = ++serial;
+    queryRun result = {QStringList(), QList<QList<QStringList>>(), 0, 0, 0};
+    QEventLoop loop;
+    QElapsedTimer timer;
+    auto started = QObject::connect(loader, &libraryThread::queryStarted, &loop, [&](int, int s, QStringList fieldNames) { if(s == mine) result.fields = fieldNames; });
+    auto read = QObject::connect(loader, &libraryThread::rowsRead, &loop, [&](int, int s, QList<QStringList> rows)
+    {
+        if(s != mine) return;
+        if(result.chunks.isEmpty()) result.firstMs = timer.nsecsElapsed() / 1e6;
+        result.chunks.append(rows);
+    });
+    auto finished = QObject::connect(loader, &libraryThread::queryFinished, &loop, [&](int, int s, int rowCount)
+    {
+        if(s != mine) return;
+        result.rows = rowCount;
+        result.totalMs = timer.nsecsElapsed() / 1e6;
+        loop.quit();
+    });
+    timer.start();
+    loader->query(kind, mine, sql, values);
+    loop.exec();
+    QObject::disconnect(started);
+    QObject::disconnect(read);
+    QObject::disconnect(finished);
+    return result;
+}
+
+static double runTransaction(libraryThread* loader, libraryThread::transactionWork work, QString* error)
+{
+    static int serial = 0;
+    int mine = ++serial;
+    QEventLoop loop;
+    QElapsedTimer timer;
+    double ms = 0;
+    auto done = QObject::connect(loader, &libraryThread::transactionDone, &loop, [&](int s, QString result)
+    {
+        if(s != mine) return;
+        ms = timer.nsecsElapsed() / 1e6;
+        *error = result;
+        loop.quit();
+    });
+    timer.start();
+    loader->transaction(mine, work);
+    loop.exec();
+    QObject::disconnect(done);
+    return ms;
+}
+
+class benchResults
+{
+public:
+    void add(const QString& name, double ms, const QString& note = QString())
+    {
+        if(!names.contains(name)) names.append(name);
+        times[name].append(ms);
+        if(!note.isEmpty()) notes[name] = note;
+    }
+    void print() const
+    {
+        for(const QString& name : names)
+        {
+            QVector<double> these = times[name];
+            std::sort(these.begin(), these.end());
+            out << QString("%1 %2 ms  (%3 - %4)  %5").arg(name, -44).arg(these[these.size() / 2], 10, 'f', 2).arg(these.first(), 0, 'f', 2)
+                   .arg(these.last(), 0, 'f', 2).arg(notes.value(name)) << Qt::endl;
+        }
+    }
+
+private:
+    QStringList names;
+    QHash<QString, QVector<double>> times;
+    QHash<QString, QString> notes;
+};
+
+static void loadModel(libraryModel& model, const queryRun& books)
+{
+    // As musicLibrary does: hidden columns aren't searched, rows go in a chunk at a time, then it's sorted by title
+    model.reset(books.fields);
+    for(const QString& hidden : {"BookID", "Modified", "Path"}) model.setSearchable(model.fieldColumn(hidden), false);
+    for(const QList<QStringList>& chunk : books.chunks) model.appendRows(chunk);
+    model.loadFinished();
+    model.sort(model.fieldColumn("Title"));
+}
+
+static int run(const QString& folder, bool immutable, int mmapMB, int cacheMB, int repeat)
+{
+    QString path = folder + "/metadata.db";
+    if(!QFileInfo::exists(path))
+    {
+        out << path << " not found, make it with generate" << Qt::endl;
+        return 1;
+    }
+    out << "Timing " << path << (immutable ? ", immutable" : "") << ", mmap " << mmapMB << "MB, cache " << cacheMB << "MB, median of " << repeat << Qt::endl;
+    benchResults results;
+    libraryThread loader(NULL, path, immutable, mmapMB, cacheMB);
+    libraryModel model(NULL);
+    libraryModel listModel(NULL);
+    playListOrder listOrder("benchLists");  // (librarybench's own, beside its other local files)
+    QString facetMemory;
+    const QString bulkList = "Bench";
+
+    for(int pass = 0; pass < repeat; pass++)
+    {
+        queryRun books = runQuery(&loader, libraryThread::booksQuery, librarySql::books(false) + librarySql::booksEnd(), {LIBRARYBENCH_MUSIC_TAG});
+        results.add("Read all books (first chunk)", books.firstMs);
+        results.add("Read all books", books.totalMs, QString::number(books.rows) + " rows");
+
+        queryRun lists = runQuery(&loader, libraryThread::playListsQuery, librarySql::playLists(),
+                                  {LIBRARYBENCH_LIST_PREFIX, librarySql::prefixEnd(LIBRARYBENCH_LIST_PREFIX)});
+        results.add("Read playlists", lists.totalMs, QString::number(lists.rows) + " rows");
+
+        // As musicLibrary::fillPlayLists: the order store is made to match what Calibre has
+        QElapsedTimer timer;
+        timer.start();
+        QHash<QString, QList<playListOrder::entry>> listEntries;
+        for(const QList<QStringList>& chunk : lists.chunks)
+            for(const QStringList& row : chunk)
+                listEntries[QString(row[1]).replace(LIBRARYBENCH_LIST_PREFIX, "")].append({row[3].toInt(), row[2].toInt()});
+        int changed = 0;
+        for(auto list = listEntries.constBegin(); list != listEntries.constEnd(); ++list) changed += listOrder.sync(list.key(), list.value());
+        listOrder.keepOnly(listEntries.keys());
+        results.add("Sync playlist order", timer.nsecsElapsed() / 1e6, QString::number(changed) + " lists changed");
+
+        QStringList listNames = listEntries.keys();
+        std::sort(listNames.begin(), listNames.end());
+        QString listName = listNames.value(0, "Concert 01");
+        QString listPrefix = LIBRARYBENCH_LIST_PREFIX + listName + "|";
+        queryRun listBooks = runQuery(&loader, libraryThread::booksQuery, librarySql::books(true) + librarySql::booksEnd(),
+                                      {listPrefix, librarySql::prefixEnd(listPrefix), LIBRARYBENCH_MUSIC_TAG});
+        results.add("Read one playlist's books", listBooks.totalMs, QString::number(listBooks.rows) + " rows");
+        loadModel(listModel, listBooks);
+        timer.start();
+        listModel.setListOrder(listModel.fieldColumn("BookID"), listOrder.positions(listName));
+        results.add("Put it in the list's order", timer.nsecsElapsed() / 1e6);
+
+        timer.start();
+        loadModel(model, books);
+        results.add("Load model and sort", timer.nsecsElapsed() / 1e6);
+
+        for(const QString& search : {"no. 1", "sonata", "sonnata", "gershwn", "x"})
+        {
+            timer.start();
+            model.setFilter(search);
+            results.add("Search \"" + search + "\"", timer.nsecsElapsed() / 1e6, QString::number(model.rowCount()) + " shown");
+        }
+        model.setFilter("");
+
+        timer.start();
+        model.setTagFilter({"Piano"}, true);
+        results.add("Tag filter, one tag", timer.nsecsElapsed() / 1e6, QString::number(model.rowCount()) + " shown");
+        timer.start();
+        model.setTagFilter({"Piano", "Jazz"}, true);
+        results.add("Tag filter, two tags, all", timer.nsecsElapsed() / 1e6, QString::number(model.rowCount()) + " shown");
+        timer.start();
+        model.setTagFilter({"Piano", "Jazz"}, false);
+        results.add("Tag filter, two tags, any", timer.nsecsElapsed() / 1e6, QString::number(model.rowCount()) + " shown");
+        timer.start();
+        int counted = model.facetCounts(tagFacets::tags).size();
+        results.add("Count every tag", timer.nsecsElapsed() / 1e6, QString::number(counted) + " tags");
+        model.setTagFilter(QStringList(), true);
+
+        QStringList collections = model.facetNames(tagFacets::collection);
+        timer.start();
+        model.setFacet(tagFacets::collection, collections.value(0));
+        results.add("Choose a collection", timer.nsecsElapsed() / 1e6, QString::number(model.rowCount()) + " shown");
+        timer.start();
+        counted = model.facetCounts(tagFacets::author).size();
+        results.add("Count authors in it", timer.nsecsElapsed() / 1e6, QString::number(counted) + " authors");
+        model.setFacet(tagFacets::collection, QString());
+        timer.start();
+        counted = model.facetCounts(tagFacets::author).size();
+        results.add("Count every author", timer.nsecsElapsed() / 1e6, QString::number(counted) + " authors");
+        if(pass == repeat - 1)
+            facetMemory = QString("Facets hold about %1 KB for %2 rows, %3 collections and %4 authors").arg(model.facetBytes() / 1024)
+                          .arg(model.loadedRows()).arg(model.facetNames(tagFacets::collection).size()).arg(model.facetNames(tagFacets::author).size());
+
+        // Every so many books, as a refresh that found them gone would (the model is loaded again next pass)
+        QSet<QString> removed;
+        for(int row = 0; row < model.loadedRows() && removed.size() < LIBRARYBENCH_REMOVED_BOOKS; row += std::max(1, model.loadedRows() / LIBRARYBENCH_REMOVED_BOOKS))
+            removed.insert(model.loadedText(row, model.fieldColumn("BookID")));
+        timer.start();
+        model.removeIds(model.fieldColumn("BookID"), removed);
+        results.add("Take books out", timer.nsecsElapsed() / 1e6, QString::number(removed.size()) + " books");
+
+        QString stamp = model.latest(model.fieldColumn("Modified"));
+        queryRun changes = runQuery(&loader, libraryThread::bookChangesQuery, librarySql::bookChanges(), {stamp});
+        results.add("Check for changed books", changes.totalMs, QString::number(changes.rows) + " rows");
+
+        // As musicLibrary::addBooksToList and removeBookFromList do it, on a list of our own
+        QList<int> bulk;
+        for(int i = 0; i < LIBRARYBENCH_BULK_BOOKS && i < model.rowCount(); i++) bulk.append(model.text(i, model.fieldColumn("BookID")).toInt());
+        QList<QPair<int,QString>> adding;
+        int position = listOrder.lastPosition(bulkList);
+        for(int book : bulk)
+        {
+            position += MUSICALPI_PLAYLIST_GAP;
+            listOrder.add(bulkList, position, book);
+            adding.append(qMakePair(book, playListOrder::tagName(LIBRARYBENCH_LIST_PREFIX + bulkList, position)));
+        }
+        QString error;
+        double ms = runTransaction(&loader, librarySql::addToList(adding), &error);
+        results.add("Add " + QString::number(bulk.size()) + " books to a list", ms, error == " / " ? "one transaction" : error);
+        ms = 0;
+        for(int book : bulk)
+        {
+            position = listOrder.position(bulkList, book);
+            listOrder.remove(bulkList, book);
+            ms += runTransaction(&loader, librarySql::removeFromList(book, playListOrder::tagName(LIBRARYBENCH_LIST_PREFIX + bulkList, position)), &error);
+            if(error != " / ") break;
+        }
+        results.add("Remove them again", ms, error == " / " ? "a transaction each" : error);
+        (void)counted;
+    }
+    results.print();
+    out << facetMemory << Qt::endl;
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    if(qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM")) qputenv("QT_QPA_PLATFORM", "offscreen");  // The model uses fonts and pixmaps, but nothing is shown
+    QGuiApplication app(argc, argv);
+    app.setApplicationName("librarybench");
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Makes a synthetic Calibre music library, or times the library's operations on one");
+    parser.addHelpOption();
+    parser.addPositionalArgument("command", "generate or run");
+    parser.addPositionalArgument("folder", "Folder for metadata.db");
+    parser.addPositionalArgument("books", "(generate) Number of books, e.g. 1000, 10000 or 100000");
+    QCommandLineOption immutable("immutable", "(run) Read the database immutable, as the calibreImmutable setting does");
+    QCommandLineOption mmap("mmap", "(run) SQLite memory mapped reads, MB (as calibreMmapMB)", "MB", "64");
+    QCommandLineOption cache("cache", "(run) SQLite page cache, MB (as calibreCacheMB)", "MB", "16");
+    QCommandLineOption repeat("repeat", "(run) Times to do each operation", "count", "5");
+    parser.addOptions({immutable, mmap, cache, repeat});
+    parser.process(app);
+    QStringList args = parser.positionalArguments();
+    if(args.size() == 3 && args[0] == "generate" && args[2].toInt() > 0) return generate(args[1], args[2].toInt());
+    if(args.size() == 2 && args[0] == "run")
+        return run(args[1], parser.isSet(immutable), parser.value(mmap).toInt(), parser.value(cache).toInt(), std::max(1, parser.value(repeat).toInt()));
+    parser.showHelp(1);
+}
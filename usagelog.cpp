@@ -0,0 +1,120 @@
+// Copyright 2023 by Linwood Ferguson, licensed under GNU GPLv3
+
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QSaveFile>
+#include <QDataStream>
+#include <QDateTime>
+#include <QStandardPaths>
+
+#include "usagelog.h"
+#include "piconstants.h"
+
+#include <algorithm>
+#include <cmath>
+
+#define USAGELOG_MAGIC 0x4D50554C   // "MPUL"
+#define USAGELOG_VERSION 1
+
+usageLog::usageLog()
+{
+    load();
+}
+
+QString usageLog::fileName()
+{
+    return QStandardPaths::writableLocation(QStandardPaths::AppLocalDataLocation) + "/usage.log";
+}
+
+double usageLog::scoreNow(const entry& thisEntry, qint64 now)
+{
+    double days = std::max((qint64)0, now - thisEntry.lastOpened) / (24.0 * 60 * 60 * 1000);
+    return thisEntry.score * std::pow(0.5, days / MUSICALPI_USAGE_HALF_LIFE_DAYS);
+}
+
+void usageLog::load()
+{
+    QFile file(fileName());
+    if(!file.open(QIODevice::ReadOnly)) return;  // Nothing played yet
+    QDataStream in(&file);
+    in.setVersion(QDataStream::Qt_6_0);
+    quint32 magic, version;
+    qint32 count;
+    in >> magic >> version >> count;
+    if(magic != USAGELOG_MAGIC || version != USAGELOG_VERSION) return;
+    for(int i = 0; i < count && in.status() == QDataStream::Ok; i++)
+    {
+        entry thisEntry;
+        qint32 startPage, lastPage, opens, spreadPages;
+        in >> thisEntry.filepath >> thisEntry.title >> startPage >> lastPage >> opens >> thisEntry.msOpen >> thisEntry.lastOpened >> thisEntry.score >> thisEntry.pageSize >> spreadPages;
+        thisEntry.startPage = startPage;
+        thisEntry.lastPage = lastPage;
+        thisEntry.opens = opens;
+        thisEntry.spreadPages = spreadPages;
+        if(in.status() == QDataStream::Ok) entries.append(thisEntry);
+    }
+    qDebug() << "Loaded " << entries.size() << " books played";
+}
+
+void usageLog::save()
+{
+    qint64 now = QDateTime::currentMSecsSinceEpoch();
+    if(entries.size() > MUSICALPI_USAGE_KEPT)
+    {
+        std::sort(entries.begin(), entries.end(), [now](const entry& a, const entry& b) { return scoreNow(a, now) > scoreNow(b, now); });
+        entries.erase(entries.begin() + MUSICALPI_USAGE_KEPT, entries.end());
+    }
+    QDir().mkpath(QStandardPaths::writableLocation(QStandardPaths::AppLocalDataLocation));
+    QSaveFile file(fileName());
+    if(!file.open(QIODevice::WriteOnly))
+    {
+        qDebug() << "Could not write " << file.fileName() << ", " << file.errorString();
+        return;
+    }
+    QDataStream out(&file);
+    out.setVersion(QDataStream::Qt_6_0);
+    out << (quint32)USAGELOG_MAGIC << (quint32)USAGELOG_VERSION << (qint32)entries.size();
+    for(const entry& thisEntry : entries)
+        out << thisEntry.filepath << thisEntry.title << (qint32)thisEntry.startPage << (qint32)thisEntry.lastPage << (qint32)thisEntry.opens << thisEntry.msOpen
+            << thisEntry.lastOpened << thisEntry.score << thisEntry.pageSize << (qint32)thisEntry.spreadPages;
+    if(!file.commit()) qDebug() << "Could not write " << file.fileName() << ", " << file.errorString();
+}
+
+void usageLog::opened(const QString& path, const QString& title, int startPage, QSize pageSize, int spreadPages)
+{
+    qint64 now = QDateTime::currentMSecsSinceEpoch();
+    auto found = std::find_if(entries.begin(), entries.end(), [&path](const entry& thisEntry) { return thisEntry.filepath == path; });
+    if(found == entries.end())
+    {
+        entries.append({path, title, startPage, startPage, 0, 0, now, 0.0, pageSize, spreadPages});
+        found = entries.end() - 1;
+    }
+    found->score = scoreNow(*found, now) + 1.0;
+    found->lastOpened = now;
+    found->opens++;
+    found->title = title;
+    found->startPage = startPage;
+    found->pageSize = pageSize;
+    found->spreadPages = spreadPages;
+    save();
+}
+
+void usageLog::closed(const QString& path, qint64 msOpen, int lastPage)
+{
+    auto found = std::find_if(entries.begin(), entries.end(), [&path](const entry& thisEntry) { return thisEntry.filepath == path; });
+    if(found == entries.end()) return;
+    found->msOpen += msOpen;
+    found->lastPage = lastPage;
+    found->score += std::min(msOpen / (double)MUSICALPI_USAGE_MS_PER_OPEN, 2.0);  // Time spent counts, but no more than a couple of opens' worth
+    save();
+}
+
+QList<usageLog::entry> usageLog::mostUsed(int count) const
+{
+    qint64 now = QDateTime::currentMSecsSinceEpoch();
+    QList<entry> result = entries;
+    std::sort(result.begin(), result.end(), [now](const entry& a, const entry& b) { return scoreNow(a, now) > scoreNow(b, now); });
+    if(result.size() > count) result.erase(result.begin() + count, result.end());
+    return result;
+}
@@ -0,0 +1,44 @@
+#ifndef USAGELOG_H
+#define USAGELOG_H
+
+// Copyright 2023 by Linwood Ferguson, licensed under GNU GPLv3
+
+#include <QString>
+#include <QList>
+#include <QSize>
+
+// Which books are played, how often and for how long, kept on local storage (one small file) so the library can
+// offer those played most (and most lately) at the top, and have their first pages rendered ahead (see pageCache).
+// Each book has a score: one for each time it's opened, and a little more for time spent in it, halving every
+// MUSICALPI_USAGE_HALF_LIFE_DAYS, so what's played today counts for more than what was played a lot last month.
+
+class usageLog
+{
+public:
+    struct entry
+    {
+        QString filepath;
+        QString title;
+        int startPage;        // It was last opened at (1 unless it was a song in it)
+        int lastPage;         // Leftmost page showing when it was last closed
+        int opens;
+        qint64 msOpen;        // Time it has been open, in all
+        qint64 lastOpened;    // ms since epoch
+        double score;         // as of lastOpened
+        QSize pageSize;       // Its first pages were rendered for, when last opened
+        int spreadPages;      //     and how many of them were showing
+    };
+    usageLog();
+    void opened(const QString& path, const QString& title, int startPage, QSize pageSize, int spreadPages);
+    void closed(const QString& path, qint64 msOpen, int lastPage);
+    QList<entry> mostUsed(int count) const;  // Best score first
+
+private:
+    QList<entry> entries;
+    static QString fileName();
+    static double scoreNow(const entry& thisEntry, qint64 now);
+    void load();
+    void save();              // (keeping only the best MUSICALPI_USAGE_KEPT)
+};
+
+#endif // USAGELOG_H